@@ -0,0 +1,100 @@
+#include "json_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_MIN_CHUNK_SIZE (64 * 1024)
+#define ARENA_MAX_CHUNK_SIZE (4 * 1024 * 1024)
+
+static JsonArenaChunk* chunk_create(size_t size) {
+    JsonArenaChunk* chunk = malloc(sizeof(JsonArenaChunk) + size);
+    if (!chunk) return NULL;
+    
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+void json_arena_init(JsonArena* arena) {
+    arena->head = NULL;
+    arena->next_chunk_size = ARENA_MIN_CHUNK_SIZE;
+}
+
+static void* arena_alloc(JsonArena* arena, size_t size, size_t align) {
+    JsonArenaChunk* head = arena->head;
+    if (head) {
+        size_t offset = (head->used + align - 1) & ~(align - 1);
+        if (offset <= head->size && head->size - offset >= size) {
+            head->used = offset + size;
+            return (char*)head->data + offset;
+        }
+    }
+    
+    // Oversized requests get a dedicated chunk behind the current one so
+    // the free space left in the head chunk is not wasted
+    if (head && size > arena->next_chunk_size / 4) {
+        JsonArenaChunk* chunk = chunk_create(size);
+        if (!chunk) return NULL;
+        chunk->used = size;
+        chunk->next = head->next;
+        head->next = chunk;
+        return chunk->data;
+    }
+    
+    size_t chunk_size = arena->next_chunk_size;
+    while (chunk_size < size) chunk_size *= 2;
+    
+    JsonArenaChunk* chunk = chunk_create(chunk_size);
+    if (!chunk) return NULL;
+    
+    chunk->used = size;
+    chunk->next = head;
+    arena->head = chunk;
+    if (arena->next_chunk_size < ARENA_MAX_CHUNK_SIZE) {
+        arena->next_chunk_size *= 2;
+    }
+    return chunk->data;
+}
+
+void* json_arena_alloc(JsonArena* arena, size_t size) {
+    return arena_alloc(arena, size, sizeof(void*));
+}
+
+char* json_arena_strndup(JsonArena* arena, const char* str, size_t len) {
+    char* copy = arena_alloc(arena, len + 1, 1);
+    if (!copy) return NULL;
+    
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+// Moves all chunks of `src` into `dst`, leaving `src` empty. Allocation
+// continues in the head chunk of `dst`.
+void json_arena_adopt(JsonArena* dst, JsonArena* src) {
+    JsonArenaChunk* chunks = src->head;
+    src->head = NULL;
+    if (!chunks) return;
+    
+    if (!dst->head) {
+        dst->head = chunks;
+        return;
+    }
+    
+    JsonArenaChunk* tail = chunks;
+    while (tail->next) tail = tail->next;
+    tail->next = dst->head->next;
+    dst->head->next = chunks;
+}
+
+void json_arena_release(JsonArena* arena) {
+    // The arena itself may live inside one of its chunks
+    JsonArenaChunk* chunk = arena->head;
+    arena->head = NULL;
+    
+    while (chunk) {
+        JsonArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
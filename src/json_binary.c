@@ -0,0 +1,823 @@
+#include "json_internal.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// CBOR (RFC 8949) and MessagePack conversion. Both are tag-length-value
+// encodings: a lead byte gives the type and either holds a small value or
+// says how many big-endian bytes of length or value follow.
+
+// Writes `lead` followed by the low `bytes` bytes of `value`, big-endian
+static void put_head(JsonWriter* writer, unsigned char lead, uint64_t value, size_t bytes) {
+    unsigned char buffer[9];
+    buffer[0] = lead;
+    for (size_t i = 0; i < bytes; i++) {
+        buffer[bytes - i] = (unsigned char)(value >> (8 * i));
+    }
+    json_writer_put(writer, (const char*)buffer, bytes + 1);
+}
+
+static void cbor_head(JsonWriter* writer, unsigned major, uint64_t value) {
+    unsigned char lead = (unsigned char)(major << 5);
+    if (value < 24) {
+        put_head(writer, lead | (unsigned char)value, 0, 0);
+    } else if (value <= UINT8_MAX) {
+        put_head(writer, lead | 24, value, 1);
+    } else if (value <= UINT16_MAX) {
+        put_head(writer, lead | 25, value, 2);
+    } else if (value <= UINT32_MAX) {
+        put_head(writer, lead | 26, value, 4);
+    } else {
+        put_head(writer, lead | 27, value, 8);
+    }
+}
+
+// MessagePack sizes: the fix form below `fix_limit`, then 8 (strings only),
+// 16 and 32-bit lengths from `lead8`, `lead16` and `lead32`
+static bool msgpack_size(JsonWriter* writer, uint64_t size, unsigned char fix, uint64_t fix_limit,
+                         unsigned char lead8, unsigned char lead16, unsigned char lead32) {
+    if (size < fix_limit) {
+        put_head(writer, fix | (unsigned char)size, 0, 0);
+    } else if (lead8 && size <= UINT8_MAX) {
+        put_head(writer, lead8, size, 1);
+    } else if (size <= UINT16_MAX) {
+        put_head(writer, lead16, size, 2);
+    } else if (size <= UINT32_MAX) {
+        put_head(writer, lead32, size, 4);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void msgpack_uint(JsonWriter* writer, uint64_t value) {
+    if (value < 0x80) {
+        put_head(writer, (unsigned char)value, 0, 0);
+    } else if (value <= UINT8_MAX) {
+        put_head(writer, 0xcc, value, 1);
+    } else if (value <= UINT16_MAX) {
+        put_head(writer, 0xcd, value, 2);
+    } else if (value <= UINT32_MAX) {
+        put_head(writer, 0xce, value, 4);
+    } else {
+        put_head(writer, 0xcf, value, 8);
+    }
+}
+
+static void msgpack_int(JsonWriter* writer, int64_t value) {
+    if (value >= -32) {
+        put_head(writer, (unsigned char)value, 0, 0);
+    } else if (value >= INT8_MIN) {
+        put_head(writer, 0xd0, (uint64_t)value, 1);
+    } else if (value >= INT16_MIN) {
+        put_head(writer, 0xd1, (uint64_t)value, 2);
+    } else if (value >= INT32_MIN) {
+        put_head(writer, 0xd2, (uint64_t)value, 4);
+    } else {
+        put_head(writer, 0xd3, (uint64_t)value, 8);
+    }
+}
+
+// Doubles that survive the round trip through float are written as
+// float32, the others as float64
+static void put_double(JsonWriter* writer, JsonBinaryFormat format, double value) {
+    if (value >= -FLT_MAX && value <= FLT_MAX && (double)(float)value == value) {
+        float single = (float)value;
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        put_head(writer, format == JSON_BINARY_CBOR ? 0xfa : 0xca, bits, 4);
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        put_head(writer, format == JSON_BINARY_CBOR ? 0xfb : 0xcb, bits, 8);
+    }
+}
+
+static void put_number(JsonWriter* writer, JsonBinaryFormat format, JsonNumber number) {
+    switch (number.type) {
+        case JSON_NUMBER_INT:
+            if (number.i >= 0) {
+                if (format == JSON_BINARY_CBOR) {
+                    cbor_head(writer, 0, (uint64_t)number.i);
+                } else {
+                    msgpack_uint(writer, (uint64_t)number.i);
+                }
+            } else if (format == JSON_BINARY_CBOR) {
+                cbor_head(writer, 1, ~(uint64_t)number.i);  // -1 - n
+            } else {
+                msgpack_int(writer, number.i);
+            }
+            break;
+        case JSON_NUMBER_UINT:
+            if (format == JSON_BINARY_CBOR) {
+                cbor_head(writer, 0, number.u);
+            } else {
+                msgpack_uint(writer, number.u);
+            }
+            break;
+        case JSON_NUMBER_DOUBLE:
+            put_double(writer, format, number.d);
+            break;
+    }
+}
+
+typedef struct {
+    JsonWriter* writer;
+    JsonBinaryFormat format;
+    char* scratch;              // Unescaped text
+    size_t scratch_capacity;
+    size_t* counts;             // MessagePack: sizes of the containers, in order
+    size_t count_next;
+} BinaryEncoder;
+
+// Writes a key or a string with its escapes decoded
+static bool encode_text(BinaryEncoder* encoder, const JsonEvent* event) {
+    JsonSlice text = event->text;
+    if (event->escaped) {
+        if (text.length > encoder->scratch_capacity) {
+            char* scratch = realloc(encoder->scratch, text.length);
+            if (!scratch) return false;
+            encoder->scratch = scratch;
+            encoder->scratch_capacity = text.length;
+        }
+        text.length = json_unescape_into(text, encoder->scratch);
+        text.data = encoder->scratch;
+    }
+    
+    if (encoder->format == JSON_BINARY_CBOR) {
+        cbor_head(encoder->writer, 3, text.length);
+    } else if (!msgpack_size(encoder->writer, text.length, 0xa0, 32, 0xd9, 0xda, 0xdb)) {
+        return false;
+    }
+    return json_writer_put(encoder->writer, text.data, text.length);
+}
+
+static bool encode_event(BinaryEncoder* encoder, const JsonEvent* event) {
+    JsonWriter* writer = encoder->writer;
+    bool cbor = encoder->format == JSON_BINARY_CBOR;
+    
+    switch (event->type) {
+        case JSON_EVENT_START_OBJECT:
+        case JSON_EVENT_START_ARRAY: {
+            bool object = event->type == JSON_EVENT_START_OBJECT;
+            if (cbor) {
+                put_head(writer, object ? 0xbf : 0x9f, 0, 0);
+                break;
+            }
+            size_t count = encoder->counts[encoder->count_next++];
+            return object ? msgpack_size(writer, count, 0x80, 16, 0, 0xde, 0xdf) :
+                            msgpack_size(writer, count, 0x90, 16, 0, 0xdc, 0xdd);
+        }
+        case JSON_EVENT_END_OBJECT:
+        case JSON_EVENT_END_ARRAY:
+            if (cbor) put_head(writer, 0xff, 0, 0);  // Break
+            break;
+        case JSON_EVENT_KEY:
+        case JSON_EVENT_STRING:
+            return encode_text(encoder, event);
+        case JSON_EVENT_NUMBER:
+            put_number(writer, encoder->format, event->number);
+            break;
+        case JSON_EVENT_BOOL:
+            if (cbor) {
+                put_head(writer, event->text.data[0] == 't' ? 0xf5 : 0xf4, 0, 0);
+            } else {
+                put_head(writer, event->text.data[0] == 't' ? 0xc3 : 0xc2, 0, 0);
+            }
+            break;
+        case JSON_EVENT_NULL:
+            put_head(writer, cbor ? 0xf6 : 0xc0, 0, 0);
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+// Sizes of all the containers of the document, in the order they open
+static size_t* count_containers(JsonParser* parser) {
+    size_t* counts = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t* open = NULL;        // Their positions in counts, while open
+    size_t depth = 0;
+    size_t open_capacity = 0;
+    bool ok = true;
+    
+    JsonReader reader;
+    JsonEvent event;
+    json_reader_init(&reader, parser);
+    while (ok && json_reader_next(&reader, &event)) {
+        switch (event.type) {
+            case JSON_EVENT_KEY:
+                continue;
+            case JSON_EVENT_END_OBJECT:
+            case JSON_EVENT_END_ARRAY:
+                depth--;
+                continue;
+            default:
+                break;
+        }
+        if (depth > 0) counts[open[depth - 1]]++;
+        if (event.type != JSON_EVENT_START_OBJECT && event.type != JSON_EVENT_START_ARRAY) continue;
+        
+        if (count == capacity) {
+            size_t new_capacity = capacity == 0 ? JSON_BUFFER_SIZE : capacity * 2;
+            size_t* new_counts = realloc(counts, new_capacity * sizeof(size_t));
+            ok = new_counts != NULL;
+            if (!ok) break;
+            counts = new_counts;
+            capacity = new_capacity;
+        }
+        if (depth == open_capacity) {
+            size_t new_capacity = open_capacity == 0 ? JSON_INITIAL_CAPACITY : open_capacity * 2;
+            size_t* new_open = realloc(open, new_capacity * sizeof(size_t));
+            ok = new_open != NULL;
+            if (!ok) break;
+            open = new_open;
+            open_capacity = new_capacity;
+        }
+        counts[count] = 0;
+        open[depth++] = count++;
+    }
+    json_reader_release(&reader);
+    free(open);
+    
+    if (!ok || event.type != JSON_EVENT_END) {
+        free(counts);
+        return NULL;
+    }
+    
+    // A document without containers still gets a non-NULL result
+    return counts ? counts : malloc(sizeof(size_t));
+}
+
+bool json_write_binary(JsonParser* parser, JsonBinaryFormat format, JsonWriter* writer) {
+    if (!parser || !writer) return false;
+    
+    BinaryEncoder encoder = { writer, format, NULL, 0, NULL, 0 };
+    if (format == JSON_BINARY_MSGPACK) {
+        if (parser->source || !parser->input_complete) {
+            json_parser_error(parser, "MessagePack output needs the whole input in memory");
+            return false;
+        }
+        encoder.counts = count_containers(parser);
+        if (!encoder.counts) return false;
+    }
+    
+    JsonReader reader;
+    JsonEvent event;
+    bool ok = true;
+    json_reader_init(&reader, parser);
+    while (ok && json_reader_next(&reader, &event)) {
+        ok = encode_event(&encoder, &event);
+    }
+    json_reader_release(&reader);
+    free(encoder.scratch);
+    free(encoder.counts);
+    
+    if (ok && event.type != JSON_EVENT_END) return false;
+    if (!ok) json_parser_error(parser, "Value too large to encode");
+    return ok && !writer->failed;
+}
+
+// Decoding. Items are read recursively, like the recursive descent parser,
+// with the same depth limit.
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    size_t pos;
+    JsonWriter* writer;
+    const char* error;
+    size_t error_offset;
+} BinaryDecoder;
+
+static bool decode_fail(BinaryDecoder* decoder, const char* message) {
+    if (!decoder->error) {
+        decoder->error = message;
+        decoder->error_offset = decoder->pos;
+    }
+    return false;
+}
+
+// Reads a big-endian unsigned integer of `bytes` bytes
+static bool read_uint(BinaryDecoder* decoder, size_t bytes, uint64_t* value) {
+    if (decoder->size - decoder->pos < bytes) return decode_fail(decoder, "Unexpected end of input");
+    
+    uint64_t result = 0;
+    for (size_t i = 0; i < bytes; i++) {
+        result = (result << 8) | decoder->data[decoder->pos + i];
+    }
+    decoder->pos += bytes;
+    *value = result;
+    return true;
+}
+
+static bool take_bytes(BinaryDecoder* decoder, uint64_t length, const unsigned char** bytes) {
+    if (decoder->size - decoder->pos < length) return decode_fail(decoder, "Unexpected end of input");
+    *bytes = decoder->data + decoder->pos;
+    decoder->pos += (size_t)length;
+    return true;
+}
+
+static void write_uint(JsonWriter* writer, uint64_t value) {
+    char buffer[20];
+    size_t i = sizeof(buffer);
+    do {
+        buffer[--i] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    json_writer_put(writer, buffer + i, sizeof(buffer) - i);
+}
+
+static void write_int(JsonWriter* writer, int64_t value) {
+    if (value < 0) {
+        json_writer_put(writer, "-", 1);
+        write_uint(writer, 0 - (uint64_t)value);
+    } else {
+        write_uint(writer, (uint64_t)value);
+    }
+}
+
+// Writes the shortest text that reads back as the same double. Floats
+// are widened first: JSON readers parse numbers as doubles, so the text
+// must name the widened value, not merely round to the same float.
+// Integral values keep a ".0", so they read back as floats; JSON has no
+// NaN or infinity, which become null.
+static void write_double(JsonWriter* writer, double value) {
+    if (!isfinite(value)) {
+        json_writer_put(writer, "null", 4);
+        return;
+    }
+    
+    char buffer[32];
+    int length = 0;
+    for (int precision = 15; precision <= 17; precision++) {
+        length = snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+        if (strtod(buffer, NULL) == value) break;
+    }
+    json_writer_put(writer, buffer, (size_t)length);
+    if (!strpbrk(buffer, ".e")) json_writer_put(writer, ".0", 2);
+}
+
+// Bytes that cannot appear unescaped in a JSON string
+static const char* const string_escapes[32] = {
+    "\\u0000", "\\u0001", "\\u0002", "\\u0003", "\\u0004", "\\u0005", "\\u0006", "\\u0007",
+    "\\b", "\\t", "\\n", "\\u000b", "\\f", "\\r", "\\u000e", "\\u000f",
+    "\\u0010", "\\u0011", "\\u0012", "\\u0013", "\\u0014", "\\u0015", "\\u0016", "\\u0017",
+    "\\u0018", "\\u0019", "\\u001a", "\\u001b", "\\u001c", "\\u001d", "\\u001e", "\\u001f"
+};
+
+// Writes text as the inside of a JSON string, copying the runs that need
+// no escape in one go
+static void write_escaped(JsonWriter* writer, const unsigned char* text, size_t length) {
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = text[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        
+        json_writer_put(writer, (const char*)text + start, i - start);
+        if (c < 0x20) {
+            json_writer_put(writer, string_escapes[c], strlen(string_escapes[c]));
+        } else {
+            char escape[2] = { '\\', (char)c };
+            json_writer_put(writer, escape, 2);
+        }
+        start = i + 1;
+    }
+    json_writer_put(writer, (const char*)text + start, length - start);
+}
+
+// Base64url without padding (RFC 4648 section 5), as RFC 8949 maps byte
+// strings to JSON. The bytes of a chunked string are encoded as one: up to
+// two bytes that do not fill a group are carried to the next chunk.
+typedef struct {
+    unsigned char carry[3];
+    size_t carried;
+} Base64State;
+
+static const char base64url[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+static void base64_group(JsonWriter* writer, const unsigned char* bytes, size_t count) {
+    uint32_t group = (uint32_t)bytes[0] << 16;
+    if (count > 1) group |= (uint32_t)bytes[1] << 8;
+    if (count > 2) group |= bytes[2];
+    
+    char out[4] = {
+        base64url[(group >> 18) & 63], base64url[(group >> 12) & 63],
+        base64url[(group >> 6) & 63], base64url[group & 63]
+    };
+    json_writer_put(writer, out, count + 1);
+}
+
+static void base64_write(JsonWriter* writer, Base64State* state, const unsigned char* bytes, size_t length) {
+    size_t i = 0;
+    while (state->carried > 0 && i < length) {
+        state->carry[state->carried++] = bytes[i++];
+        if (state->carried == 3) {
+            base64_group(writer, state->carry, 3);
+            state->carried = 0;
+        }
+    }
+    for (; i + 3 <= length; i += 3) {
+        base64_group(writer, bytes + i, 3);
+    }
+    while (i < length) {
+        state->carry[state->carried++] = bytes[i++];
+    }
+}
+
+static void base64_finish(JsonWriter* writer, Base64State* state) {
+    if (state->carried > 0) base64_group(writer, state->carry, state->carried);
+    state->carried = 0;
+}
+
+// CBOR
+
+// Reads the argument of a lead byte: the value itself, a length or a
+// count. Sets `indefinite` for the 31 of chunked strings and open-ended
+// containers, which is only valid for major types 2 to 5.
+static bool cbor_argument(BinaryDecoder* decoder, unsigned char lead, uint64_t* value, bool* indefinite) {
+    unsigned info = lead & 31;
+    *indefinite = false;
+    if (info < 24) {
+        *value = info;
+        return true;
+    }
+    if (info <= 27) return read_uint(decoder, (size_t)1 << (info - 24), value);
+    if (info == 31 && (lead >> 5) >= 2 && (lead >> 5) <= 5) {
+        *indefinite = true;
+        return true;
+    }
+    decoder->pos--;
+    return decode_fail(decoder, "Invalid CBOR additional information");
+}
+
+static bool cbor_at_break(BinaryDecoder* decoder) {
+    if (decoder->pos < decoder->size && decoder->data[decoder->pos] == 0xff) {
+        decoder->pos++;
+        return true;
+    }
+    return false;
+}
+
+// Decodes a text or byte string, definite or chunked, into the body of a
+// JSON string
+static bool cbor_string(BinaryDecoder* decoder, unsigned major, uint64_t length, bool indefinite) {
+    Base64State base64 = { { 0 }, 0 };
+    const unsigned char* bytes;
+    for (;;) {
+        if (indefinite) {
+            if (cbor_at_break(decoder)) break;
+            if (decoder->pos >= decoder->size) return decode_fail(decoder, "Unexpected end of input");
+            
+            unsigned char lead = decoder->data[decoder->pos++];
+            bool nested;
+            if ((unsigned)(lead >> 5) != major) {
+                decoder->pos--;
+                return decode_fail(decoder, "Invalid chunk in CBOR string");
+            }
+            if (!cbor_argument(decoder, lead, &length, &nested)) return false;
+            if (nested) {
+                decoder->pos--;
+                return decode_fail(decoder, "Invalid chunk in CBOR string");
+            }
+        }
+        if (!take_bytes(decoder, length, &bytes)) return false;
+        
+        if (major == 3) {
+            write_escaped(decoder->writer, bytes, (size_t)length);
+        } else {
+            base64_write(decoder->writer, &base64, bytes, (size_t)length);
+        }
+        if (!indefinite) break;
+    }
+    base64_finish(decoder->writer, &base64);
+    return true;
+}
+
+static double half_to_double(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+    
+    if (exponent == 31) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else if (exponent > 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        // Subnormal: shift the mantissa up until its leading bit is the
+        // implicit one
+        exponent = 113;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static bool cbor_item(BinaryDecoder* decoder, size_t depth, bool key);
+
+// Writes an array or map; `count` pairs for a map
+static bool cbor_container(BinaryDecoder* decoder, bool map, uint64_t count, bool indefinite, size_t depth) {
+    JsonWriter* writer = decoder->writer;
+    json_writer_put(writer, map ? "{" : "[", 1);
+    for (uint64_t i = 0; indefinite || i < count; i++) {
+        if (indefinite && cbor_at_break(decoder)) break;
+        if (i > 0) json_writer_put(writer, ",", 1);
+        if (map) {
+            if (!cbor_item(decoder, depth + 1, true)) return false;
+            json_writer_put(writer, ":", 1);
+        }
+        if (!cbor_item(decoder, depth + 1, false)) return false;
+    }
+    json_writer_put(writer, map ? "}" : "]", 1);
+    return true;
+}
+
+// Decodes one item. A map key must be a string or an integer, and is
+// written as a JSON string.
+static bool cbor_item(BinaryDecoder* decoder, size_t depth, bool key) {
+    if (depth > JSON_MAX_DEPTH) return decode_fail(decoder, "Maximum nesting depth exceeded");
+    if (decoder->pos >= decoder->size) return decode_fail(decoder, "Unexpected end of input");
+    
+    JsonWriter* writer = decoder->writer;
+    size_t start = decoder->pos;
+    unsigned char lead = decoder->data[decoder->pos++];
+    unsigned major = lead >> 5;
+    uint64_t value;
+    bool indefinite;
+    if (lead == 0xff) {
+        decoder->pos = start;
+        return decode_fail(decoder, "Unexpected CBOR break");
+    }
+    if (major != 7 && !cbor_argument(decoder, lead, &value, &indefinite)) return false;
+    if (key && (major == 4 || major == 5 || major == 7)) {
+        decoder->pos = start;
+        return decode_fail(decoder, "Map key is not a string or an integer");
+    }
+    
+    switch (major) {
+        case 0:
+        case 1:
+            if (key) json_writer_put(writer, "\"", 1);
+            if (major == 1) {
+                // -1 - value, which may be below INT64_MIN
+                json_writer_put(writer, "-", 1);
+                if (value == UINT64_MAX) {
+                    json_writer_put(writer, "18446744073709551616", 20);
+                } else {
+                    write_uint(writer, value + 1);
+                }
+            } else {
+                write_uint(writer, value);
+            }
+            if (key) json_writer_put(writer, "\"", 1);
+            return true;
+            
+        case 2:
+        case 3:
+            json_writer_put(writer, "\"", 1);
+            if (!cbor_string(decoder, major, value, indefinite)) return false;
+            json_writer_put(writer, "\"", 1);
+            return true;
+            
+        case 4:
+        case 5:
+            return cbor_container(decoder, major == 5, value, indefinite, depth);
+            
+        case 6:
+            // Tags only annotate the item that follows
+            return cbor_item(decoder, depth + 1, key);
+            
+        default:
+            break;
+    }
+    
+    unsigned info = lead & 31;
+    uint64_t bits;
+    switch (info) {
+        case 20:
+            json_writer_put(writer, "false", 5);
+            return true;
+        case 21:
+            json_writer_put(writer, "true", 4);
+            return true;
+        case 25:
+            if (!read_uint(decoder, 2, &bits)) return false;
+            write_double(writer, half_to_double((uint16_t)bits));
+            return true;
+        case 26: {
+            if (!read_uint(decoder, 4, &bits)) return false;
+            uint32_t single_bits = (uint32_t)bits;
+            float single;
+            memcpy(&single, &single_bits, sizeof(single));
+            write_double(writer, (double)single);
+            return true;
+        }
+        case 27: {
+            if (!read_uint(decoder, 8, &bits)) return false;
+            double number;
+            memcpy(&number, &bits, sizeof(number));
+            write_double(writer, number);
+            return true;
+        }
+        case 24:
+            if (!read_uint(decoder, 1, &bits)) return false;
+            break;
+        case 28:
+        case 29:
+        case 30:
+            decoder->pos = start;
+            return decode_fail(decoder, "Invalid CBOR additional information");
+        default:
+            break;
+    }
+    
+    // null, undefined and the unassigned simple values
+    json_writer_put(writer, "null", 4);
+    return true;
+}
+
+// MessagePack
+
+static bool msgpack_item(BinaryDecoder* decoder, size_t depth, bool key);
+
+static bool msgpack_container(BinaryDecoder* decoder, bool map, uint64_t count, size_t depth) {
+    JsonWriter* writer = decoder->writer;
+    json_writer_put(writer, map ? "{" : "[", 1);
+    for (uint64_t i = 0; i < count; i++) {
+        if (i > 0) json_writer_put(writer, ",", 1);
+        if (map) {
+            if (!msgpack_item(decoder, depth + 1, true)) return false;
+            json_writer_put(writer, ":", 1);
+        }
+        if (!msgpack_item(decoder, depth + 1, false)) return false;
+    }
+    json_writer_put(writer, map ? "}" : "]", 1);
+    return true;
+}
+
+// Writes `length` bytes as a JSON string: text escaped, binary in base64url
+static bool msgpack_string(BinaryDecoder* decoder, uint64_t length, bool text) {
+    const unsigned char* bytes;
+    if (!take_bytes(decoder, length, &bytes)) return false;
+    
+    json_writer_put(decoder->writer, "\"", 1);
+    if (text) {
+        write_escaped(decoder->writer, bytes, (size_t)length);
+    } else {
+        Base64State base64 = { { 0 }, 0 };
+        base64_write(decoder->writer, &base64, bytes, (size_t)length);
+        base64_finish(decoder->writer, &base64);
+    }
+    json_writer_put(decoder->writer, "\"", 1);
+    return true;
+}
+
+static bool msgpack_integer(BinaryDecoder* decoder, uint64_t value, bool is_signed, bool key) {
+    if (key) json_writer_put(decoder->writer, "\"", 1);
+    if (is_signed) {
+        write_int(decoder->writer, (int64_t)value);
+    } else {
+        write_uint(decoder->writer, value);
+    }
+    if (key) json_writer_put(decoder->writer, "\"", 1);
+    return true;
+}
+
+// Decodes one object. Map keys must be strings, binary or integers.
+static bool msgpack_item(BinaryDecoder* decoder, size_t depth, bool key) {
+    if (depth > JSON_MAX_DEPTH) return decode_fail(decoder, "Maximum nesting depth exceeded");
+    if (decoder->pos >= decoder->size) return decode_fail(decoder, "Unexpected end of input");
+    
+    JsonWriter* writer = decoder->writer;
+    size_t start = decoder->pos;
+    unsigned char lead = decoder->data[decoder->pos++];
+    uint64_t value;
+    
+    if (lead <= 0x7f) return msgpack_integer(decoder, lead, false, key);
+    if (lead >= 0xe0) return msgpack_integer(decoder, (uint64_t)(int64_t)(int8_t)lead, true, key);
+    if (lead >= 0xa0 && lead <= 0xbf) return msgpack_string(decoder, lead & 0x1f, true);
+    
+    bool scalar_key = (lead >= 0xc4 && lead <= 0xc6) || (lead >= 0xcc && lead <= 0xd3) ||
+                      (lead >= 0xd9 && lead <= 0xdb);
+    if (key && !scalar_key) {
+        decoder->pos = start;
+        return decode_fail(decoder, "Map key is not a string or an integer");
+    }
+    
+    if (lead <= 0x8f) return msgpack_container(decoder, true, lead & 0x0f, depth);
+    if (lead <= 0x9f) return msgpack_container(decoder, false, lead & 0x0f, depth);
+    
+    switch (lead) {
+        case 0xc0:
+            json_writer_put(writer, "null", 4);
+            return true;
+        case 0xc2:
+            json_writer_put(writer, "false", 5);
+            return true;
+        case 0xc3:
+            json_writer_put(writer, "true", 4);
+            return true;
+        case 0xc4:
+        case 0xc5:
+        case 0xc6:
+            return read_uint(decoder, (size_t)1 << (lead - 0xc4), &value) &&
+                   msgpack_string(decoder, value, false);
+        case 0xc7:
+        case 0xc8:
+        case 0xc9:
+            // Extensions: the type byte is dropped and the data kept as binary
+            return read_uint(decoder, (size_t)1 << (lead - 0xc7), &value) &&
+                   read_uint(decoder, 1, &(uint64_t){ 0 }) &&
+                   msgpack_string(decoder, value, false);
+        case 0xca: {
+            if (!read_uint(decoder, 4, &value)) return false;
+            uint32_t bits = (uint32_t)value;
+            float single;
+            memcpy(&single, &bits, sizeof(single));
+            write_double(writer, (double)single);
+            return true;
+        }
+        case 0xcb: {
+            if (!read_uint(decoder, 8, &value)) return false;
+            double number;
+            memcpy(&number, &value, sizeof(number));
+            write_double(writer, number);
+            return true;
+        }
+        case 0xcc:
+        case 0xcd:
+        case 0xce:
+        case 0xcf:
+            return read_uint(decoder, (size_t)1 << (lead - 0xcc), &value) &&
+                   msgpack_integer(decoder, value, false, key);
+        case 0xd0:
+        case 0xd1:
+        case 0xd2:
+        case 0xd3: {
+            size_t bytes = (size_t)1 << (lead - 0xd0);
+            if (!read_uint(decoder, bytes, &value)) return false;
+            // Sign-extend from the top bit of the value read
+            if (bytes < 8 && (value >> (8 * bytes - 1))) value |= UINT64_MAX << (8 * bytes);
+            return msgpack_integer(decoder, value, true, key);
+        }
+        case 0xd4:
+        case 0xd5:
+        case 0xd6:
+        case 0xd7:
+        case 0xd8:
+            return read_uint(decoder, 1, &value) &&
+                   msgpack_string(decoder, (uint64_t)1 << (lead - 0xd4), false);
+        case 0xd9:
+        case 0xda:
+        case 0xdb:
+            return read_uint(decoder, (size_t)1 << (lead - 0xd9), &value) &&
+                   msgpack_string(decoder, value, true);
+        case 0xdc:
+        case 0xdd:
+            return read_uint(decoder, lead == 0xdc ? 2 : 4, &value) &&
+                   msgpack_container(decoder, false, value, depth);
+        case 0xde:
+        case 0xdf:
+            return read_uint(decoder, lead == 0xde ? 2 : 4, &value) &&
+                   msgpack_container(decoder, true, value, depth);
+        default:
+            break;
+    }
+    
+    decoder->pos = start;
+    return decode_fail(decoder, "Invalid MessagePack type byte");
+}
+
+bool json_read_binary(const char* data, size_t size, JsonBinaryFormat format, JsonWriter* writer,
+                      const char** error, size_t* offset) {
+    if (!data || !writer) return false;
+    
+    BinaryDecoder decoder = { (const unsigned char*)data, size, 0, writer, NULL, 0 };
+    if (size == 0) decode_fail(&decoder, "Empty input");
+    while (!decoder.error && decoder.pos < size) {
+        bool ok = format == JSON_BINARY_CBOR ? cbor_item(&decoder, 0, false) :
+                                               msgpack_item(&decoder, 0, false);
+        if (ok) json_writer_put(writer, "\n", 1);
+    }
+    
+    if (decoder.error) {
+        if (error) *error = decoder.error;
+        if (offset) *offset = decoder.error_offset;
+        return false;
+    }
+    return !writer->failed;
+}
@@ -0,0 +1,482 @@
+#include "json_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Flattened documents: a line "PATH: VALUE" per scalar, in document order.
+// The path is $ followed by .name or ["name"] for members and [N] for
+// elements; the value is the JSON text of the scalar as written. Empty
+// containers are written as {} or [], so the lines hold the whole document.
+
+// Member names written after a dot: ASCII letters and digits, '_', '-',
+// '$' and any byte of a multibyte UTF-8 sequence. Others are quoted.
+static bool name_byte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || c == '-' || c == '$' || c >= 0x80;
+}
+
+bool json_path_name_is_plain(JsonSlice name) {
+    if (name.length == 0) return false;
+    for (size_t i = 0; i < name.length; i++) {
+        if (!name_byte((unsigned char)name.data[i])) return false;
+    }
+    return true;
+}
+
+// Path of the value being visited: one buffer that steps are appended to
+// and cut back from in place, with the length it had at each open
+// container
+typedef struct {
+    char* text;
+    size_t length;
+    size_t capacity;
+    size_t* marks;
+    size_t depth;
+    size_t mark_capacity;
+} FlatPath;
+
+static bool path_put(FlatPath* path, const char* data, size_t length) {
+    if (length > path->capacity - path->length) {
+        size_t new_capacity = path->capacity == 0 ? JSON_PATH_MAX_LENGTH : path->capacity * 2;
+        while (new_capacity - path->length < length) new_capacity *= 2;
+        char* new_text = realloc(path->text, new_capacity);
+        if (!new_text) return false;
+        path->text = new_text;
+        path->capacity = new_capacity;
+    }
+    memcpy(path->text + path->length, data, length);
+    path->length += length;
+    return true;
+}
+
+// Member names are raw string text, escapes as written, which is also
+// valid between the quotes of ["name"]
+static bool path_member(FlatPath* path, JsonSlice name) {
+    if (json_path_name_is_plain(name)) {
+        return path_put(path, ".", 1) && path_put(path, name.data, name.length);
+    }
+    return path_put(path, "[\"", 2) && path_put(path, name.data, name.length) && path_put(path, "\"]", 2);
+}
+
+static bool path_element(FlatPath* path, size_t index) {
+    char buffer[24];
+    size_t i = sizeof(buffer);
+    buffer[--i] = ']';
+    do {
+        buffer[--i] = (char)('0' + index % 10);
+        index /= 10;
+    } while (index > 0);
+    buffer[--i] = '[';
+    return path_put(path, buffer + i, sizeof(buffer) - i);
+}
+
+static bool path_push(FlatPath* path, size_t mark) {
+    if (path->depth >= path->mark_capacity) {
+        size_t new_capacity = path->mark_capacity == 0 ? JSON_INITIAL_CAPACITY : path->mark_capacity * 2;
+        size_t* new_marks = realloc(path->marks, new_capacity * sizeof(size_t));
+        if (!new_marks) return false;
+        path->marks = new_marks;
+        path->mark_capacity = new_capacity;
+    }
+    
+    path->marks[path->depth++] = mark;
+    return true;
+}
+
+static void write_line(JsonWriter* writer, const FlatPath* path, const char* value, size_t length) {
+    json_writer_put(writer, path->text, path->length);
+    json_writer_put(writer, ": ", 2);
+    json_writer_put(writer, value, length);
+    json_writer_put(writer, "\n", 1);
+}
+
+bool json_write_flat(JsonParser* parser, const char* root, JsonWriter* writer) {
+    if (!parser || !root || !writer) return false;
+    
+    FlatPath path = { NULL, 0, 0, NULL, 0, 0 };
+    JsonReader reader;
+    JsonEvent event;
+    size_t key_mark = 0;
+    bool has_key = false;
+    bool empty = false;           // Whether the last event opened a container
+    bool ok = path_put(&path, root, strlen(root));
+    
+    json_reader_init(&reader, parser);
+    while (ok && json_reader_next(&reader, &event)) {
+        switch (event.type) {
+            case JSON_EVENT_KEY:
+                // Copied right away: with a stream parser the key text may
+                // be gone once the value has been read
+                key_mark = path.length;
+                ok = path_member(&path, event.text);
+                has_key = true;
+                empty = false;
+                continue;
+            case JSON_EVENT_END_OBJECT:
+            case JSON_EVENT_END_ARRAY:
+                if (empty) write_line(writer, &path, event.type == JSON_EVENT_END_OBJECT ? "{}" : "[]", 2);
+                path.length = path.marks[--path.depth];
+                empty = false;
+                continue;
+            default:
+                break;
+        }
+        
+        size_t mark = path.length;
+        if (has_key) {
+            mark = key_mark;
+            has_key = false;
+        } else if (event.depth > 0) {
+            ok = path_element(&path, event.index);
+        }
+        
+        if (event.type == JSON_EVENT_START_OBJECT || event.type == JSON_EVENT_START_ARRAY) {
+            ok = ok && path_push(&path, mark);
+            empty = true;
+            continue;
+        }
+        
+        if (event.type == JSON_EVENT_NULL) {
+            write_line(writer, &path, "null", 4);
+        } else if (event.type == JSON_EVENT_STRING) {
+            json_writer_put(writer, path.text, path.length);
+            json_writer_put(writer, ": \"", 3);
+            json_writer_put(writer, event.text.data, event.text.length);
+            json_writer_put(writer, "\"\n", 2);
+        } else {
+            write_line(writer, &path, event.text.data, event.text.length);
+        }
+        path.length = mark;
+        empty = false;
+    }
+    json_reader_release(&reader);
+    free(path.text);
+    free(path.marks);
+    
+    return ok && event.type == JSON_EVENT_END && !writer->failed;
+}
+
+// Unflattening. Lines are read in order and only the containers on the
+// path of the last line are kept open: a line closes those its path leaves
+// and opens those it enters, so the document comes out in one pass with
+// one level of state per open container.
+
+// A step of a path, pointing into its line
+typedef struct {
+    const char* name;
+    size_t length;
+    size_t index;
+    bool member;
+} FlatStep;
+
+typedef struct {
+    bool object;
+    size_t count;          // Members or elements written so far
+    size_t name;           // Last member name: its offset in `names`
+    size_t name_length;
+} FlatLevel;
+
+typedef struct {
+    JsonWriter* writer;
+    FlatStep* steps;
+    size_t step_count;
+    size_t step_capacity;
+    FlatLevel* levels;
+    size_t depth;
+    size_t level_capacity;
+    char* names;           // Last member names of the open objects, outermost first
+    size_t names_size;
+    size_t names_capacity;
+    bool done;             // A root scalar was written
+    bool any;              // Whether a line held a value
+    size_t line;
+    const char* error;
+} FlatReader;
+
+static bool flat_fail(FlatReader* reader, const char* message) {
+    if (!reader->error) reader->error = message;
+    return false;
+}
+
+static bool add_step(FlatReader* reader, FlatStep step) {
+    if (reader->step_count >= reader->step_capacity) {
+        size_t new_capacity = reader->step_capacity == 0 ? JSON_INITIAL_CAPACITY : reader->step_capacity * 2;
+        FlatStep* new_steps = realloc(reader->steps, new_capacity * sizeof(FlatStep));
+        if (!new_steps) return flat_fail(reader, "Out of memory");
+        reader->steps = new_steps;
+        reader->step_capacity = new_capacity;
+    }
+    
+    reader->steps[reader->step_count++] = step;
+    return true;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Length of the body of the string at p (just past its opening quote) up
+// to the closing quote; fails if it is unterminated or not valid JSON
+static bool string_body(FlatReader* reader, const char* p, size_t length, size_t* body) {
+    size_t i = 0;
+    while (i < length && p[i] != '"') {
+        unsigned char c = (unsigned char)p[i];
+        if (c < 0x20) return flat_fail(reader, "Control character in a string");
+        if (c != '\\') {
+            i++;
+            continue;
+        }
+        
+        char escape = i + 1 < length ? p[i + 1] : '\0';
+        if (escape == 'u') {
+            bool hex = i + 5 < length;
+            for (size_t k = 2; hex && k < 6; k++) hex = hex_value(p[i + k]) >= 0;
+            if (!hex) return flat_fail(reader, "Invalid \\u escape in a string");
+            i += 6;
+        } else if (escape && strchr("\"\\/bfnrt", escape)) {
+            i += 2;
+        } else {
+            return flat_fail(reader, "Invalid escape in a string");
+        }
+    }
+    if (i >= length) return flat_fail(reader, "Unterminated string");
+    
+    *body = i;
+    return true;
+}
+
+// Splits a line into the steps of its path and its value
+static bool parse_line(FlatReader* reader, const char* p, size_t length, JsonSlice* value) {
+    reader->step_count = 0;
+    if (length == 0 || p[0] != '$') return flat_fail(reader, "A path starts with $");
+    
+    size_t i = 1;
+    while (i < length && p[i] != ':') {
+        FlatStep step = { NULL, 0, 0, true };
+        if (p[i] == '.') {
+            size_t start = ++i;
+            while (i < length && name_byte((unsigned char)p[i])) i++;
+            if (i == start) return flat_fail(reader, "Expected a member name after '.'");
+            step.name = p + start;
+            step.length = i - start;
+        } else if (p[i] == '[' && i + 1 < length && p[i + 1] == '"') {
+            i += 2;
+            size_t body;
+            if (!string_body(reader, p + i, length - i, &body)) return false;
+            step.name = p + i;
+            step.length = body;
+            i += body + 1;
+            if (i >= length || p[i] != ']') return flat_fail(reader, "Expected ']' after a member name");
+            i++;
+        } else if (p[i] == '[' && i + 1 < length && p[i + 1] >= '0' && p[i + 1] <= '9') {
+            step.member = false;
+            for (i++; i < length && p[i] >= '0' && p[i] <= '9'; i++) {
+                if (step.index > (SIZE_MAX - 9) / 10) return flat_fail(reader, "Index out of range");
+                step.index = step.index * 10 + (size_t)(p[i] - '0');
+            }
+            if (i >= length || p[i] != ']') return flat_fail(reader, "Expected ']' after an index");
+            i++;
+        } else {
+            return flat_fail(reader, "Expected .name, [\"name\"] or [N] in the path");
+        }
+        if (!add_step(reader, step)) return false;
+    }
+    if (i >= length) return flat_fail(reader, "Expected ': ' and a value after the path");
+    
+    // The value runs to the end of the line, less surrounding blanks
+    i++;
+    while (i < length && (p[i] == ' ' || p[i] == '\t')) i++;
+    while (length > i && (p[length - 1] == ' ' || p[length - 1] == '\t' || p[length - 1] == '\r')) length--;
+    *value = (JsonSlice){ p + i, length - i };
+    
+    const char* text = value->data;
+    size_t size = value->length;
+    JsonNumber number;
+    bool valid;
+    if (size > 0 && text[0] == '"') {
+        size_t body;
+        if (!string_body(reader, text + 1, size - 1, &body)) return false;
+        valid = body + 2 == size;
+    } else {
+        valid = (size == 2 && (memcmp(text, "{}", 2) == 0 || memcmp(text, "[]", 2) == 0)) ||
+                (size == 4 && (memcmp(text, "true", 4) == 0 || memcmp(text, "null", 4) == 0)) ||
+                (size == 5 && memcmp(text, "false", 5) == 0) ||
+                (size > 0 && json_number_parse(*value, &number));
+    }
+    return valid || flat_fail(reader, "Expected a JSON scalar, {} or [] as the value");
+}
+
+// Opens the container that holds `step`
+static bool open_level(FlatReader* reader, const FlatStep* step) {
+    if (reader->depth >= reader->level_capacity) {
+        size_t new_capacity = reader->level_capacity == 0 ? JSON_INITIAL_CAPACITY : reader->level_capacity * 2;
+        FlatLevel* new_levels = realloc(reader->levels, new_capacity * sizeof(FlatLevel));
+        if (!new_levels) return flat_fail(reader, "Out of memory");
+        reader->levels = new_levels;
+        reader->level_capacity = new_capacity;
+    }
+    
+    reader->levels[reader->depth++] = (FlatLevel){ step->member, 0, reader->names_size, 0 };
+    json_writer_put(reader->writer, step->member ? "{" : "[", 1);
+    return true;
+}
+
+static void close_levels(FlatReader* reader, size_t depth) {
+    while (reader->depth > depth) {
+        FlatLevel* level = &reader->levels[--reader->depth];
+        json_writer_put(reader->writer, level->object ? "}" : "]", 1);
+        reader->names_size = level->name;
+    }
+}
+
+// Whether `step` names the child `level` last received
+static bool same_child(const FlatReader* reader, const FlatLevel* level, const FlatStep* step) {
+    if (level->object != step->member || level->count == 0) return false;
+    if (!step->member) return step->index == level->count - 1;
+    return step->length == level->name_length &&
+           (step->length == 0 || memcmp(reader->names + level->name, step->name, step->length) == 0);
+}
+
+// Starts the next child of the innermost open container
+static bool add_child(FlatReader* reader, const FlatStep* step) {
+    FlatLevel* level = &reader->levels[reader->depth - 1];
+    if (level->object != step->member) return flat_fail(reader, "A container holds both members and elements");
+    if (!step->member && step->index != level->count) {
+        return flat_fail(reader, "Elements must come in order from [0]");
+    }
+    
+    if (level->count++ > 0) json_writer_put(reader->writer, ",", 1);
+    if (!step->member) return true;
+    
+    // Deeper levels are closed, so the name replaces the last of the stack
+    reader->names_size = level->name;
+    if (step->length > reader->names_capacity - reader->names_size) {
+        size_t new_capacity = reader->names_capacity == 0 ? JSON_PATH_MAX_LENGTH : reader->names_capacity * 2;
+        while (new_capacity - reader->names_size < step->length) new_capacity *= 2;
+        char* new_names = realloc(reader->names, new_capacity);
+        if (!new_names) return flat_fail(reader, "Out of memory");
+        reader->names = new_names;
+        reader->names_capacity = new_capacity;
+    }
+    if (step->length > 0) memcpy(reader->names + reader->names_size, step->name, step->length);
+    reader->names_size += step->length;
+    level->name_length = step->length;
+    
+    json_writer_put(reader->writer, "\"", 1);
+    json_writer_put(reader->writer, step->name, step->length);
+    json_writer_put(reader->writer, "\":", 2);
+    return true;
+}
+
+static bool add_value(FlatReader* reader, JsonSlice value) {
+    const FlatStep* steps = reader->steps;
+    size_t count = reader->step_count;
+    if (reader->done) return flat_fail(reader, "Value conflicts with an earlier line");
+    
+    size_t i = 0;
+    if (reader->depth == 0) {
+        reader->done = count == 0;
+        if (count > 0 && !open_level(reader, &steps[0])) return false;
+    } else {
+        // Stay in the open containers the path goes through
+        while (i < count && i + 1 < reader->depth && same_child(reader, &reader->levels[i], &steps[i])) i++;
+        
+        // Naming the last child again where the path cannot go into it,
+        // because it is a scalar or the value goes in its place, starts a
+        // repeated member name, as the parser allows. An element cannot
+        // repeat.
+        if (i == count) {
+            if (i == 0 || !steps[i - 1].member) return flat_fail(reader, "Value conflicts with an earlier line");
+            i--;
+        } else if (i + 1 < count && !steps[i].member && same_child(reader, &reader->levels[i], &steps[i])) {
+            return flat_fail(reader, "Value conflicts with an earlier line");
+        }
+        close_levels(reader, i + 1);
+    }
+    
+    for (; i < count; i++) {
+        if (!add_child(reader, &steps[i])) return false;
+        if (i + 1 < count && !open_level(reader, &steps[i + 1])) return false;
+    }
+    json_writer_put(reader->writer, value.data, value.length);
+    return true;
+}
+
+// Reads one line, without its newline
+static void read_line(FlatReader* reader, const char* start, size_t length) {
+    reader->line++;
+    
+    // Blank lines are skipped
+    size_t blank = 0;
+    while (blank < length && (start[blank] == ' ' || start[blank] == '\t' || start[blank] == '\r')) blank++;
+    if (blank == length) return;
+    
+    JsonSlice value;
+    if (parse_line(reader, start, length, &value)) add_value(reader, value);
+    reader->any = true;
+}
+
+static bool finish_reading(FlatReader* reader, const char** error, size_t* line) {
+    if (!reader->error && !reader->any) {
+        flat_fail(reader, "No path/value lines");
+        reader->line = 0;
+    }
+    
+    if (!reader->error) {
+        close_levels(reader, 0);
+        json_writer_put(reader->writer, "\n", 1);
+    }
+    free(reader->steps);
+    free(reader->levels);
+    free(reader->names);
+    
+    if (reader->error) {
+        if (error) *error = reader->error;
+        if (line) *line = reader->line;
+        return false;
+    }
+    return !reader->writer->failed;
+}
+
+bool json_read_flat(const char* data, size_t size, JsonWriter* writer, const char** error, size_t* line) {
+    if (!data || !writer) return false;
+    
+    FlatReader reader;
+    memset(&reader, 0, sizeof(reader));
+    reader.writer = writer;
+    
+    size_t pos = 0;
+    while (!reader.error && pos < size) {
+        const char* start = data + pos;
+        const char* end = memchr(start, '\n', size - pos);
+        size_t length = end ? (size_t)(end - start) : size - pos;
+        pos += length + 1;
+        read_line(&reader, start, length);
+    }
+    return finish_reading(&reader, error, line);
+}
+
+bool json_read_flat_stream(FILE* source, JsonWriter* writer, const char** error, size_t* line) {
+    if (!source || !writer) return false;
+    
+    FlatReader reader;
+    memset(&reader, 0, sizeof(reader));
+    reader.writer = writer;
+    
+    // Only the current line is held: the names of the open objects are
+    // copied out of it before the next one is read
+    char* text = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    while (!reader.error && (length = getline(&text, &capacity, source)) >= 0) {
+        size_t size = (size_t)length;
+        if (size > 0 && text[size - 1] == '\n') size--;
+        read_line(&reader, text, size);
+    }
+    if (!reader.error && ferror(source)) flat_fail(&reader, "Cannot read the input");
+    free(text);
+    return finish_reading(&reader, error, line);
+}
@@ -1,59 +1,13 @@
-#include "json_parser.h"
+#include "json_internal.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-typedef struct {
-    char* data;
-    size_t size;
-    size_t capacity;
-} Buffer;
-
-static Buffer* buffer_create(void) {
-    Buffer* buffer = malloc(sizeof(Buffer));
-    if (!buffer) return NULL;
-    
-    buffer->data = malloc(JSON_BUFFER_SIZE);
-    if (!buffer->data) {
-        free(buffer);
-        return NULL;
-    }
-    
-    buffer->size = 0;
-    buffer->capacity = JSON_BUFFER_SIZE;
-    return buffer;
-}
-
-static void buffer_destroy(Buffer* buffer) {
-    if (!buffer) return;
-    free(buffer->data);
-    free(buffer);
-}
-
-static bool buffer_append(Buffer* buffer, const char* str) {
-    size_t len = strlen(str);
-    size_t new_size = buffer->size + len;
-    
-    if (new_size > buffer->capacity) {
-        size_t new_capacity = buffer->capacity * 2;
-        while (new_size > new_capacity) {
-            new_capacity *= 2;
-        }
-        
-        char* new_data = realloc(buffer->data, new_capacity);
-        if (!new_data) return false;
-        
-        buffer->data = new_data;
-        buffer->capacity = new_capacity;
-    }
-    
-    memcpy(buffer->data + buffer->size, str, len);
-    buffer->size = new_size;
-    return true;
-}
+// Writes a string literal without measuring it at run time
+#define WRITE_LITERAL(writer, literal) json_writer_put(writer, literal, sizeof(literal) - 1)
 
 static void add_token(Token** tokens, size_t* count, size_t* capacity,
-                     TokenType type, const char* value, const char* style) {
+                     TokenType type, const char* value, size_t len, const char* style) {
     if (*count >= *capacity) {
         size_t new_capacity = *capacity * 2;
         Token* new_tokens = realloc(*tokens, new_capacity * sizeof(Token));
@@ -64,7 +18,9 @@ static void add_token(Token** tokens, size_t* count, size_t* capacity,
     
     Token* token = &(*tokens)[*count];
     token->type = type;
-    token->value = json_escape_string(value);  // Use proper string escaping
+    char* raw = json_slice_dup((JsonSlice){ value, len });
+    token->value = json_escape_string(raw);  // Use proper string escaping
+    free(raw);
     token->style = strdup(style);
     (*count)++;
 }
@@ -72,186 +28,456 @@ static void add_token(Token** tokens, size_t* count, size_t* capacity,
 static void tokenize_value(const TreeNode* node, Token** tokens, size_t* count, size_t* capacity) {
     if (!node || !tokens || !count || !capacity) return;
     
-    char temp[32];
-    
     switch (node->type) {
         case JSON_OBJECT:
-            add_token(tokens, count, capacity, TOKEN_BRACE, "{", "brace");
+            add_token(tokens, count, capacity, TOKEN_BRACE, "{", 1, "brace");
             for (size_t i = 0; i < node->children_count; i++) {
                 const TreeNode* child = node->children[i];
                 if (i > 0) {
-                    add_token(tokens, count, capacity, TOKEN_COMMA, ",", "operator");
+                    add_token(tokens, count, capacity, TOKEN_COMMA, ",", 1, "operator");
                 }
-                add_token(tokens, count, capacity, TOKEN_STRING, child->name, "key");
-                add_token(tokens, count, capacity, TOKEN_COLON, ":", "operator");
+                add_token(tokens, count, capacity, TOKEN_STRING, child->name.data, child->name.length, "key");
+                add_token(tokens, count, capacity, TOKEN_COLON, ":", 1, "operator");
                 tokenize_value(child, tokens, count, capacity);
             }
-            add_token(tokens, count, capacity, TOKEN_BRACE, "}", "brace");
+            add_token(tokens, count, capacity, TOKEN_BRACE, "}", 1, "brace");
             break;
             
         case JSON_ARRAY:
-            add_token(tokens, count, capacity, TOKEN_BRACKET, "[", "brace");
+            add_token(tokens, count, capacity, TOKEN_BRACKET, "[", 1, "brace");
             for (size_t i = 0; i < node->children_count; i++) {
                 if (i > 0) {
-                    add_token(tokens, count, capacity, TOKEN_COMMA, ",", "operator");
+                    add_token(tokens, count, capacity, TOKEN_COMMA, ",", 1, "operator");
                 }
                 tokenize_value(node->children[i], tokens, count, capacity);
             }
-            add_token(tokens, count, capacity, TOKEN_BRACKET, "]", "brace");
+            add_token(tokens, count, capacity, TOKEN_BRACKET, "]", 1, "brace");
             break;
             
-        case JSON_STRING:
-            snprintf(temp, sizeof(temp), "\"%s\"", node->value);
-            add_token(tokens, count, capacity, TOKEN_STRING, temp, "string");
+        case JSON_STRING: {
+            char* quoted = malloc(node->value.length + 2);
+            if (!quoted) break;
+            quoted[0] = '"';
+            memcpy(quoted + 1, node->value.data, node->value.length);
+            quoted[node->value.length + 1] = '"';
+            add_token(tokens, count, capacity, TOKEN_STRING, quoted, node->value.length + 2, "string");
+            free(quoted);
             break;
-            
+        }
+        
         case JSON_NUMBER:
-            add_token(tokens, count, capacity, TOKEN_NUMBER, node->value, "number");
+            add_token(tokens, count, capacity, TOKEN_NUMBER, node->value.data, node->value.length, "number");
             break;
             
         case JSON_BOOL:
-            add_token(tokens, count, capacity, TOKEN_BOOL, node->value, "boolean");
+            add_token(tokens, count, capacity, TOKEN_BOOL, node->value.data, node->value.length, "boolean");
             break;
             
         case JSON_NULL:
-            add_token(tokens, count, capacity, TOKEN_NULL, "null", "null");
+            add_token(tokens, count, capacity, TOKEN_NULL, "null", 4, "null");
             break;
     }
 }
 
-Token* json_tokenize(JsonParser* parser, size_t* token_count) {
-    if (!parser || !token_count) return NULL;
+Token* json_tokenize_tree(const TreeNode* root, size_t* token_count) {
+    if (!root || !token_count) return NULL;
     *token_count = 0;
     
     size_t capacity = JSON_INITIAL_CAPACITY;
     Token* tokens = malloc(capacity * sizeof(Token));
     if (!tokens) return NULL;
     
+    tokenize_value(root, &tokens, token_count, &capacity);
+    return tokens;
+}
+
+Token* json_tokenize(JsonParser* parser, size_t* token_count) {
+    if (!parser || !token_count) return NULL;
+    *token_count = 0;
+    
     TreeNode* root = json_parse_tree(parser);
-    if (!root) {
-        free(tokens);
-        return NULL;
-    }
+    if (!root) return NULL;
     
-    tokenize_value(root, &tokens, token_count, &capacity);
+    Token* tokens = json_tokenize_tree(root, token_count);
     tree_node_destroy(root);
     
     return tokens;
 }
 
-static void format_value(const TreeNode* node, Buffer* buffer, size_t indent, size_t level) {
-    if (!node || !buffer) return;
+// Writes `node` at nesting `level`. Object members are indented once for
+// the key and once more for the value, which starts right after the key.
+static void format_value(const TreeNode* node, JsonWriter* writer, size_t indent, size_t level) {
+    if (!node || !writer) return;
     
-    // Add indentation
-    for (size_t i = 0; i < level * indent; i++) {
-        buffer_append(buffer, " ");
-    }
+    json_writer_spaces(writer, level * indent);
     
     switch (node->type) {
         case JSON_NULL:
-            buffer_append(buffer, "null");
+            WRITE_LITERAL(writer, "null");
             break;
             
         case JSON_BOOL:
-            buffer_append(buffer, node->value);
-            break;
-            
         case JSON_NUMBER:
-            buffer_append(buffer, node->value);
+            json_writer_put(writer, node->value.data, node->value.length);
             break;
             
         case JSON_STRING:
-            buffer_append(buffer, "\"");
-            buffer_append(buffer, node->value);
-            buffer_append(buffer, "\"");
+            WRITE_LITERAL(writer, "\"");
+            json_writer_put(writer, node->value.data, node->value.length);
+            WRITE_LITERAL(writer, "\"");
             break;
             
         case JSON_ARRAY:
-            buffer_append(buffer, "[\n");
+            WRITE_LITERAL(writer, "[\n");
             for (size_t i = 0; i < node->children_count; i++) {
-                format_value(node->children[i], buffer, indent, level + 1);
+                format_value(node->children[i], writer, indent, level + 1);
                 if (i < node->children_count - 1) {
-                    buffer_append(buffer, ",");
+                    WRITE_LITERAL(writer, ",\n");
+                } else {
+                    WRITE_LITERAL(writer, "\n");
                 }
-                buffer_append(buffer, "\n");
-            }
-            for (size_t i = 0; i < level * indent; i++) {
-                buffer_append(buffer, " ");
             }
-            buffer_append(buffer, "]");
+            json_writer_spaces(writer, level * indent);
+            WRITE_LITERAL(writer, "]");
             break;
             
         case JSON_OBJECT:
-            buffer_append(buffer, "{\n");
+            WRITE_LITERAL(writer, "{\n");
             for (size_t i = 0; i < node->children_count; i++) {
                 const TreeNode* child = node->children[i];
-                for (size_t j = 0; j < (level + 1) * indent; j++) {
-                    buffer_append(buffer, " ");
-                }
-                buffer_append(buffer, "\"");
-                buffer_append(buffer, child->name);
-                buffer_append(buffer, "\": ");
-                format_value(child, buffer, indent, level + 1);
+                json_writer_spaces(writer, (level + 1) * indent);
+                WRITE_LITERAL(writer, "\"");
+                json_writer_put(writer, child->name.data, child->name.length);
+                WRITE_LITERAL(writer, "\": ");
+                format_value(child, writer, indent, level + 1);
                 if (i < node->children_count - 1) {
-                    buffer_append(buffer, ",");
+                    WRITE_LITERAL(writer, ",\n");
+                } else {
+                    WRITE_LITERAL(writer, "\n");
                 }
-                buffer_append(buffer, "\n");
             }
-            for (size_t i = 0; i < level * indent; i++) {
-                buffer_append(buffer, " ");
+            json_writer_spaces(writer, level * indent);
+            WRITE_LITERAL(writer, "}");
+            break;
+    }
+}
+
+// format_value() for the tape entry at `i`. The members or elements of a
+// container run from i + 1 to its end, each one's end leading to the next.
+static void format_entry(const JsonTape* tape, size_t i, JsonWriter* writer, size_t indent, size_t level) {
+    const JsonTapeEntry* entry = &tape->entries[i];
+    JsonSlice value = json_tape_slice(tape, entry->value);
+    json_writer_spaces(writer, level * indent);
+    
+    switch (entry->type) {
+        case JSON_NULL:
+            WRITE_LITERAL(writer, "null");
+            break;
+            
+        case JSON_BOOL:
+        case JSON_NUMBER:
+            json_writer_put(writer, value.data, value.length);
+            break;
+            
+        case JSON_STRING:
+            WRITE_LITERAL(writer, "\"");
+            json_writer_put(writer, value.data, value.length);
+            WRITE_LITERAL(writer, "\"");
+            break;
+            
+        case JSON_ARRAY:
+            WRITE_LITERAL(writer, "[\n");
+            for (size_t child = i + 1; child < entry->end; child = tape->entries[child].end) {
+                format_entry(tape, child, writer, indent, level + 1);
+                if (tape->entries[child].end < entry->end) {
+                    WRITE_LITERAL(writer, ",\n");
+                } else {
+                    WRITE_LITERAL(writer, "\n");
+                }
+            }
+            json_writer_spaces(writer, level * indent);
+            WRITE_LITERAL(writer, "]");
+            break;
+            
+        case JSON_OBJECT:
+            WRITE_LITERAL(writer, "{\n");
+            for (size_t child = i + 1; child < entry->end; child = tape->entries[child].end) {
+                const JsonTapeEntry* member = &tape->entries[child];
+                JsonSlice name = json_tape_slice(tape, member->name);
+                json_writer_spaces(writer, (level + 1) * indent);
+                WRITE_LITERAL(writer, "\"");
+                json_writer_put(writer, name.data, name.length);
+                WRITE_LITERAL(writer, "\": ");
+                format_entry(tape, child, writer, indent, level + 1);
+                if (member->end < entry->end) {
+                    WRITE_LITERAL(writer, ",\n");
+                } else {
+                    WRITE_LITERAL(writer, "\n");
+                }
             }
-            buffer_append(buffer, "}");
+            json_writer_spaces(writer, level * indent);
+            WRITE_LITERAL(writer, "}");
             break;
     }
 }
 
-char* json_format(JsonParser* parser, size_t indent) {
-    if (!parser) return NULL;
+// Writes `node` with no whitespace at all, as json_minify() does
+static void compact_value(const TreeNode* node, JsonWriter* writer) {
+    switch (node->type) {
+        case JSON_NULL:
+            WRITE_LITERAL(writer, "null");
+            break;
+            
+        case JSON_BOOL:
+        case JSON_NUMBER:
+            json_writer_put(writer, node->value.data, node->value.length);
+            break;
+            
+        case JSON_STRING:
+            WRITE_LITERAL(writer, "\"");
+            json_writer_put(writer, node->value.data, node->value.length);
+            WRITE_LITERAL(writer, "\"");
+            break;
+            
+        case JSON_ARRAY:
+            WRITE_LITERAL(writer, "[");
+            for (size_t i = 0; i < node->children_count; i++) {
+                if (i > 0) WRITE_LITERAL(writer, ",");
+                compact_value(node->children[i], writer);
+            }
+            WRITE_LITERAL(writer, "]");
+            break;
+            
+        case JSON_OBJECT:
+            WRITE_LITERAL(writer, "{");
+            for (size_t i = 0; i < node->children_count; i++) {
+                const TreeNode* child = node->children[i];
+                if (i > 0) WRITE_LITERAL(writer, ",");
+                WRITE_LITERAL(writer, "\"");
+                json_writer_put(writer, child->name.data, child->name.length);
+                WRITE_LITERAL(writer, "\":");
+                compact_value(child, writer);
+            }
+            WRITE_LITERAL(writer, "}");
+            break;
+    }
+}
+
+// Separators are written from the event positions rather than copied,
+// so commas the lax grammar let through are dropped or filled in
+void json_minify_event(JsonWriter* writer, const JsonEvent* event, bool* after_key) {
+    switch (event->type) {
+        case JSON_EVENT_KEY:
+            if (event->index > 0) WRITE_LITERAL(writer, ",");
+            WRITE_LITERAL(writer, "\"");
+            json_writer_put(writer, event->text.data, event->text.length);
+            WRITE_LITERAL(writer, "\":");
+            *after_key = true;
+            return;
+        case JSON_EVENT_END_OBJECT:
+            WRITE_LITERAL(writer, "}");
+            return;
+        case JSON_EVENT_END_ARRAY:
+            WRITE_LITERAL(writer, "]");
+            return;
+        default:
+            break;
+    }
     
-    TreeNode* root = json_parse_tree(parser);
-    if (!root) return NULL;
+    if (!*after_key && event->index > 0) WRITE_LITERAL(writer, ",");
+    *after_key = false;
     
-    Buffer* buffer = buffer_create();
-    if (!buffer) {
-        tree_node_destroy(root);
-        return NULL;
+    switch (event->type) {
+        case JSON_EVENT_START_OBJECT:
+            WRITE_LITERAL(writer, "{");
+            break;
+        case JSON_EVENT_START_ARRAY:
+            WRITE_LITERAL(writer, "[");
+            break;
+        case JSON_EVENT_STRING:
+            WRITE_LITERAL(writer, "\"");
+            json_writer_put(writer, event->text.data, event->text.length);
+            WRITE_LITERAL(writer, "\"");
+            break;
+        case JSON_EVENT_NULL:
+            WRITE_LITERAL(writer, "null");
+            break;
+        default:
+            json_writer_put(writer, event->text.data, event->text.length);
+            break;
+    }
+}
+
+bool json_minify(JsonParser* parser, JsonWriter* writer) {
+    if (!parser || !writer) return false;
+    
+    JsonReader reader;
+    JsonEvent event;
+    bool after_key = false;
+    json_reader_init(&reader, parser);
+    
+    while (json_reader_next(&reader, &event)) {
+        json_minify_event(writer, &event, &after_key);
     }
+    json_reader_release(&reader);
     
-    format_value(root, buffer, indent, 0);
-    buffer_append(buffer, "\n");
+    return event.type == JSON_EVENT_END && !writer->failed;
+}
+
+bool json_write_pretty(JsonParser* parser, size_t indent, JsonWriter* writer) {
+    if (!parser || !writer) return false;
     
-    char* result = strdup(buffer->data);
+    // Reproduces format_value() from the events. Whether a value was the
+    // last in its container is only known at the next event, so the
+    // separator after it is written then.
+    JsonReader reader;
+    JsonEvent event;
+    bool after_key = false;
+    bool opened = false;    // Nothing written since the last [ or {
+    json_reader_init(&reader, parser);
     
-    buffer_destroy(buffer);
-    tree_node_destroy(root);
+    while (json_reader_next(&reader, &event)) {
+        switch (event.type) {
+            case JSON_EVENT_KEY:
+                if (event.index > 0) WRITE_LITERAL(writer, ",\n");
+                json_writer_spaces(writer, event.depth * indent);
+                WRITE_LITERAL(writer, "\"");
+                json_writer_put(writer, event.text.data, event.text.length);
+                WRITE_LITERAL(writer, "\": ");
+                after_key = true;
+                opened = false;
+                continue;
+            case JSON_EVENT_END_OBJECT:
+            case JSON_EVENT_END_ARRAY:
+                if (!opened) WRITE_LITERAL(writer, "\n");
+                json_writer_spaces(writer, event.depth * indent);
+                if (event.type == JSON_EVENT_END_OBJECT) {
+                    WRITE_LITERAL(writer, "}");
+                } else {
+                    WRITE_LITERAL(writer, "]");
+                }
+                opened = false;
+                continue;
+            default:
+                break;
+        }
+        
+        if (!after_key && event.index > 0) WRITE_LITERAL(writer, ",\n");
+        json_writer_spaces(writer, event.depth * indent);
+        after_key = false;
+        opened = false;
+        
+        switch (event.type) {
+            case JSON_EVENT_START_OBJECT:
+                WRITE_LITERAL(writer, "{\n");
+                opened = true;
+                break;
+            case JSON_EVENT_START_ARRAY:
+                WRITE_LITERAL(writer, "[\n");
+                opened = true;
+                break;
+            case JSON_EVENT_STRING:
+                WRITE_LITERAL(writer, "\"");
+                json_writer_put(writer, event.text.data, event.text.length);
+                WRITE_LITERAL(writer, "\"");
+                break;
+            case JSON_EVENT_NULL:
+                WRITE_LITERAL(writer, "null");
+                break;
+            default:
+                json_writer_put(writer, event.text.data, event.text.length);
+                break;
+        }
+    }
+    json_reader_release(&reader);
+    
+    if (event.type != JSON_EVENT_END) return false;
+    WRITE_LITERAL(writer, "\n");
+    return !writer->failed;
+}
+
+bool json_write_tree(const TreeNode* root, size_t indent, JsonWriter* writer) {
+    if (!root || !writer) return false;
+    
+    format_value(root, writer, indent, 0);
+    WRITE_LITERAL(writer, "\n");
+    return !writer->failed;
+}
+
+bool json_write_tape(const JsonTape* tape, size_t indent, JsonWriter* writer) {
+    if (!tape || tape->count == 0 || !writer) return false;
+    
+    format_entry(tape, 0, writer, indent, 0);
+    WRITE_LITERAL(writer, "\n");
+    return !writer->failed;
+}
+
+char* json_format_tree(const TreeNode* root, size_t indent) {
+    if (!root) return NULL;
+    
+    JsonWriter writer;
+    if (!json_writer_init_memory(&writer)) return NULL;
+    
+    json_write_tree(root, indent, &writer);
+    return json_writer_take(&writer);
+}
+
+char* json_compact_tree(const TreeNode* root) {
+    if (!root) return NULL;
+    
+    JsonWriter writer;
+    if (!json_writer_init_memory(&writer)) return NULL;
+    
+    compact_value(root, &writer);
+    return json_writer_take(&writer);
+}
+
+char* json_format(JsonParser* parser, size_t indent) {
+    if (!parser) return NULL;
+    
+    JsonWriter writer;
+    if (!json_writer_init_memory(&writer)) return NULL;
     
-    return result;
+    if (!json_write_pretty(parser, indent, &writer)) {
+        json_writer_finish(&writer);
+        return NULL;
+    }
+    return json_writer_take(&writer);
 }
 
 char* json_compact(JsonParser* parser) {
-    return json_format(parser, 0);
+    if (!parser) return NULL;
+    
+    JsonWriter writer;
+    if (!json_writer_init_memory(&writer)) return NULL;
+    
+    if (!json_minify(parser, &writer)) {
+        json_writer_finish(&writer);
+        return NULL;
+    }
+    return json_writer_take(&writer);
 }
 
 static void print_tree_node(const TreeNode* node, const char* prefix, bool is_root, bool is_last, FILE* output) {
     char new_prefix[1024];
     char indent[1024] = "";
-
+    
     if (!is_root) {
         snprintf(indent, sizeof(indent), "%s%s", prefix, is_last ? "└── " : "├── ");
     }
-
+    
     switch (node->type) {
         case JSON_NULL:
             fprintf(output, "%snull\n", indent);
             break;
         case JSON_BOOL:
-            fprintf(output, "%s%s\n", indent, node->value);
+            fprintf(output, "%s%.*s\n", indent, JSON_SLICE_ARGS(node->value));
             break;
         case JSON_NUMBER:
-            fprintf(output, "%s%s\n", indent, node->value);
+            fprintf(output, "%s%.*s\n", indent, JSON_SLICE_ARGS(node->value));
             break;
         case JSON_STRING:
-            fprintf(output, "%s\"%s\"\n", indent, node->value);
+            fprintf(output, "%s\"%.*s\"\n", indent, JSON_SLICE_ARGS(node->value));
             break;
         case JSON_ARRAY:
             if (!is_root) fprintf(output, "%sArray\n", indent);
@@ -266,13 +492,13 @@ static void print_tree_node(const TreeNode* node, const char* prefix, bool is_ro
                 const TreeNode* child = node->children[i];
                 snprintf(new_prefix, sizeof(new_prefix), "%s%s", prefix, is_last ? "    " : "│   ");
                 
-                if (child->name) {
-                    fprintf(output, "%s%s%s\n", new_prefix, 
+                if (child->name.data) {
+                    fprintf(output, "%s%s%.*s\n", new_prefix, 
                            i == node->children_count - 1 ? "└── " : "├── ", 
-                           child->name);
+                           JSON_SLICE_ARGS(child->name));
                 }
                 
-                char next_prefix[1024];
+                char next_prefix[sizeof(new_prefix) + 8];
                 snprintf(next_prefix, sizeof(next_prefix), "%s%s", new_prefix, 
                         i == node->children_count - 1 ? "    " : "│   ");
                 print_tree_node(child, next_prefix, false, true, output);
@@ -284,5 +510,54 @@ static void print_tree_node(const TreeNode* node, const char* prefix, bool is_ro
 void json_print_tree(const TreeNode* root, FILE* output) {
     if (!root) return;
     print_tree_node(root, "", true, true, output);
-} 
+}
 
+// print_tree_node() for the tape entry at `i`
+static void print_tape_entry(const JsonTape* tape, size_t i, const char* prefix, bool is_root, bool is_last, FILE* output) {
+    const JsonTapeEntry* entry = &tape->entries[i];
+    char new_prefix[1024];
+    char indent[1024] = "";
+    
+    if (!is_root) {
+        snprintf(indent, sizeof(indent), "%s%s", prefix, is_last ? "└── " : "├── ");
+    }
+    
+    switch (entry->type) {
+        case JSON_NULL:
+            fprintf(output, "%snull\n", indent);
+            break;
+        case JSON_BOOL:
+        case JSON_NUMBER:
+            fprintf(output, "%s%.*s\n", indent, JSON_SLICE_ARGS(json_tape_slice(tape, entry->value)));
+            break;
+        case JSON_STRING:
+            fprintf(output, "%s\"%.*s\"\n", indent, JSON_SLICE_ARGS(json_tape_slice(tape, entry->value)));
+            break;
+        case JSON_ARRAY:
+            if (!is_root) fprintf(output, "%sArray\n", indent);
+            snprintf(new_prefix, sizeof(new_prefix), "%s%s", prefix, is_last ? "    " : "│   ");
+            for (size_t child = i + 1; child < entry->end; child = tape->entries[child].end) {
+                print_tape_entry(tape, child, new_prefix, false, tape->entries[child].end == entry->end, output);
+            }
+            break;
+        case JSON_OBJECT:
+            if (!is_root) fprintf(output, "%sObject\n", indent);
+            snprintf(new_prefix, sizeof(new_prefix), "%s%s", prefix, is_last ? "    " : "│   ");
+            for (size_t child = i + 1; child < entry->end; child = tape->entries[child].end) {
+                const JsonTapeEntry* member = &tape->entries[child];
+                bool last = member->end == entry->end;
+                fprintf(output, "%s%s%.*s\n", new_prefix, last ? "└── " : "├── ",
+                        JSON_SLICE_ARGS(json_tape_slice(tape, member->name)));
+                
+                char next_prefix[sizeof(new_prefix) + 8];
+                snprintf(next_prefix, sizeof(next_prefix), "%s%s", new_prefix, last ? "    " : "│   ");
+                print_tape_entry(tape, child, next_prefix, false, true, output);
+            }
+            break;
+    }
+}
+
+void json_print_tape(const JsonTape* tape, FILE* output) {
+    if (!tape || tape->count == 0) return;
+    print_tape_entry(tape, 0, "", true, true, output);
+}
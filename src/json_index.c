@@ -0,0 +1,706 @@
+#include "json_internal.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Value index. The builder collects one posting per scalar: the value, its
+// path and its byte offset in the source. Values and keys are interned
+// into one text pool; a path is stored as LEB128 varints, one per segment,
+// each a key id times two for a member or an array index times two plus
+// one for an element.
+//
+// The index file is the builder's content laid out for mmap(), with file
+// offsets instead of pointers:
+//
+//     header | buckets | values | postings | keys | paths | strings
+//
+// buckets[b]..buckets[b + 1] are the values whose hash falls in bucket b
+// (bucket_count is a power of two), and each value owns a run of postings
+// in source order.
+
+#define INDEX_NO_ID SIZE_MAX
+
+typedef struct {
+    uint64_t hash;
+    uint64_t text;                  // In the strings pool
+    uint64_t length;
+} IndexText;
+
+// Open-addressing hash set of interned texts
+typedef struct {
+    IndexText* entries;
+    size_t count;
+    size_t capacity;
+    size_t* slots;
+    size_t slot_count;
+} TextTable;
+
+typedef struct {
+    uint64_t path;                  // In the paths pool
+    uint64_t offset;                // In the source
+    uint32_t path_length;
+    uint32_t value;
+    uint8_t type;
+} BuildPosting;
+
+struct JsonIndexBuilder {
+    TextTable values;
+    TextTable keys;
+    BuildPosting* postings;
+    size_t posting_count;
+    size_t posting_capacity;
+    char* strings;
+    size_t strings_size;
+    size_t strings_capacity;
+    unsigned char* paths;
+    size_t paths_size;
+    size_t paths_capacity;
+    uint64_t* segments;             // Path of the value being read
+    size_t depth;
+    size_t segments_capacity;
+};
+
+// On-disk entries, all 8-byte aligned
+typedef struct {
+    uint64_t hash;
+    uint64_t text;
+    uint64_t length;
+    uint64_t first_posting;
+    uint64_t posting_count;
+} IndexValue;
+
+typedef struct {
+    uint64_t path;
+    uint64_t offset;
+    uint32_t path_length;
+    uint32_t type;
+} IndexPosting;
+
+typedef struct {
+    uint64_t text;
+    uint64_t length;
+} IndexKey;
+
+static uint64_t text_hash(const char* data, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Makes room for `extra` more elements of `size` bytes in *data
+static bool reserve(void** data, size_t* capacity, size_t count, size_t extra, size_t size) {
+    if (count + extra <= *capacity) return true;
+    
+    size_t new_capacity = *capacity == 0 ? JSON_BUFFER_SIZE : *capacity * 2;
+    while (new_capacity < count + extra) new_capacity *= 2;
+    
+    void* new_data = realloc(*data, new_capacity * size);
+    if (!new_data) return false;
+    
+    *data = new_data;
+    *capacity = new_capacity;
+    return true;
+}
+
+static bool table_grow(TextTable* table) {
+    size_t slot_count = table->slot_count == 0 ? JSON_BUFFER_SIZE : table->slot_count * 2;
+    size_t* slots = malloc(slot_count * sizeof(size_t));
+    if (!slots) return false;
+    
+    memset(slots, 0xff, slot_count * sizeof(size_t));
+    for (size_t i = 0; i < table->count; i++) {
+        size_t slot = (size_t)table->entries[i].hash & (slot_count - 1);
+        while (slots[slot] != INDEX_NO_ID) slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = i;
+    }
+    
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+    return true;
+}
+
+// Id of `text` in `table`, added to the builder's text pool on first use
+static size_t intern(JsonIndexBuilder* builder, TextTable* table, const char* data, size_t length) {
+    if (table->count >= UINT32_MAX) return INDEX_NO_ID; // Postings hold 32-bit ids
+    if (table->count * 2 >= table->slot_count && !table_grow(table)) return INDEX_NO_ID;
+    
+    uint64_t hash = text_hash(data, length);
+    size_t mask = table->slot_count - 1;
+    size_t slot = (size_t)hash & mask;
+    while (table->slots[slot] != INDEX_NO_ID) {
+        const IndexText* entry = &table->entries[table->slots[slot]];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(builder->strings + entry->text, data, length) == 0) {
+            return table->slots[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    
+    if (!reserve((void**)&table->entries, &table->capacity, table->count, 1, sizeof(IndexText)) ||
+        !reserve((void**)&builder->strings, &builder->strings_capacity, builder->strings_size, length, 1)) {
+        return INDEX_NO_ID;
+    }
+    
+    if (length > 0) memcpy(builder->strings + builder->strings_size, data, length);
+    table->entries[table->count] = (IndexText){ hash, builder->strings_size, length };
+    builder->strings_size += length;
+    table->slots[slot] = table->count;
+    return table->count++;
+}
+
+static bool append_varint(JsonIndexBuilder* builder, uint64_t value) {
+    if (!reserve((void**)&builder->paths, &builder->paths_capacity, builder->paths_size, 10, 1)) return false;
+    
+    while (value >= 0x80) {
+        builder->paths[builder->paths_size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    builder->paths[builder->paths_size++] = (unsigned char)value;
+    return true;
+}
+
+// Reads one varint from p[*pos..length); false if it runs past the end
+static bool read_varint(const unsigned char* p, size_t length, size_t* pos, uint64_t* value) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; *pos < length && shift < 64; shift += 7) {
+        unsigned char byte = p[(*pos)++];
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool add_posting(JsonIndexBuilder* builder, size_t value, uint64_t path, size_t path_length,
+                        uint64_t offset, JsonType type) {
+    if (!reserve((void**)&builder->postings, &builder->posting_capacity, builder->posting_count, 1,
+                 sizeof(BuildPosting))) {
+        return false;
+    }
+    
+    builder->postings[builder->posting_count++] = (BuildPosting){
+        .path = path,
+        .offset = offset,
+        .path_length = (uint32_t)path_length,
+        .value = (uint32_t)value,
+        .type = (uint8_t)type
+    };
+    return true;
+}
+
+static bool push_segment(JsonIndexBuilder* builder, uint64_t segment) {
+    if (!reserve((void**)&builder->segments, &builder->segments_capacity, builder->depth, 1, sizeof(uint64_t))) {
+        return false;
+    }
+    builder->segments[builder->depth++] = segment;
+    return true;
+}
+
+JsonIndexBuilder* json_index_builder_create(void) {
+    return calloc(1, sizeof(JsonIndexBuilder));
+}
+
+void json_index_builder_destroy(JsonIndexBuilder* builder) {
+    if (!builder) return;
+    
+    free(builder->values.entries);
+    free(builder->values.slots);
+    free(builder->keys.entries);
+    free(builder->keys.slots);
+    free(builder->postings);
+    free(builder->strings);
+    free(builder->paths);
+    free(builder->segments);
+    free(builder);
+}
+
+size_t json_index_count(const JsonIndexBuilder* builder) {
+    return builder ? builder->posting_count : 0;
+}
+
+static JsonType event_value_type(JsonEventType type) {
+    switch (type) {
+        case JSON_EVENT_STRING:
+            return JSON_STRING;
+        case JSON_EVENT_NUMBER:
+            return JSON_NUMBER;
+        case JSON_EVENT_BOOL:
+            return JSON_BOOL;
+        default:
+            return JSON_NULL;
+    }
+}
+
+bool json_index_add(JsonIndexBuilder* builder, JsonParser* parser, size_t offset, size_t record) {
+    if (!builder || !parser) return false;
+    
+    JsonReader reader;
+    JsonEvent event;
+    uint64_t key_segment = 0;
+    bool has_key = false;
+    bool ok = true;
+    
+    // Records of JSON Lines input start below their record index
+    builder->depth = 0;
+    if (record != JSON_INDEX_DOCUMENT) ok = push_segment(builder, (uint64_t)record * 2 + 1);
+    
+    json_reader_init(&reader, parser);
+    while (ok && json_reader_next(&reader, &event)) {
+        switch (event.type) {
+            case JSON_EVENT_KEY: {
+                // Keys, like values, are interned by their decoded text
+                size_t key = INDEX_NO_ID;
+                if (event.escaped) {
+                    char* text = malloc(event.text.length + 1);
+                    if (text) key = intern(builder, &builder->keys, text, json_unescape_into(event.text, text));
+                    free(text);
+                } else {
+                    key = intern(builder, &builder->keys, event.text.data, event.text.length);
+                }
+                ok = key != INDEX_NO_ID;
+                key_segment = (uint64_t)key * 2;
+                has_key = true;
+                continue;
+            }
+            case JSON_EVENT_END_OBJECT:
+            case JSON_EVENT_END_ARRAY:
+                if (event.depth > 0) builder->depth--;
+                continue;
+            default:
+                break;
+        }
+        
+        // The root itself adds no segment
+        bool has_segment = event.depth > 0;
+        uint64_t segment = has_key ? key_segment : (uint64_t)event.index * 2 + 1;
+        has_key = false;
+        
+        if (event.type == JSON_EVENT_START_OBJECT || event.type == JSON_EVENT_START_ARRAY) {
+            if (has_segment) ok = push_segment(builder, segment);
+            continue;
+        }
+        
+        // Escaped strings are indexed by their decoded text
+        size_t value = INDEX_NO_ID;
+        if (event.escaped) {
+            char* text = malloc(event.text.length + 1);
+            if (text) value = intern(builder, &builder->values, text, json_unescape_into(event.text, text));
+            free(text);
+        } else {
+            value = intern(builder, &builder->values, event.text.data, event.text.length);
+        }
+        uint64_t path = builder->paths_size;
+        ok = value != INDEX_NO_ID;
+        for (size_t i = 0; ok && i < builder->depth; i++) {
+            ok = append_varint(builder, builder->segments[i]);
+        }
+        if (ok && has_segment) ok = append_varint(builder, segment);
+        
+        // Postings point at the opening quote of strings
+        size_t position = (size_t)(event.text.data - parser->input) - (event.type == JSON_EVENT_STRING);
+        if (ok) {
+            ok = add_posting(builder, value, path, builder->paths_size - path,
+                             offset + parser->input_offset + position, event_value_type(event.type));
+        }
+    }
+    json_reader_release(&reader);
+    
+    return ok && event.type == JSON_EVENT_END;
+}
+
+bool json_index_merge(JsonIndexBuilder* dst, const JsonIndexBuilder* src) {
+    if (!dst || !src) return false;
+    if (src->posting_count == 0) return true;
+    
+    size_t* key_map = malloc((src->keys.count + 1) * sizeof(size_t));
+    size_t* value_map = malloc(src->values.count * sizeof(size_t));
+    bool ok = key_map && value_map;
+    
+    for (size_t i = 0; ok && i < src->keys.count; i++) {
+        const IndexText* key = &src->keys.entries[i];
+        key_map[i] = intern(dst, &dst->keys, src->strings + key->text, key->length);
+        ok = key_map[i] != INDEX_NO_ID;
+    }
+    for (size_t i = 0; ok && i < src->values.count; i++) {
+        const IndexText* value = &src->values.entries[i];
+        value_map[i] = intern(dst, &dst->values, src->strings + value->text, value->length);
+        ok = value_map[i] != INDEX_NO_ID;
+    }
+    
+    // Paths are copied segment by segment, with member keys renumbered
+    for (size_t i = 0; ok && i < src->posting_count; i++) {
+        const BuildPosting* posting = &src->postings[i];
+        const unsigned char* segments = src->paths + posting->path;
+        uint64_t path = dst->paths_size;
+        size_t pos = 0;
+        uint64_t segment;
+        while (ok && pos < posting->path_length) {
+            ok = read_varint(segments, posting->path_length, &pos, &segment) &&
+                 append_varint(dst, segment & 1 ? segment : (uint64_t)key_map[segment / 2] * 2);
+        }
+        if (ok) {
+            ok = add_posting(dst, value_map[posting->value], path, dst->paths_size - path,
+                             posting->offset, (JsonType)posting->type);
+        }
+    }
+    
+    free(key_map);
+    free(value_map);
+    return ok;
+}
+
+static int compare_offsets(const void* a, const void* b) {
+    uint64_t x = (*(const BuildPosting* const*)a)->offset;
+    uint64_t y = (*(const BuildPosting* const*)b)->offset;
+    return x < y ? -1 : x > y;
+}
+
+static bool write_padded(FILE* file, const void* data, size_t size) {
+    static const char zeros[8] = { 0 };
+    size_t padding = (8 - size % 8) % 8;
+    return (size == 0 || fwrite(data, 1, size, file) == size) &&
+           (padding == 0 || fwrite(zeros, 1, padding, file) == padding);
+}
+
+static uint64_t padded(uint64_t size) {
+    return (size + 7) & ~(uint64_t)7;
+}
+
+// Lays the builder out as an index file: values sorted by hash bucket, the
+// postings of each value together and in source order
+static bool write_index(const JsonIndexBuilder* builder, FILE* file, const JsonIndexSource* source) {
+    size_t value_count = builder->values.count;
+    size_t posting_count = builder->posting_count;
+    size_t key_count = builder->keys.count;
+    size_t bucket_count = 1;
+    while (bucket_count < value_count) bucket_count *= 2;
+    
+    uint64_t* buckets = calloc(bucket_count + 1, sizeof(uint64_t));
+    size_t* order = malloc((value_count + 1) * sizeof(size_t));           // Position -> value
+    uint64_t* first_posting = calloc(value_count + 1, sizeof(uint64_t));  // By value
+    uint64_t* filled = malloc(bucket_count * sizeof(uint64_t));           // Sort cursors
+    const BuildPosting** postings = malloc((posting_count + 1) * sizeof(BuildPosting*));
+    bool ok = buckets && order && first_posting && filled && postings;
+    
+    if (ok) {
+        // Counting sorts: values by bucket, postings by value
+        for (size_t i = 0; i < value_count; i++) {
+            buckets[(builder->values.entries[i].hash & (bucket_count - 1)) + 1]++;
+        }
+        for (size_t b = 0; b < bucket_count; b++) {
+            buckets[b + 1] += buckets[b];
+        }
+        memset(filled, 0, bucket_count * sizeof(uint64_t));
+        for (size_t i = 0; i < value_count; i++) {
+            size_t b = builder->values.entries[i].hash & (bucket_count - 1);
+            order[buckets[b] + filled[b]++] = i;
+        }
+        
+        for (size_t i = 0; i < posting_count; i++) {
+            first_posting[builder->postings[i].value + 1]++;
+        }
+        for (size_t v = 0; v < value_count; v++) {
+            first_posting[v + 1] += first_posting[v];
+        }
+        memset(filled, 0, value_count * sizeof(uint64_t));
+        for (size_t i = 0; i < posting_count; i++) {
+            uint32_t v = builder->postings[i].value;
+            postings[first_posting[v] + filled[v]++] = &builder->postings[i];
+        }
+        
+        // Merged --lines builders may hold a value's postings out of order
+        for (size_t v = 0; ok && v < value_count; v++) {
+            const BuildPosting** run = postings + first_posting[v];
+            size_t count = first_posting[v + 1] - first_posting[v];
+            for (size_t i = 1; i < count; i++) {
+                if (run[i]->offset < run[i - 1]->offset) {
+                    qsort(run, count, sizeof(*run), compare_offsets);
+                    break;
+                }
+            }
+        }
+    }
+    
+    JsonIndexHeader header = {
+        .magic = JSON_INDEX_MAGIC,
+        .source = *source,
+        .bucket_count = bucket_count,
+        .value_count = value_count,
+        .posting_count = posting_count,
+        .key_count = key_count,
+        .buckets_offset = sizeof(JsonIndexHeader),
+        .paths_size = builder->paths_size,
+        .strings_size = builder->strings_size
+    };
+    header.values_offset = header.buckets_offset + (bucket_count + 1) * sizeof(uint64_t);
+    header.postings_offset = header.values_offset + value_count * sizeof(IndexValue);
+    header.keys_offset = header.postings_offset + posting_count * sizeof(IndexPosting);
+    header.paths_offset = header.keys_offset + key_count * sizeof(IndexKey);
+    header.strings_offset = header.paths_offset + padded(builder->paths_size);
+    
+    ok = ok && fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(buckets, sizeof(uint64_t), bucket_count + 1, file) == bucket_count + 1;
+    
+    // Postings are numbered in value order, so each value's run starts at
+    // the total of the runs before it
+    uint64_t written = 0;
+    for (size_t i = 0; ok && i < value_count; i++) {
+        size_t v = order[i];
+        const IndexText* text = &builder->values.entries[v];
+        IndexValue value = {
+            .hash = text->hash,
+            .text = text->text,
+            .length = text->length,
+            .first_posting = written,
+            .posting_count = first_posting[v + 1] - first_posting[v]
+        };
+        written += value.posting_count;
+        ok = fwrite(&value, sizeof(value), 1, file) == 1;
+    }
+    for (size_t i = 0; ok && i < value_count; i++) {
+        size_t v = order[i];
+        for (uint64_t p = first_posting[v]; ok && p < first_posting[v + 1]; p++) {
+            IndexPosting posting = {
+                .path = postings[p]->path,
+                .offset = postings[p]->offset,
+                .path_length = postings[p]->path_length,
+                .type = postings[p]->type
+            };
+            ok = fwrite(&posting, sizeof(posting), 1, file) == 1;
+        }
+    }
+    for (size_t i = 0; ok && i < key_count; i++) {
+        IndexKey key = { builder->keys.entries[i].text, builder->keys.entries[i].length };
+        ok = fwrite(&key, sizeof(key), 1, file) == 1;
+    }
+    ok = ok && write_padded(file, builder->paths, builder->paths_size) &&
+         write_padded(file, builder->strings, builder->strings_size);
+    
+    free(buckets);
+    free(order);
+    free(first_posting);
+    free(filled);
+    free(postings);
+    return ok;
+}
+
+bool json_index_write(const JsonIndexBuilder* builder, const char* path, const JsonIndexSource* source) {
+    if (!builder || !path || !source) return false;
+    
+    // Written aside and renamed over the old index, so readers never see
+    // a partial file
+    size_t length = strlen(path);
+    char* temp = malloc(length + 5);
+    if (!temp) return false;
+    memcpy(temp, path, length);
+    memcpy(temp + length, ".tmp", 5);
+    
+    FILE* file = fopen(temp, "wb");
+    bool ok = file && write_index(builder, file, source);
+    if (file && fclose(file) != 0) ok = false;
+    if (ok) ok = rename(temp, path) == 0;
+    if (!ok && file) remove(temp);
+    
+    free(temp);
+    return ok;
+}
+
+// True if count entries of `size` bytes at `offset` lie inside the file
+static bool section_fits(const JsonIndex* index, uint64_t offset, uint64_t count, size_t size) {
+    return offset <= index->size && count <= (index->size - offset) / size;
+}
+
+bool json_index_open(JsonIndex* index, const char* path) {
+    if (!index || !path) return false;
+    index->data = NULL;
+    index->size = 0;
+    index->header = NULL;
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    
+    struct stat st;
+    void* addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(JsonIndexHeader)) {
+        addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED) return false;
+    
+    index->data = addr;
+    index->size = (size_t)st.st_size;
+    
+    const JsonIndexHeader* header = addr;
+    bool ok = memcmp(header->magic, JSON_INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+              header->bucket_count > 0 && (header->bucket_count & (header->bucket_count - 1)) == 0 &&
+              section_fits(index, header->buckets_offset, header->bucket_count + 1, sizeof(uint64_t)) &&
+              section_fits(index, header->values_offset, header->value_count, sizeof(IndexValue)) &&
+              section_fits(index, header->postings_offset, header->posting_count, sizeof(IndexPosting)) &&
+              section_fits(index, header->keys_offset, header->key_count, sizeof(IndexKey)) &&
+              section_fits(index, header->paths_offset, header->paths_size, 1) &&
+              section_fits(index, header->strings_offset, header->strings_size, 1) &&
+              header->buckets_offset % 8 == 0 && header->values_offset % 8 == 0 &&
+              header->postings_offset % 8 == 0 && header->keys_offset % 8 == 0;
+    if (!ok) {
+        json_index_close(index);
+        return false;
+    }
+    
+    index->header = header;
+    return true;
+}
+
+void json_index_close(JsonIndex* index) {
+    if (!index || !index->data) return;
+    
+    munmap((void*)index->data, index->size);
+    index->data = NULL;
+    index->size = 0;
+    index->header = NULL;
+}
+
+// Text of the strings pool, or NULL if the range is out of bounds
+static const char* index_text(const JsonIndex* index, uint64_t text, uint64_t length) {
+    const JsonIndexHeader* header = index->header;
+    if (text > header->strings_size || length > header->strings_size - text) return NULL;
+    return (const char*)index->data + header->strings_offset + text;
+}
+
+static bool path_printf(char** path, size_t* length, size_t* capacity, const char* format, ...) {
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(*path + *length, *capacity - *length, format, args);
+        va_end(args);
+        if (n < 0) return false;
+        if ((size_t)n < *capacity - *length) {
+            *length += (size_t)n;
+            return true;
+        }
+        
+        char* new_path = realloc(*path, *capacity * 2 + (size_t)n);
+        if (!new_path) return false;
+        *path = new_path;
+        *capacity = *capacity * 2 + (size_t)n;
+    }
+}
+
+// Appends a decoded key between the quotes of ["key"], escaped again
+static bool path_quoted(char** path, size_t* length, size_t* capacity, const char* text, size_t size) {
+    size_t start = 0;
+    for (size_t i = 0; i < size; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        
+        if (!path_printf(path, length, capacity, "%.*s", (int)(i - start), text + start)) return false;
+        bool ok = c >= 0x20 ? path_printf(path, length, capacity, "\\%c", c) :
+                              path_printf(path, length, capacity, "\\u%04x", c);
+        if (!ok) return false;
+        start = i + 1;
+    }
+    return path_printf(path, length, capacity, "%.*s", (int)(size - start), text + start);
+}
+
+// Renders the path of `posting` as "$" followed by ".key" and "[index]"
+// steps, keys quoted as --flatten quotes them
+static bool render_path(const JsonIndex* index, const IndexPosting* posting,
+                        char** path, size_t* capacity) {
+    const JsonIndexHeader* header = index->header;
+    if (posting->path > header->paths_size || posting->path_length > header->paths_size - posting->path) {
+        return false;
+    }
+    
+    const unsigned char* segments = index->data + header->paths_offset + posting->path;
+    const IndexKey* keys = (const IndexKey*)(index->data + header->keys_offset);
+    size_t length = 0;
+    size_t pos = 0;
+    uint64_t segment;
+    
+    if (!path_printf(path, &length, capacity, "$")) return false;
+    while (pos < posting->path_length) {
+        if (!read_varint(segments, posting->path_length, &pos, &segment)) return false;
+        
+        if (segment & 1) {
+            if (!path_printf(path, &length, capacity, "[%llu]", (unsigned long long)(segment / 2))) return false;
+            continue;
+        }
+        
+        if (segment / 2 >= header->key_count) return false;
+        const IndexKey* key = &keys[segment / 2];
+        const char* text = index_text(index, key->text, key->length);
+        if (!text || key->length > INT_MAX) return false;
+        bool ok = json_path_name_is_plain((JsonSlice){ text, (size_t)key->length }) ?
+            path_printf(path, &length, capacity, ".%.*s", (int)key->length, text) :
+            path_printf(path, &length, capacity, "[\"") &&
+            path_quoted(path, &length, capacity, text, (size_t)key->length) &&
+            path_printf(path, &length, capacity, "\"]");
+        if (!ok) return false;
+    }
+    return true;
+}
+
+bool json_index_lookup(const JsonIndex* index, JsonSlice value, JsonIndexHandler handler, void* context) {
+    if (!index || !index->header || !handler) return false;
+    
+    const JsonIndexHeader* header = index->header;
+    const uint64_t* buckets = (const uint64_t*)(index->data + header->buckets_offset);
+    const IndexValue* values = (const IndexValue*)(index->data + header->values_offset);
+    const IndexPosting* postings = (const IndexPosting*)(index->data + header->postings_offset);
+    
+    uint64_t hash = text_hash(value.data, value.length);
+    size_t b = hash & (header->bucket_count - 1);
+    uint64_t start = buckets[b];
+    uint64_t end = buckets[b + 1];
+    if (start > end || end > header->value_count) return false;
+    
+    size_t capacity = JSON_PATH_MAX_LENGTH;
+    char* path = malloc(capacity);
+    if (!path) return false;
+    
+    bool ok = true;
+    bool more = true;
+    for (uint64_t i = start; ok && more && i < end; i++) {
+        const IndexValue* entry = &values[i];
+        if (entry->hash != hash || entry->length != value.length) continue;
+        
+        const char* text = index_text(index, entry->text, entry->length);
+        if (!text) {
+            ok = false;
+            break;
+        }
+        if (value.length > 0 && memcmp(text, value.data, value.length) != 0) continue;
+        
+        if (entry->first_posting > header->posting_count ||
+            entry->posting_count > header->posting_count - entry->first_posting) {
+            ok = false;
+            break;
+        }
+        for (uint64_t p = 0; more && p < entry->posting_count; p++) {
+            const IndexPosting* posting = &postings[entry->first_posting + p];
+            ok = posting->type <= JSON_OBJECT && render_path(index, posting, &path, &capacity);
+            if (!ok) break;
+            
+            JsonIndexMatch match = {
+                .type = (JsonType)posting->type,
+                .value = { text, entry->length },
+                .offset = posting->offset,
+                .path = path
+            };
+            more = handler(&match, context);
+        }
+    }
+    
+    free(path);
+    return ok;
+}
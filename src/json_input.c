@@ -0,0 +1,124 @@
+#define _DEFAULT_SOURCE // madvise() and MADV_HUGEPAGE
+
+#include "json_parser.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define READ_CHUNK_SIZE (64 * 1024)
+
+// Reads a whole stream into a heap buffer. Used for pipes, terminals and
+// anything else that cannot be mapped.
+static bool read_stream(JsonInput* input, FILE* fp) {
+    size_t capacity = READ_CHUNK_SIZE;
+    size_t size = 0;
+    char* data = malloc(capacity + 1);
+    if (!data) return false;
+    
+    for (;;) {
+        if (size == capacity) {
+            size_t new_capacity = capacity * 2;
+            char* new_data = realloc(data, new_capacity + 1);
+            if (!new_data) {
+                free(data);
+                return false;
+            }
+            data = new_data;
+            capacity = new_capacity;
+        }
+        
+        size_t n = fread(data + size, 1, capacity - size, fp);
+        size += n;
+        if (n == 0) break;
+    }
+    
+    if (ferror(fp)) {
+        free(data);
+        return false;
+    }
+    
+    data[size] = '\0';
+    input->data = data;
+    input->size = size;
+    input->mapped = false;
+    return true;
+}
+
+static bool map_file(JsonInput* input, int fd, size_t size) {
+    void* addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) return false;
+    
+    // The parser walks the input front to back exactly once
+    posix_madvise(addr, size, POSIX_MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(addr, size, MADV_HUGEPAGE);
+#endif
+    
+    input->data = addr;
+    input->size = size;
+    input->mapped = true;
+    return true;
+}
+
+static bool input_open(JsonInput* input, const char* path, bool keep_stream) {
+    if (!input || !path) return false;
+    input->data = NULL;
+    input->size = 0;
+    input->mapped = false;
+    input->stream = NULL;
+    
+    bool is_stdin = strcmp(path, "-") == 0;
+    FILE* fp = is_stdin ? stdin : fopen(path, "rb");
+    if (!fp) return false;
+    
+    struct stat st;
+    bool ok = false;
+    if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        ok = map_file(input, fileno(fp), (size_t)st.st_size);
+    }
+    
+    // Empty files cannot be mapped; FIFOs and character devices have no size
+    if (!ok && keep_stream) {
+        input->stream = fp;
+        return true;
+    }
+    if (!ok) {
+        ok = read_stream(input, fp);
+    }
+    
+    if (!is_stdin) fclose(fp);
+    return ok;
+}
+
+bool json_input_open(JsonInput* input, const char* path) {
+    return input_open(input, path, false);
+}
+
+// Like json_input_open(), but an input that cannot be mapped is left open
+// in input->stream for a stream parser instead of being read into memory
+bool json_input_open_stream(JsonInput* input, const char* path) {
+    return input_open(input, path, true);
+}
+
+void json_input_close(JsonInput* input) {
+    if (!input) return;
+    
+    if (input->stream) {
+        if (input->stream != stdin) fclose(input->stream);
+        input->stream = NULL;
+    }
+    if (!input->data) return;
+    
+    if (input->mapped) {
+        munmap((void*)input->data, input->size);
+    } else {
+        free((char*)input->data);
+    }
+    
+    input->data = NULL;
+    input->size = 0;
+}
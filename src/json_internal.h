@@ -0,0 +1,318 @@
+#ifndef JSON_INTERNAL_H
+#define JSON_INTERNAL_H
+
+// Shared implementation details of the jsonchrist library. Not part of
+// the public interface in json_parser.h.
+
+#include "json_parser.h"
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Bump allocator backing a parsed document. Everything is released at once
+// by json_arena_release(), in O(number of chunks).
+typedef struct JsonArenaChunk {
+    struct JsonArenaChunk* next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+} JsonArenaChunk;
+
+typedef struct JsonArena {
+    JsonArenaChunk* head;
+    size_t next_chunk_size;
+} JsonArena;
+
+void json_arena_init(JsonArena* arena);
+void* json_arena_alloc(JsonArena* arena, size_t size);
+char* json_arena_strndup(JsonArena* arena, const char* str, size_t len);
+void json_arena_adopt(JsonArena* dst, JsonArena* src);
+void json_arena_release(JsonArena* arena);
+
+// Tree construction shared by the parse engines (json_parser.c)
+TreeNode* json_tree_begin(JsonParser* parser);
+TreeNode* json_tree_end(JsonParser* parser, TreeNode* root, bool ok);
+TreeNode* json_tree_node_alloc(JsonParser* parser, TreeNode* parent);
+bool json_tree_push_child(JsonParser* parser, TreeNode* child);
+bool json_tree_finish_container(JsonParser* parser, TreeNode* node, size_t base);
+bool json_tree_parse_elements(JsonParser* parser, TreeNode* array, size_t end, bool last);
+
+// Distinct raw member names of a parsed document (json_parser.c), at most
+// JSON_KEY_TABLE_MAX of them
+#define JSON_KEY_TABLE_MAX (1u << 16)
+
+typedef struct {
+    const char* data;               // NULL when the slot is empty
+    size_t length;
+    uint64_t hash;
+    size_t next;                    // Slot + 1 of the name interned after it
+} JsonKeySlot;
+
+typedef struct JsonKeyTable {
+    JsonKeySlot* slots;
+    size_t mask;
+    size_t count;
+    size_t last;                    // Slot + 1 of the last name interned
+} JsonKeyTable;
+
+void json_key_table_init(JsonKeyTable* table);
+void json_key_table_release(JsonKeyTable* table);
+
+// Points name->data at the table's copy of the name, adding it if new.
+// Fails, leaving the name alone, when the table is full or out of memory.
+bool json_key_intern(JsonKeyTable* table, JsonSlice* name);
+
+// The table's copy of the raw name key[0..len), or NULL if no member has it
+const char* json_key_find(const JsonKeyTable* table, const char* key, size_t len);
+
+// Records an error at parser->pos (json_parser.c)
+void json_parser_error(JsonParser* parser, const char* message);
+
+// Two-stage structural engine (json_structural.c). Returns NULL without
+// recording errors for anything it does not accept.
+TreeNode* json_parse_tree_structural(JsonParser* parser);
+
+// Parallel engine for large root arrays (json_parallel.c). Returns NULL
+// without recording errors if the input does not suit it or fails to parse.
+TreeNode* json_parse_tree_parallel(JsonParser* parser);
+
+// Writes one event of json_minify()'s output. `after_key` carries between
+// events; a value written on its own should have an index of 0.
+// (json_format.c)
+void json_minify_event(JsonWriter* writer, const JsonEvent* event, bool* after_key);
+
+// Inline fast path of json_writer_write() for the short pieces the
+// formatters emit: a copy into the buffer when it fits
+static inline bool json_writer_put(JsonWriter* writer, const char* data, size_t len) {
+    if (len <= writer->capacity - writer->size && !writer->failed) {
+        if (len > 0) memcpy(writer->data + writer->size, data, len);
+        writer->size += len;
+        return true;
+    }
+    return json_writer_write(writer, data, len);
+}
+
+// Scanning kernels. Each returns the offset of the first byte of interest
+// in p[0..len), or len if there is none. The AVX2 and SSE2 versions
+// classify 32 or 16 bytes per step and never read past p + len; the scalar
+// loops handle the tail and non-x86 builds, with identical results.
+
+static inline bool json_is_whitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// First byte that is not JSON whitespace
+static inline size_t json_scan_whitespace(const char* p, size_t len) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i ws = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, newline), _mm256_cmpeq_epi8(v, cr)));
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(ws);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#elif defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, newline), _mm_cmpeq_epi8(v, cr)));
+        uint32_t mask = ~(uint32_t)_mm_movemask_epi8(ws) & 0xFFFFu;
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    while (i < len && json_is_whitespace(p[i])) i++;
+    return i;
+}
+
+// First occurrence of either byte a or b
+static inline size_t json_scan_pair(const char* p, size_t len, char a, char b) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#elif defined(__SSE2__)
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    while (i < len && p[i] != a && p[i] != b) i++;
+    return i;
+}
+
+// First '"' or '\\' (the end of a string or the start of an escape)
+static inline size_t json_scan_string(const char* p, size_t len) {
+    return json_scan_pair(p, len, '"', '\\');
+}
+
+// Length of the string body at p (just past the opening quote) up to the
+// closing quote, or len if the string is unterminated. Sets *has_escapes
+// when the body contains a backslash.
+static inline size_t json_scan_string_body(const char* p, size_t len, bool* has_escapes) {
+    size_t i = 0;
+    for (;;) {
+        i += json_scan_string(p + i, len - i);
+        if (i >= len || p[i] == '"') return i;
+        
+        // Backslash: skip it and the escaped character
+        *has_escapes = true;
+        i += 2;
+        if (i > len) return len;
+    }
+}
+
+// Length of the number token at p, which starts with '-' or a digit: the
+// minus sign, digits, a fraction and an exponent, each taken as far as it
+// goes. json_number_parse() then checks the token, so "01", "1." or "1e"
+// are one invalid number rather than a number followed by garbage.
+static inline size_t json_scan_number(const char* p, size_t len) {
+    size_t i = p[0] == '-' ? 1 : 0;
+    
+    while (i < len && p[i] >= '0' && p[i] <= '9') i++;
+    if (i < len && p[i] == '.') {
+        i++;
+        while (i < len && p[i] >= '0' && p[i] <= '9') i++;
+    }
+    if (i < len && (p[i] == 'e' || p[i] == 'E')) {
+        i++;
+        if (i < len && (p[i] == '+' || p[i] == '-')) i++;
+        while (i < len && p[i] >= '0' && p[i] <= '9') i++;
+    }
+    return i;
+}
+
+static inline void json_skip_whitespace(JsonParser* parser) {
+    if (parser->pos < parser->input_len && json_is_whitespace(parser->input[parser->pos])) {
+        parser->pos += json_scan_whitespace(&parser->input[parser->pos], parser->input_len - parser->pos);
+    }
+}
+
+// Bitmask helpers for engines that classify 64-byte blocks. Bit i stands
+// for byte i of the block.
+
+#define JSON_BLOCK_SIZE 64
+
+// Bytes of interest in a block; '[' and '{' both count as open, ']' and
+// '}' as close
+typedef struct {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t open;
+    uint64_t close;
+    uint64_t comma;
+} JsonBlockMasks;
+
+static inline void json_classify_block(const char* block, JsonBlockMasks* m) {
+#if defined(__AVX2__)
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');   // '[' | 0x20 == '{'
+    const __m256i close = _mm256_set1_epi8('}');  // ']' | 0x20 == '}'
+    const __m256i comma = _mm256_set1_epi8(',');
+    
+    m->quote = m->backslash = m->open = m->close = m->comma = 0;
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(block + 32 * i));
+        __m256i folded = _mm256_or_si256(v, lower);
+        int shift = 32 * i;
+        m->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << shift;
+        m->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) << shift;
+        m->open |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(folded, open)) << shift;
+        m->close |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(folded, close)) << shift;
+        m->comma |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, comma)) << shift;
+    }
+#elif defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');   // '[' | 0x20 == '{'
+    const __m128i close = _mm_set1_epi8('}');  // ']' | 0x20 == '}'
+    const __m128i comma = _mm_set1_epi8(',');
+    
+    m->quote = m->backslash = m->open = m->close = m->comma = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(block + 16 * i));
+        __m128i folded = _mm_or_si128(v, lower);
+        int shift = 16 * i;
+        m->quote |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << shift;
+        m->backslash |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << shift;
+        m->open |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(folded, open)) << shift;
+        m->close |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(folded, close)) << shift;
+        m->comma |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, comma)) << shift;
+    }
+#else
+    m->quote = m->backslash = m->open = m->close = m->comma = 0;
+    for (int i = 0; i < JSON_BLOCK_SIZE; i++) {
+        uint64_t bit = 1ULL << i;
+        switch (block[i]) {
+            case '"': m->quote |= bit; break;
+            case '\\': m->backslash |= bit; break;
+            case '[': case '{': m->open |= bit; break;
+            case ']': case '}': m->close |= bit; break;
+            case ',': m->comma |= bit; break;
+            default: break;
+        }
+    }
+#endif
+}
+
+// Bit i of the result is the parity of bits 0..i of x
+static inline uint64_t json_prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Bytes preceded by an odd-length run of backslashes. Runs starting on odd
+// bits are pushed onto even bits by the addition, which flips their parity
+// relative to the even bits. `prev_escaped` carries between blocks.
+static inline uint64_t json_escaped_mask(uint64_t backslash, uint64_t* prev_escaped) {
+    const uint64_t even_bits = 0x5555555555555555ULL;
+    
+    backslash &= ~*prev_escaped;
+    uint64_t follows_escape = backslash << 1 | *prev_escaped;
+    uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+    uint64_t even_sequences;
+    *prev_escaped = __builtin_add_overflow(odd_starts, backslash, &even_sequences);
+    return (even_bits ^ (even_sequences << 1)) & follows_escape;
+}
+
+// Bytes inside strings, given the unescaped quotes: opening quotes are in
+// the mask, closing quotes are not. `prev_in_string` is all ones or zero.
+static inline uint64_t json_string_mask(uint64_t quote, uint64_t* prev_in_string) {
+    uint64_t in_string = json_prefix_xor(quote) ^ *prev_in_string;
+    *prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+    return in_string;
+}
+
+#endif // JSON_INTERNAL_H
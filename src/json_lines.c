@@ -0,0 +1,252 @@
+#include "json_internal.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// JSON Lines input is cut into batches of whole lines, about
+// LINES_BATCH_SIZE bytes each, and processed in two parallel passes: the
+// first counts the lines and records of every batch so each record knows
+// its line number and index, the second runs the handler. Batch output is
+// collected in memory and written by the calling thread, in input order
+// unless ordering was turned off.
+
+#define LINES_BATCH_SIZE (1024 * 1024)
+#define LINES_BATCHES_IN_FLIGHT 4   // Per worker, when output is ordered
+
+typedef struct {
+    size_t start;
+    size_t end;
+    size_t first_line;
+    size_t first_index;
+    size_t lines;
+    size_t records;
+    char* output;
+    size_t output_size;
+    bool done;
+} LineBatch;
+
+typedef struct {
+    const char* data;
+    LineBatch* batches;
+    size_t batch_count;
+    bool ordered;
+    bool counting;                  // First pass
+    size_t window;
+    JsonLineHandler handler;
+    void* context;
+    FILE* output;
+    
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    size_t next;                    // Next batch to claim
+    size_t written;                 // Batches already written out
+    bool failed;
+} LinePool;
+
+typedef struct {
+    LinePool* pool;
+    size_t id;
+} LineWorker;
+
+static bool is_blank(const char* line, size_t len) {
+    return json_scan_whitespace(line, len) == len;
+}
+
+// Calls `handler` (or just counts, in the first pass) for each line of the batch
+static void run_batch(LinePool* pool, LineBatch* batch, size_t worker, FILE* out) {
+    const char* p = pool->data + batch->start;
+    const char* end = pool->data + batch->end;
+    JsonLineRecord record = { .line = batch->first_line, .index = batch->first_index, .worker = worker };
+    
+    while (p < end) {
+        const char* newline = memchr(p, '\n', (size_t)(end - p));
+        size_t len = newline ? (size_t)(newline - p) : (size_t)(end - p);
+        
+        if (!is_blank(p, len)) {
+            if (!pool->counting) {
+                record.text = (JsonSlice){ p, len };
+                pool->handler(&record, out, pool->context);
+            }
+            record.index++;
+        }
+        record.line++;
+        p += newline ? len + 1 : len;
+    }
+    
+    batch->lines = record.line - batch->first_line;
+    batch->records = record.index - batch->first_index;
+}
+
+static void* worker_main(void* arg) {
+    LineWorker* worker = arg;
+    LinePool* pool = worker->pool;
+    
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->ordered && !pool->counting && !pool->failed &&
+               pool->next < pool->batch_count && pool->next >= pool->written + pool->window) {
+            pthread_cond_wait(&pool->changed, &pool->lock);
+        }
+        if (pool->next >= pool->batch_count || pool->failed) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        LineBatch* batch = &pool->batches[pool->next++];
+        pthread_mutex_unlock(&pool->lock);
+        
+        if (pool->counting) {
+            run_batch(pool, batch, worker->id, NULL);
+            continue;
+        }
+        
+        char* text = NULL;
+        size_t size = 0;
+        FILE* out = open_memstream(&text, &size);
+        if (out) {
+            run_batch(pool, batch, worker->id, out);
+            fclose(out);
+        }
+        
+        pthread_mutex_lock(&pool->lock);
+        if (!out) {
+            pool->failed = true;
+        } else if (pool->ordered) {
+            batch->output = text;
+            batch->output_size = size;
+            text = NULL;
+        } else {
+            fwrite(text, 1, size, pool->output);
+        }
+        batch->done = true;
+        pthread_cond_broadcast(&pool->changed);
+        pthread_mutex_unlock(&pool->lock);
+        free(text);
+    }
+}
+
+// Writes the batch outputs in order as the workers finish them
+static void write_in_order(LinePool* pool) {
+    for (size_t i = 0; i < pool->batch_count; i++) {
+        LineBatch* batch = &pool->batches[i];
+        
+        pthread_mutex_lock(&pool->lock);
+        while (!batch->done && !pool->failed) {
+            pthread_cond_wait(&pool->changed, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        if (!batch->done) return;
+        
+        fwrite(batch->output, 1, batch->output_size, pool->output);
+        free(batch->output);
+        batch->output = NULL;
+        
+        pthread_mutex_lock(&pool->lock);
+        pool->written++;
+        pthread_cond_broadcast(&pool->changed);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// Runs one pass over all batches on `count` threads
+static bool run_pass(LinePool* pool, LineWorker* workers, pthread_t* threads, size_t count) {
+    pool->next = 0;
+    pool->written = 0;
+    
+    size_t started = 0;
+    while (started < count && pthread_create(&threads[started], NULL, worker_main, &workers[started]) == 0) {
+        started++;
+    }
+    if (started == 0) return false;
+    
+    if (!pool->counting && pool->ordered) {
+        write_in_order(pool);
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return !pool->failed;
+}
+
+size_t json_lines_default_workers(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t)n : 1;
+}
+
+bool json_lines_process(const char* data, size_t size, size_t workers, bool ordered,
+                        JsonLineHandler handler, void* context, FILE* output) {
+    if (!handler || !output || (size > 0 && !data)) return false;
+    if (workers == 0) workers = json_lines_default_workers();
+    
+    // Batch boundaries fall just after a newline
+    size_t capacity = size / LINES_BATCH_SIZE + 1;
+    LineBatch* batches = calloc(capacity, sizeof(LineBatch));
+    if (!batches) return false;
+    
+    size_t batch_count = 0;
+    size_t pos = 0;
+    while (pos < size) {
+        size_t end = pos + LINES_BATCH_SIZE;
+        if (end >= size) {
+            end = size;
+        } else {
+            const char* newline = memchr(data + end, '\n', size - end);
+            end = newline ? (size_t)(newline - data) + 1 : size;
+        }
+        batches[batch_count].start = pos;
+        batches[batch_count].end = end;
+        batch_count++;
+        pos = end;
+    }
+    
+    if (workers > batch_count) workers = batch_count > 0 ? batch_count : 1;
+    
+    LinePool pool = {
+        .data = data,
+        .batches = batches,
+        .batch_count = batch_count,
+        .ordered = ordered,
+        .counting = true,
+        .window = workers * LINES_BATCHES_IN_FLIGHT,
+        .handler = handler,
+        .context = context,
+        .output = output
+    };
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.changed, NULL);
+    
+    LineWorker* worker_args = malloc(workers * sizeof(LineWorker));
+    pthread_t* threads = malloc(workers * sizeof(pthread_t));
+    bool ok = worker_args && threads;
+    
+    for (size_t i = 0; ok && i < workers; i++) {
+        worker_args[i].pool = &pool;
+        worker_args[i].id = i;
+    }
+    
+    ok = ok && run_pass(&pool, worker_args, threads, workers);
+    if (ok) {
+        size_t line = 1;
+        size_t index = 0;
+        for (size_t i = 0; i < batch_count; i++) {
+            batches[i].first_line = line;
+            batches[i].first_index = index;
+            line += batches[i].lines;
+            index += batches[i].records;
+        }
+        
+        pool.counting = false;
+        ok = run_pass(&pool, worker_args, threads, workers);
+    }
+    
+    for (size_t i = 0; i < batch_count; i++) {
+        free(batches[i].output);
+    }
+    pthread_cond_destroy(&pool.changed);
+    pthread_mutex_destroy(&pool.lock);
+    free(threads);
+    free(worker_args);
+    free(batches);
+    
+    return ok;
+}
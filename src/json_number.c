@@ -0,0 +1,275 @@
+#include "json_parser.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Number conversion. Integers are accumulated exactly. Doubles go through
+// three steps, each exact when it applies: Clinger's fast path when the
+// significand and the power of ten are both exact doubles, then the
+// Eisel-Lemire algorithm on a 128-bit approximation of the power of ten,
+// and strtod() for what remains (more than 19 significant digits, results
+// too close to a halfway point, subnormals and overflow).
+
+#define POWER_MIN_EXP10 (-348)
+#define POWER_MAX_EXP10 347
+#define POWER_LIMBS 44              // 2^1344 and 10^348, in 32-bit limbs
+
+// Normalized 128-bit mantissas of 10^e, rounded down, built on first use
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} PowerOfTen;
+
+static PowerOfTen powers_of_ten[POWER_MAX_EXP10 - POWER_MIN_EXP10 + 1];
+static pthread_once_t powers_once = PTHREAD_ONCE_INIT;
+
+static const double exact_powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Top 128 bits of the little-endian number limbs[0..count)
+static PowerOfTen top_bits(const uint32_t* limbs, size_t count) {
+    while (count > 1 && limbs[count - 1] == 0) count--;
+    size_t bits = (count - 1) * 32 + (32 - (size_t)__builtin_clz(limbs[count - 1]));
+    
+    PowerOfTen power = { 0, 0 };
+    for (size_t k = 0; k < 128; k++) {
+        uint64_t bit = 0;
+        if (k < bits) {
+            size_t b = bits - 1 - k;
+            bit = (limbs[b / 32] >> (b % 32)) & 1;
+        }
+        power.hi = (power.hi << 1) | (power.lo >> 63);
+        power.lo = (power.lo << 1) | bit;
+    }
+    return power;
+}
+
+// 10^e exactly for e >= 0, floor(2^1344 / 10^-e) below that
+static void build_powers(void) {
+    uint32_t value[POWER_LIMBS] = { 1 };
+    for (int e = 0; e <= POWER_MAX_EXP10; e++) {
+        powers_of_ten[e - POWER_MIN_EXP10] = top_bits(value, POWER_LIMBS);
+        
+        uint64_t carry = 0;
+        for (size_t i = 0; i < POWER_LIMBS; i++) {
+            carry += (uint64_t)value[i] * 10;
+            value[i] = (uint32_t)carry;
+            carry >>= 32;
+        }
+    }
+    
+    memset(value, 0, sizeof(value));
+    value[1344 / 32] = 1;
+    for (int e = -1; e >= POWER_MIN_EXP10; e--) {
+        uint64_t remainder = 0;
+        for (size_t i = POWER_LIMBS; i-- > 0;) {
+            remainder = (remainder << 32) | value[i];
+            value[i] = (uint32_t)(remainder / 10);
+            remainder %= 10;
+        }
+        powers_of_ten[e - POWER_MIN_EXP10] = top_bits(value, POWER_LIMBS);
+    }
+}
+
+// Full 128-bit product of a and b
+static inline uint64_t multiply(uint64_t a, uint64_t b, uint64_t* lo) {
+#ifdef __SIZEOF_INT128__
+    __extension__ unsigned __int128 product = (unsigned __int128)a * b;
+    *lo = (uint64_t)product;
+    return (uint64_t)(product >> 64);
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t low = a_lo * b_lo;
+    uint64_t mid1 = a_hi * b_lo + (low >> 32);
+    uint64_t mid2 = a_lo * b_hi + (uint32_t)mid1;
+    *lo = (mid2 << 32) | (uint32_t)low;
+    return a_hi * b_hi + (mid1 >> 32) + (mid2 >> 32);
+#endif
+}
+
+// w * 10^q rounded to nearest, for a nonzero w. Fails when the result
+// cannot be decided from 128 bits or is not a normal double.
+static bool eisel_lemire(uint64_t w, int q, bool negative, double* out) {
+    if (q < POWER_MIN_EXP10 || q > POWER_MAX_EXP10) return false;
+    pthread_once(&powers_once, build_powers);
+    const PowerOfTen* power = &powers_of_ten[q - POWER_MIN_EXP10];
+    
+    int shift = __builtin_clzll(w);
+    w <<= shift;
+    uint64_t exp2 = (uint64_t)(((217706 * q) >> 16) + 64 + 1023) - (uint64_t)shift;
+    
+    // The product with the upper half is enough unless its low bits are
+    // all ones, where the truncated lower half may still carry into them
+    uint64_t lo;
+    uint64_t hi = multiply(w, power->hi, &lo);
+    if ((hi & 0x1FF) == 0x1FF && lo + w < w) {
+        uint64_t extra_lo;
+        uint64_t extra_hi = multiply(w, power->lo, &extra_lo);
+        uint64_t merged_lo = lo + extra_hi;
+        uint64_t merged_hi = hi + (merged_lo < lo);
+        if ((merged_hi & 0x1FF) == 0x1FF && merged_lo + 1 == 0 && extra_lo + w < w) return false;
+        hi = merged_hi;
+        lo = merged_lo;
+    }
+    
+    // 54 bits, then round half to even down to 53
+    uint64_t msb = hi >> 63;
+    uint64_t mantissa = hi >> (msb + 9);
+    exp2 -= 1 ^ msb;
+    if (lo == 0 && (hi & 0x1FF) == 0 && (mantissa & 3) == 1) return false;
+    
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >> 53) {
+        mantissa >>= 1;
+        exp2++;
+    }
+    if (exp2 - 1 >= 0x7FF - 1) return false;
+    
+    uint64_t bits = exp2 << 52 | (mantissa & 0x000FFFFFFFFFFFFFull);
+    if (negative) bits |= 0x8000000000000000ull;
+    memcpy(out, &bits, sizeof(*out));
+    return true;
+}
+
+static double slow_double(JsonSlice text) {
+    char local[128];
+    char* copy = text.length < sizeof(local) ? local : malloc(text.length + 1);
+    if (!copy) return NAN;
+    
+    memcpy(copy, text.data, text.length);
+    copy[text.length] = '\0';
+    double value = strtod(copy, NULL);
+    if (copy != local) free(copy);
+    return value;
+}
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool json_number_parse(JsonSlice text, JsonNumber* number) {
+    const char* p = text.data;
+    size_t len = text.length;
+    size_t i = 0;
+    
+    bool negative = len > 0 && p[0] == '-';
+    if (negative) i++;
+    
+    // Integer part: 0, or digits without a leading zero
+    size_t int_start = i;
+    if (i < len && p[i] == '0') {
+        i++;
+    } else {
+        while (i < len && is_digit(p[i])) i++;
+    }
+    if (i == int_start) return false;
+    size_t int_end = i;
+    
+    size_t frac_start = i, frac_end = i;
+    if (i < len && p[i] == '.') {
+        frac_start = ++i;
+        while (i < len && is_digit(p[i])) i++;
+        frac_end = i;
+        if (frac_end == frac_start) return false;
+    }
+    
+    // The exponent saturates; anything that large overflows or underflows anyway
+    int exponent = 0;
+    bool has_exponent = i < len && (p[i] == 'e' || p[i] == 'E');
+    if (has_exponent) {
+        i++;
+        bool exponent_negative = i < len && p[i] == '-';
+        if (i < len && (p[i] == '-' || p[i] == '+')) i++;
+        
+        size_t exp_start = i;
+        while (i < len && is_digit(p[i])) {
+            if (exponent < 100000) exponent = exponent * 10 + (p[i] - '0');
+            i++;
+        }
+        if (i == exp_start) return false;
+        if (exponent_negative) exponent = -exponent;
+    }
+    if (i != len) return false;
+    if (!number) return true;
+    
+    // Integers are kept exactly while they fit in 64 bits
+    if (frac_end == frac_start && !has_exponent) {
+        uint64_t value = 0;
+        bool overflow = false;
+        for (size_t k = int_start; k < int_end; k++) {
+            overflow |= __builtin_mul_overflow(value, 10, &value);
+            overflow |= __builtin_add_overflow(value, (uint64_t)(p[k] - '0'), &value);
+        }
+        
+        if (!overflow && !negative) {
+            number->type = value <= INT64_MAX ? JSON_NUMBER_INT : JSON_NUMBER_UINT;
+            if (number->type == JSON_NUMBER_INT) {
+                number->i = (int64_t)value;
+            } else {
+                number->u = value;
+            }
+            return true;
+        }
+        if (!overflow && value != 0 && value <= (uint64_t)INT64_MAX + 1) {
+            number->type = JSON_NUMBER_INT;
+            number->i = value == (uint64_t)INT64_MAX + 1 ? INT64_MIN : -(int64_t)value;
+            return true;
+        }
+    }
+    
+    // Significand of up to 19 digits, and the power of ten that scales it
+    uint64_t w = 0;
+    size_t digits = 0;
+    bool truncated = false;
+    int q = exponent;
+    for (size_t k = int_start; k < int_end; k++) {
+        if (digits < 19) {
+            w = w * 10 + (uint64_t)(p[k] - '0');
+            if (w > 0) digits++;
+        } else {
+            truncated = true;
+            q++;
+        }
+    }
+    
+    for (size_t k = frac_start; k < frac_end && !truncated; k++) {
+        if (digits < 19) {
+            w = w * 10 + (uint64_t)(p[k] - '0');
+            if (w > 0) digits++;
+            q--;
+        } else {
+            truncated = true;
+        }
+    }
+    
+    number->type = JSON_NUMBER_DOUBLE;
+    if (w == 0) {
+        number->d = negative ? -0.0 : 0.0;
+    } else if (truncated) {
+        number->d = slow_double(text);
+    } else if (w <= (1ull << 53) && q >= -22 && q <= 22) {
+        double d = (double)w;
+        d = q < 0 ? d / exact_powers[-q] : d * exact_powers[q];
+        number->d = negative ? -d : d;
+    } else if (!eisel_lemire(w, q, negative, &number->d)) {
+        number->d = slow_double(text);
+    }
+    return true;
+}
+
+double json_number_double(JsonNumber number) {
+    switch (number.type) {
+        case JSON_NUMBER_INT:
+            return (double)number.i;
+        case JSON_NUMBER_UINT:
+            return (double)number.u;
+        case JSON_NUMBER_DOUBLE:
+            break;
+    }
+    return number.d;
+}
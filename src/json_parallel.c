@@ -0,0 +1,345 @@
+#include "json_internal.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Parallel engine for documents whose root is a large array.
+//
+// The input after the opening bracket is cut into one chunk per worker.
+// Whether a chunk starts inside a string is unknown until the chunks before
+// it have been read, so each worker classifies its chunk in 64-byte blocks
+// and counts the brackets under both hypotheses at once: the inside-string
+// mask of one is the complement of the other. Chunk boundaries never
+// follow a backslash, so no escape is pending at a chunk start. Chaining
+// the results from the first chunk picks the right hypothesis for every
+// chunk.
+//
+// Each worker then looks for the first comma at depth 1 in its chunk: the
+// elements between consecutive such commas are parsed by the reference
+// parser on separate threads, each into its own arena, and the root adopts
+// the arenas and the children in order. The ranges intern member names
+// into tables of their own, which are then merged in order, so the first
+// range keeps its names and the others are repointed in a second pass.
+//
+// Every range is checked to end exactly where the next one starts, so the
+// result is the reference parser's whatever the scan found. On any failure
+// this returns NULL and json_parse_tree() falls back to the reference
+// parser for the whole document.
+
+#define PARALLEL_MIN_CHUNK (512 * 1024)   // Smaller chunks are not worth a thread
+
+typedef struct {
+    bool in_string;   // At the end of the chunk
+    long depth;       // Relative to the start of the chunk
+    long min_depth;
+} ScanState;
+
+typedef struct {
+    const char* input;
+    size_t start;               // Chunk
+    size_t end;
+    ScanState outside;          // Results of the two hypotheses
+    ScanState inside;
+    
+    bool in_string;             // Actual state at the chunk start
+    long depth;
+    bool closes_root;
+    
+    size_t split;               // Just after the first comma at depth 1, or 0
+    size_t close;               // Closing bracket of the root, if in this chunk
+} ParallelChunk;
+
+typedef struct {
+    JsonParser* parser;         // Worker parser over the whole input
+    JsonArena arena;
+    JsonKeyTable keys;          // Member names of the range
+    const JsonKeyTable* document_keys;   // Merged, for the second pass
+    TreeNode* root;
+    size_t start;
+    size_t end;
+    bool last;
+    bool ok;
+} ParallelRange;
+
+// Classifies the block at `pos` of input[..end), padding a partial block
+// with whitespace, and returns the mask of bytes inside strings
+static uint64_t scan_block(const char* input, size_t pos, size_t end, JsonBlockMasks* m,
+                           uint64_t* prev_escaped, uint64_t* prev_in_string) {
+    if (end - pos >= JSON_BLOCK_SIZE) {
+        json_classify_block(input + pos, m);
+    } else {
+        char tail[JSON_BLOCK_SIZE];
+        memset(tail, ' ', sizeof(tail));
+        memcpy(tail, input + pos, end - pos);
+        json_classify_block(tail, m);
+    }
+    
+    uint64_t escaped = json_escaped_mask(m->backslash, prev_escaped);
+    return json_string_mask(m->quote & ~escaped, prev_in_string);
+}
+
+static void count_brackets(ScanState* state, uint64_t open, uint64_t close) {
+    long closes = __builtin_popcountll(close);
+    if (state->depth - closes >= state->min_depth) {
+        state->depth += __builtin_popcountll(open) - closes;
+        return;
+    }
+    
+    // The minimum may be reached inside this block
+    for (uint64_t brackets = open | close; brackets; brackets &= brackets - 1) {
+        uint64_t bit = brackets & -brackets;
+        state->depth += (close & bit) ? -1 : 1;
+        if (state->depth < state->min_depth) state->min_depth = state->depth;
+    }
+}
+
+static void* scan_chunk(void* arg) {
+    ParallelChunk* chunk = arg;
+    uint64_t prev_escaped = 0;
+    uint64_t prev_in_string = 0;
+    
+    chunk->outside = (ScanState){ false, 0, 0 };
+    chunk->inside = (ScanState){ true, 0, 0 };
+    for (size_t pos = chunk->start; pos < chunk->end; pos += JSON_BLOCK_SIZE) {
+        JsonBlockMasks m;
+        uint64_t in_string = scan_block(chunk->input, pos, chunk->end, &m, &prev_escaped, &prev_in_string);
+        count_brackets(&chunk->outside, m.open & ~in_string, m.close & ~in_string);
+        count_brackets(&chunk->inside, m.open & in_string, m.close & in_string);
+    }
+    
+    chunk->outside.in_string = prev_in_string != 0;
+    chunk->inside.in_string = prev_in_string == 0;
+    return NULL;
+}
+
+// Finds the first element boundary and, if the root closes in this chunk,
+// the closing bracket. Needs the actual start state.
+static void* find_boundaries(void* arg) {
+    ParallelChunk* chunk = arg;
+    uint64_t prev_escaped = 0;
+    uint64_t prev_in_string = chunk->in_string ? ~0ULL : 0;
+    long depth = chunk->depth;
+    
+    for (size_t pos = chunk->start; pos < chunk->end; pos += JSON_BLOCK_SIZE) {
+        JsonBlockMasks m;
+        uint64_t in_string = scan_block(chunk->input, pos, chunk->end, &m, &prev_escaped, &prev_in_string);
+        uint64_t structurals = (m.open | m.close | m.comma) & ~in_string;
+        
+        for (; structurals; structurals &= structurals - 1) {
+            uint64_t bit = structurals & -structurals;
+            size_t offset = pos + (size_t)__builtin_ctzll(structurals);
+            
+            if (m.comma & bit) {
+                if (depth != 1 || chunk->split) continue;
+                chunk->split = offset + 1;
+                if (!chunk->closes_root) return NULL;
+            } else if (m.open & bit) {
+                depth++;
+            } else if (--depth == 0) {
+                chunk->close = offset;
+                return NULL;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void* parse_range(void* arg) {
+    ParallelRange* range = arg;
+    JsonParser* parser = range->parser;
+    
+    parser->arena = &range->arena;
+    parser->keys = &range->keys;
+    parser->pos = range->start;
+    range->ok = json_tree_parse_elements(parser, range->root, range->end, range->last);
+    parser->arena = NULL;
+    parser->keys = NULL;
+    return NULL;
+}
+
+// Points the interned names below `node` at the document's copies
+static void rename_members(const JsonKeyTable* keys, TreeNode* node) {
+    for (size_t i = 0; i < node->children_count; i++) {
+        TreeNode* child = node->children[i];
+        if (child->flags & TREE_NODE_NAME_INTERNED) {
+            const char* interned = json_key_find(keys, child->name.data, child->name.length);
+            if (interned) {
+                child->name.data = interned;
+            } else {
+                child->flags &= ~TREE_NODE_NAME_INTERNED;
+            }
+        }
+        rename_members(keys, child);
+    }
+}
+
+static void* rename_range(void* arg) {
+    ParallelRange* range = arg;
+    JsonParser* worker = range->parser;
+    
+    for (size_t i = 0; i < worker->node_stack_len; i++) {
+        rename_members(range->document_keys, worker->node_stack[i]);
+    }
+    return NULL;
+}
+
+// Runs fn on every item, one thread each, and on the calling thread for
+// items no thread could be started for
+static void run_parallel(void* (*fn)(void*), void* items, size_t item_size, size_t count) {
+    pthread_t* threads = malloc(count * sizeof(pthread_t));
+    bool* started = calloc(count, sizeof(bool));
+    
+    for (size_t i = 1; threads && started && i < count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, fn, (char*)items + i * item_size) == 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!started || !started[i]) fn((char*)items + i * item_size);
+    }
+    for (size_t i = 1; started && i < count; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+    
+    free(started);
+    free(threads);
+}
+
+// Cuts the elements of the root array into chunks and resolves their
+// start states. Returns the number of element ranges, whose starts are
+// stored in `splits`, and sets `close`; 0 if the array does not close.
+static size_t plan_ranges(const char* input, size_t input_len, size_t open, size_t workers,
+                          size_t* splits, size_t* close) {
+    ParallelChunk* chunks = calloc(workers, sizeof(ParallelChunk));
+    if (!chunks) return 0;
+    
+    size_t first = open + 1;
+    size_t chunk_size = (input_len - first) / workers;
+    size_t count = 0;
+    size_t start = first;
+    while (start < input_len && count < workers) {
+        size_t end = count + 1 == workers ? input_len : start + chunk_size;
+        while (end < input_len && input[end - 1] == '\\') end++;
+        
+        chunks[count].input = input;
+        chunks[count].start = start;
+        chunks[count].end = end;
+        count++;
+        start = end;
+    }
+    
+    run_parallel(scan_chunk, chunks, sizeof(ParallelChunk), count);
+    
+    // Chain the hypotheses from the first chunk, which starts at depth 1
+    bool in_string = false;
+    long depth = 1;
+    size_t live = 0;
+    for (size_t i = 0; i < count && depth > 0; i++) {
+        const ScanState* s = in_string ? &chunks[i].inside : &chunks[i].outside;
+        chunks[i].in_string = in_string;
+        chunks[i].depth = depth;
+        chunks[i].closes_root = depth + s->min_depth <= 0;
+        in_string = s->in_string;
+        depth += s->depth;
+        live++;
+    }
+    
+    run_parallel(find_boundaries, chunks, sizeof(ParallelChunk), live);
+    
+    size_t ranges = 0;
+    *close = 0;
+    splits[ranges++] = first;
+    for (size_t i = 0; i < live; i++) {
+        // A chunk inside one long element has no boundary of its own
+        if (i > 0 && chunks[i].split > splits[ranges - 1]) {
+            splits[ranges++] = chunks[i].split;
+        }
+        if (chunks[i].closes_root) {
+            *close = chunks[i].close;
+            break;
+        }
+    }
+    
+    free(chunks);
+    return *close > 0 ? ranges : 0;
+}
+
+TreeNode* json_parse_tree_parallel(JsonParser* parser) {
+    size_t workers = parser->workers > 0 ? parser->workers : json_lines_default_workers();
+    if (workers > parser->input_len / PARALLEL_MIN_CHUNK) workers = parser->input_len / PARALLEL_MIN_CHUNK;
+    if (workers < 2) return NULL;
+    
+    size_t open = json_scan_whitespace(parser->input, parser->input_len);
+    if (open >= parser->input_len || parser->input[open] != '[') return NULL;
+    
+    size_t* splits = malloc(workers * sizeof(size_t));
+    if (!splits) return NULL;
+    
+    size_t close;
+    size_t count = plan_ranges(parser->input, parser->input_len, open, workers, splits, &close);
+    if (count == 0) {
+        free(splits);
+        return NULL;
+    }
+    
+    TreeNode* root = json_tree_begin(parser);
+    ParallelRange* ranges = calloc(count, sizeof(ParallelRange));
+    bool ok = root && ranges;
+    
+    for (size_t i = 0; ok && i < count; i++) {
+        ranges[i].parser = json_parser_create_borrowed(parser->input, parser->input_len);
+        ranges[i].root = root;
+        ranges[i].start = splits[i];
+        ranges[i].end = i + 1 < count ? splits[i + 1] : close;
+        ranges[i].last = i + 1 == count;
+        json_arena_init(&ranges[i].arena);
+        json_key_table_init(&ranges[i].keys);
+        ok = ranges[i].parser != NULL;
+    }
+    if (ok) run_parallel(parse_range, ranges, sizeof(ParallelRange), count);
+    
+    size_t total = 0;
+    for (size_t i = 0; ok && i < count; i++) {
+        ok = ranges[i].ok;
+        total += ranges[i].parser->node_stack_len;
+    }
+    
+    if (ok) {
+        root->type = JSON_ARRAY;
+        if (total > 0) {
+            root->children = json_arena_alloc(parser->arena, total * sizeof(TreeNode*));
+            ok = root->children != NULL;
+        }
+    }
+    if (ok) {
+        for (size_t i = 0; i < count; i++) {
+            JsonParser* worker = ranges[i].parser;
+            memcpy(&root->children[root->children_count], worker->node_stack,
+                   worker->node_stack_len * sizeof(TreeNode*));
+            root->children_count += worker->node_stack_len;
+        }
+        root->children_capacity = total;
+        parser->pos = close + 1;
+        
+        for (size_t i = 0; i < count; i++) {
+            const JsonKeyTable* keys = &ranges[i].keys;
+            for (size_t slot = 0; keys->slots && slot <= keys->mask; slot++) {
+                JsonSlice name = { keys->slots[slot].data, keys->slots[slot].length };
+                if (name.data) json_key_intern(parser->keys, &name);
+            }
+            ranges[i].document_keys = parser->keys;
+        }
+        if (count > 1) run_parallel(rename_range, ranges + 1, sizeof(ParallelRange), count - 1);
+    }
+    
+    for (size_t i = 0; ranges && i < count; i++) {
+        // The nodes of a failed parse go with the root's arena as well
+        if (root) json_arena_adopt(parser->arena, &ranges[i].arena);
+        json_arena_release(&ranges[i].arena);
+        json_key_table_release(&ranges[i].keys);
+        json_parser_destroy(ranges[i].parser);
+    }
+    free(ranges);
+    free(splits);
+    
+    if (!root) return NULL;
+    return json_tree_end(parser, root, ok);
+}
@@ -1,29 +1,41 @@
-#include "json_parser.h"
+#include "json_internal.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
 
 #define INITIAL_CAPACITY 16
-#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define STREAM_CHUNK_SIZE (64 * 1024)
 
-static void skip_whitespace(JsonParser* parser) {
-    while (parser->pos < parser->input_len) {
-        char c = parser->input[parser->pos];
-        if (c == ' ' || c == '\t' || c == '\r') {
-            parser->pos++;
-            parser->column++;
-        } else if (c == '\n') {
-            parser->pos++;
-            parser->line++;
-            parser->column = 0;
-        } else {
-            break;
+// The parser only tracks its byte offset; line and column are recovered
+// here, when an error is reported. Lines advance on newlines outside
+// strings only, and the column counts bytes since the last such newline.
+static void locate_position(const char* input, size_t pos, size_t* line, size_t* column) {
+    size_t lines = 1;
+    size_t line_start = 0;
+    size_t i = 0;
+    
+    while (i < pos) {
+        i += json_scan_pair(&input[i], pos - i, '\n', '"');
+        if (i >= pos) break;
+        
+        if (input[i] == '\n') {
+            lines++;
+            line_start = ++i;
+            continue;
         }
+        
+        // Skip over the string and its closing quote
+        bool escaped;
+        i++;
+        i += json_scan_string_body(&input[i], pos - i, &escaped) + 1;
     }
+    
+    *line = lines;
+    *column = pos - line_start;
 }
 
-static void add_error(JsonParser* parser, const char* message) {
+void json_parser_error(JsonParser* parser, const char* message) {
     if (parser->error_count >= parser->error_capacity) {
         size_t new_capacity = parser->error_capacity * 2;
         ValidationError* new_errors = realloc(parser->errors, new_capacity * sizeof(ValidationError));
@@ -32,263 +44,274 @@ static void add_error(JsonParser* parser, const char* message) {
         parser->error_capacity = new_capacity;
     }
     
+    size_t line, column;
+    locate_position(parser->input, parser->pos, &line, &column);
+    
     ValidationError* error = &parser->errors[parser->error_count++];
     error->message = strdup(message);
-    error->position.line = parser->line;
-    error->position.column = parser->column;
+    error->position.line = parser->line_offset + line;
+    error->position.column = line > 1 ? column : parser->column_offset + column;
 }
 
-static char* parse_string(JsonParser* parser) {
+// Sets `out` to the raw contents between the quotes, without copying
+static bool parse_string(JsonParser* parser, JsonSlice* out, bool* has_escapes) {
     if (parser->pos >= parser->input_len || parser->input[parser->pos] != '"') {
-        add_error(parser, "Expected string");
-        return NULL;
+        json_parser_error(parser, "Expected string");
+        return false;
     }
     
     parser->pos++; // Skip opening quote
-    parser->column++;
     
     size_t start = parser->pos;
-    size_t len = 0;
-    bool escaped = false;
-    
-    while (parser->pos < parser->input_len) {
-        char c = parser->input[parser->pos];
-        
-        if (escaped) {
-            escaped = false;
-        } else if (c == '\\') {
-            escaped = true;
-        } else if (c == '"') {
-            break;
-        }
-        
-        parser->pos++;
-        parser->column++;
-        len++;
-    }
+    *has_escapes = false;
     
+    size_t len = json_scan_string_body(&parser->input[start], parser->input_len - start, has_escapes);
+    parser->pos += len;
     if (parser->pos >= parser->input_len) {
-        add_error(parser, "Unterminated string");
-        return NULL;
+        json_parser_error(parser, "Unterminated string");
+        return false;
     }
     
     parser->pos++; // Skip closing quote
-    parser->column++;
     
-    char* str = malloc(len + 1);
-    if (!str) return NULL;
+    out->data = &parser->input[start];
+    out->length = len;
+    return true;
+}
+
+TreeNode* json_tree_node_alloc(JsonParser* parser, TreeNode* parent) {
+    TreeNode* node = json_arena_alloc(parser->arena, sizeof(TreeNode));
+    if (!node) return NULL;
+    
+    node->name = (JsonSlice){ NULL, 0 };
+    node->value = (JsonSlice){ NULL, 0 };
+    node->type = JSON_NULL;
+    node->flags = TREE_NODE_ARENA;
+    node->children = NULL;
+    node->children_count = 0;
+    node->children_capacity = 0;
+    node->parent = parent;
+    node->key_index = NULL;
+    
+    return node;
+}
+
+bool json_tree_push_child(JsonParser* parser, TreeNode* child) {
+    if (parser->node_stack_len >= parser->node_stack_capacity) {
+        size_t new_capacity = parser->node_stack_capacity == 0 ? JSON_BUFFER_SIZE : parser->node_stack_capacity * 2;
+        TreeNode** new_stack = realloc(parser->node_stack, new_capacity * sizeof(TreeNode*));
+        if (!new_stack) return false;
+        
+        parser->node_stack = new_stack;
+        parser->node_stack_capacity = new_capacity;
+    }
+    
+    parser->node_stack[parser->node_stack_len++] = child;
+    return true;
+}
+
+// Moves the children collected since `base` into an exactly sized arena array
+bool json_tree_finish_container(JsonParser* parser, TreeNode* node, size_t base) {
+    size_t count = parser->node_stack_len - base;
+    if (count > 0) {
+        node->children = json_arena_alloc(parser->arena, count * sizeof(TreeNode*));
+        if (!node->children) return false;
+        memcpy(node->children, &parser->node_stack[base], count * sizeof(TreeNode*));
+    }
     
-    memcpy(str, &parser->input[start], len);
-    str[len] = '\0';
-    return str;
+    node->children_count = count;
+    node->children_capacity = count;
+    parser->node_stack_len = base;
+    return true;
 }
 
-static TreeNode* parse_value(JsonParser* parser);
+static bool parse_value(JsonParser* parser, TreeNode* node);
 
-static TreeNode* parse_array(JsonParser* parser) {
-    TreeNode* node = tree_node_create(NULL, NULL, JSON_ARRAY);
-    if (!node) return NULL;
+static bool parse_array(JsonParser* parser, TreeNode* node) {
+    node->type = JSON_ARRAY;
+    size_t base = parser->node_stack_len;
     
     parser->pos++; // Skip [
-    parser->column++;
-    skip_whitespace(parser);
+    json_skip_whitespace(parser);
     
     while (parser->pos < parser->input_len && parser->input[parser->pos] != ']') {
-        TreeNode* value = parse_value(parser);
-        if (!value) {
-            tree_node_destroy(node);
-            return NULL;
-        }
-        
-        char index_str[32];
-        snprintf(index_str, sizeof(index_str), "%zu", node->children_count);
-        value->name = strdup(index_str);
-        tree_node_add_child(node, value);
+        TreeNode* value = json_tree_node_alloc(parser, node);
+        if (!value || !parse_value(parser, value) || !json_tree_push_child(parser, value)) return false;
         
-        skip_whitespace(parser);
+        json_skip_whitespace(parser);
         if (parser->pos < parser->input_len && parser->input[parser->pos] == ',') {
             parser->pos++;
-            parser->column++;
-            skip_whitespace(parser);
+            json_skip_whitespace(parser);
         }
     }
     
     if (parser->pos >= parser->input_len || parser->input[parser->pos] != ']') {
-        add_error(parser, "Unterminated array");
-        tree_node_destroy(node);
-        return NULL;
+        json_parser_error(parser, "Unterminated array");
+        return false;
     }
     
     parser->pos++; // Skip ]
-    parser->column++;
-    return node;
+    return json_tree_finish_container(parser, node, base);
 }
 
-static TreeNode* parse_object(JsonParser* parser) {
-    TreeNode* node = tree_node_create(NULL, NULL, JSON_OBJECT);
-    if (!node) return NULL;
+// Parses elements of `array` from parser->pos, as parse_array() does, up to
+// `end`, leaving them on the node stack. Unless this is the `last` range,
+// which ends at the closing bracket, the range must end just after the
+// comma that follows its last element.
+bool json_tree_parse_elements(JsonParser* parser, TreeNode* array, size_t end, bool last) {
+    bool at_end = false;
+    json_skip_whitespace(parser);
+    
+    while (parser->pos < end) {
+        TreeNode* value = json_tree_node_alloc(parser, array);
+        if (!value || !parse_value(parser, value) || !json_tree_push_child(parser, value)) return false;
+        
+        at_end = false;
+        json_skip_whitespace(parser);
+        if (parser->pos < parser->input_len && parser->input[parser->pos] == ',') {
+            parser->pos++;
+            at_end = parser->pos == end;
+            json_skip_whitespace(parser);
+        }
+    }
+    
+    if (!last) return at_end;
+    return parser->pos == end && end < parser->input_len && parser->input[end] == ']';
+}
+
+static bool parse_object(JsonParser* parser, TreeNode* node) {
+    node->type = JSON_OBJECT;
+    size_t base = parser->node_stack_len;
     
     parser->pos++; // Skip {
-    parser->column++;
-    skip_whitespace(parser);
+    json_skip_whitespace(parser);
     
     while (parser->pos < parser->input_len && parser->input[parser->pos] != '}') {
-        char* key = parse_string(parser);
-        if (!key) {
-            tree_node_destroy(node);
-            return NULL;
-        }
+        JsonSlice key;
+        bool key_escaped;
+        if (!parse_string(parser, &key, &key_escaped)) return false;
         
-        skip_whitespace(parser);
+        json_skip_whitespace(parser);
         if (parser->pos >= parser->input_len || parser->input[parser->pos] != ':') {
-            free(key);
-            add_error(parser, "Expected ':'");
-            tree_node_destroy(node);
-            return NULL;
+            json_parser_error(parser, "Expected ':'");
+            return false;
         }
         
         parser->pos++; // Skip :
-        parser->column++;
-        skip_whitespace(parser);
+        json_skip_whitespace(parser);
         
-        TreeNode* value = parse_value(parser);
-        if (!value) {
-            free(key);
-            tree_node_destroy(node);
-            return NULL;
-        }
+        TreeNode* value = json_tree_node_alloc(parser, node);
+        if (!value || !parse_value(parser, value)) return false;
         
         value->name = key;
-        tree_node_add_child(node, value);
+        if (key_escaped) value->flags |= TREE_NODE_NAME_ESCAPED;
+        if (json_key_intern(parser->keys, &value->name)) value->flags |= TREE_NODE_NAME_INTERNED;
+        if (!json_tree_push_child(parser, value)) return false;
         
-        skip_whitespace(parser);
+        json_skip_whitespace(parser);
         if (parser->pos < parser->input_len && parser->input[parser->pos] == ',') {
             parser->pos++;
-            parser->column++;
-            skip_whitespace(parser);
+            json_skip_whitespace(parser);
         }
     }
     
     if (parser->pos >= parser->input_len || parser->input[parser->pos] != '}') {
-        add_error(parser, "Unterminated object");
-        tree_node_destroy(node);
-        return NULL;
+        json_parser_error(parser, "Unterminated object");
+        return false;
     }
     
     parser->pos++; // Skip }
-    parser->column++;
-    return node;
+    return json_tree_finish_container(parser, node, base);
 }
 
-static TreeNode* parse_value(JsonParser* parser) {
-    skip_whitespace(parser);
+static bool parse_literal(JsonParser* parser, TreeNode* node, const char* literal, size_t len, JsonType type) {
+    if (parser->pos + len - 1 < parser->input_len &&
+        strncmp(&parser->input[parser->pos], literal, len) == 0) {
+        node->type = type;
+        node->value = (JsonSlice){ &parser->input[parser->pos], len };
+        parser->pos += len;
+        return true;
+    }
+    return false;
+}
+
+// Fills in `node`, which the caller has already allocated in the arena
+static bool parse_value(JsonParser* parser, TreeNode* node) {
+    json_skip_whitespace(parser);
     
     if (parser->pos >= parser->input_len) {
-        add_error(parser, "Unexpected end of input");
-        return NULL;
+        json_parser_error(parser, "Unexpected end of input");
+        return false;
     }
     
     char c = parser->input[parser->pos];
     switch (c) {
         case '"': {
-            char* str = parse_string(parser);
-            if (!str) return NULL;
-            TreeNode* node = tree_node_create(NULL, str, JSON_STRING);
-            free(str);
-            return node;
+            bool escaped;
+            node->type = JSON_STRING;
+            if (!parse_string(parser, &node->value, &escaped)) return false;
+            if (escaped) node->flags |= TREE_NODE_VALUE_ESCAPED;
+            return true;
         }
         case '{':
-            return parse_object(parser);
+            return parse_object(parser, node);
         case '[':
-            return parse_array(parser);
+            return parse_array(parser, node);
         case 't':
-            if (parser->pos + 3 < parser->input_len &&
-                strncmp(&parser->input[parser->pos], "true", 4) == 0) {
-                parser->pos += 4;
-                parser->column += 4;
-                return tree_node_create(NULL, "true", JSON_BOOL);
-            }
-            add_error(parser, "Invalid true value");
-            return NULL;
+            if (parse_literal(parser, node, "true", 4, JSON_BOOL)) return true;
+            json_parser_error(parser, "Invalid true value");
+            return false;
         case 'f':
-            if (parser->pos + 4 < parser->input_len &&
-                strncmp(&parser->input[parser->pos], "false", 5) == 0) {
-                parser->pos += 5;
-                parser->column += 5;
-                return tree_node_create(NULL, "false", JSON_BOOL);
-            }
-            add_error(parser, "Invalid false value");
-            return NULL;
+            if (parse_literal(parser, node, "false", 5, JSON_BOOL)) return true;
+            json_parser_error(parser, "Invalid false value");
+            return false;
         case 'n':
-            if (parser->pos + 3 < parser->input_len &&
-                strncmp(&parser->input[parser->pos], "null", 4) == 0) {
-                parser->pos += 4;
-                parser->column += 4;
-                return tree_node_create(NULL, "null", JSON_NULL);
-            }
-            add_error(parser, "Invalid null value");
-            return NULL;
+            if (parse_literal(parser, node, "null", 4, JSON_NULL)) return true;
+            json_parser_error(parser, "Invalid null value");
+            return false;
         default:
             if (c == '-' || isdigit(c)) {
-                // Simple number parsing for now
-                size_t start = parser->pos;
-                size_t len = 0;
-                bool has_decimal = false;
-                
-                if (c == '-') {
-                    parser->pos++;
-                    parser->column++;
-                    len++;
+                size_t len = json_scan_number(&parser->input[parser->pos], parser->input_len - parser->pos);
+                node->type = JSON_NUMBER;
+                node->value = (JsonSlice){ &parser->input[parser->pos], len };
+                if (!json_number_parse(node->value, &node->number)) {
+                    json_parser_error(parser, "Invalid number");
+                    return false;
                 }
-                
-                while (parser->pos < parser->input_len) {
-                    c = parser->input[parser->pos];
-                    if (c == '.' && !has_decimal) {
-                        has_decimal = true;
-                    } else if (!isdigit(c)) {
-                        break;
-                    }
-                    parser->pos++;
-                    parser->column++;
-                    len++;
-                }
-                
-                char* num_str = malloc(len + 1);
-                if (!num_str) return NULL;
-                memcpy(num_str, &parser->input[start], len);
-                num_str[len] = '\0';
-                
-                TreeNode* node = tree_node_create(NULL, num_str, JSON_NUMBER);
-                free(num_str);
-                return node;
+                parser->pos += len;
+                return true;
             }
             
-            add_error(parser, "Invalid value");
-            return NULL;
+            json_parser_error(parser, "Invalid value");
+            return false;
     }
 }
 
-JsonParser* json_parser_create(const char* input, size_t len) {
+static JsonParser* parser_alloc(const char* input, size_t len, bool owns_input) {
     JsonParser* parser = malloc(sizeof(JsonParser));
     if (!parser) return NULL;
     
-    parser->input = malloc(len + 1);
-    if (!parser->input) {
-        free(parser);
-        return NULL;
-    }
-    
-    memcpy(parser->input, input, len);
-    parser->input[len] = '\0';
+    parser->input = input;
     parser->input_len = len;
+    parser->owns_input = owns_input;
+    parser->input_complete = true;
+    parser->input_capacity = owns_input ? len + 1 : 0;
+    parser->source = NULL;
+    parser->line_offset = 0;
+    parser->column_offset = 0;
+    parser->input_offset = 0;
     parser->pos = 0;
-    parser->line = 1;
-    parser->column = 0;
+    parser->engine = JSON_ENGINE_RECURSIVE;
+    parser->workers = 0;
+    parser->arena = NULL;
+    parser->keys = NULL;
+    parser->node_stack = NULL;
+    parser->node_stack_len = 0;
+    parser->node_stack_capacity = 0;
     
     parser->error_capacity = INITIAL_CAPACITY;
     parser->errors = malloc(parser->error_capacity * sizeof(ValidationError));
     if (!parser->errors) {
-        free(parser->input);
         free(parser);
         return NULL;
     }
@@ -297,6 +320,102 @@ JsonParser* json_parser_create(const char* input, size_t len) {
     return parser;
 }
 
+JsonParser* json_parser_create(const char* input, size_t len) {
+    char* copy = malloc(len + 1);
+    if (!copy) return NULL;
+    
+    memcpy(copy, input, len);
+    copy[len] = '\0';
+    
+    JsonParser* parser = parser_alloc(copy, len, true);
+    if (!parser) free(copy);
+    return parser;
+}
+
+// Parses the caller's buffer in place. The buffer need not be NUL-terminated
+// (e.g. a file mapping) and must outlive the parser and any tree built from it.
+JsonParser* json_parser_create_borrowed(const char* input, size_t len) {
+    return parser_alloc(input, len, false);
+}
+
+JsonParser* json_parser_create_stream(FILE* source) {
+    JsonParser* parser = parser_alloc(NULL, 0, true);
+    if (!parser) return NULL;
+    
+    parser->input_complete = false;
+    parser->input_capacity = 0;
+    parser->source = source;
+    return parser;
+}
+
+// Drops the input before parser->pos, which the reader has consumed. The
+// reader only stops between tokens, never inside a string, so the position
+// of the first remaining byte carries over as a plain offset.
+static void discard_consumed(JsonParser* parser) {
+    if (parser->pos == 0) return;
+    
+    size_t line, column;
+    locate_position(parser->input, parser->pos, &line, &column);
+    if (line > 1) parser->column_offset = 0;
+    parser->line_offset += line - 1;
+    parser->column_offset += column;
+    parser->input_offset += parser->pos;
+    
+    char* data = (char*)parser->input;
+    memmove(data, data + parser->pos, parser->input_len - parser->pos);
+    parser->input_len -= parser->pos;
+    parser->pos = 0;
+}
+
+static bool reserve_input(JsonParser* parser, size_t extra) {
+    size_t needed = parser->input_len + extra;
+    if (needed <= parser->input_capacity) return true;
+    
+    size_t new_capacity = parser->input_capacity > 0 ? parser->input_capacity : STREAM_CHUNK_SIZE;
+    while (new_capacity < needed) new_capacity *= 2;
+    
+    char* new_input = realloc((char*)parser->input, new_capacity);
+    if (!new_input) return false;
+    
+    parser->input = new_input;
+    parser->input_capacity = new_capacity;
+    return true;
+}
+
+bool json_parser_feed(JsonParser* parser, const char* data, size_t len) {
+    if (!parser || parser->input_complete) return false;
+    
+    discard_consumed(parser);
+    if (!reserve_input(parser, len)) return false;
+    
+    if (len > 0) memcpy((char*)parser->input + parser->input_len, data, len);
+    parser->input_len += len;
+    return true;
+}
+
+void json_parser_finish(JsonParser* parser) {
+    if (parser) parser->input_complete = true;
+}
+
+// Reads the next chunk from parser->source, or marks the input complete at
+// end of file. Returns false on a read error.
+bool json_parser_fill(JsonParser* parser) {
+    if (!parser || !parser->source || parser->input_complete) return false;
+    
+    discard_consumed(parser);
+    if (!reserve_input(parser, STREAM_CHUNK_SIZE)) return false;
+    
+    char* end = (char*)parser->input + parser->input_len;
+    size_t n = fread(end, 1, parser->input_capacity - parser->input_len, parser->source);
+    parser->input_len += n;
+    
+    if (n == 0) {
+        if (ferror(parser->source)) return false;
+        parser->input_complete = true;
+    }
+    return true;
+}
+
 void json_parser_destroy(JsonParser* parser) {
     if (!parser) return;
     
@@ -305,36 +424,218 @@ void json_parser_destroy(JsonParser* parser) {
     }
     
     free(parser->errors);
-    free(parser->input);
+    free(parser->node_stack);
+    if (parser->owns_input) free((char*)parser->input);
     free(parser);
 }
 
-TreeNode* json_parse_tree(JsonParser* parser) {
-    if (!parser) return NULL;
+// FNV-1a, eight bytes at a time while it can
+static uint64_t key_hash(const char* key, size_t len) {
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, key + i, sizeof(word));
+        hash ^= word;
+        hash *= 1099511628211ull;
+        hash ^= hash >> 32;
+    }
+    for (; i < len; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+#define KEY_TABLE_INITIAL_SLOTS 64
+
+void json_key_table_init(JsonKeyTable* table) {
+    table->slots = NULL;
+    table->mask = 0;
+    table->count = 0;
+    table->last = 0;
+}
+
+void json_key_table_release(JsonKeyTable* table) {
+    free(table->slots);
+    json_key_table_init(table);
+}
+
+// Slot holding the name key[0..len), or the empty slot where it would go
+static JsonKeySlot* key_table_slot(const JsonKeyTable* table, const char* key, size_t len, uint64_t hash) {
+    size_t slot = (size_t)hash & table->mask;
+    while (table->slots[slot].data) {
+        const JsonKeySlot* entry = &table->slots[slot];
+        if (entry->hash == hash && entry->length == len && memcmp(entry->data, key, len) == 0) break;
+        slot = (slot + 1) & table->mask;
+    }
+    return &table->slots[slot];
+}
+
+static bool key_table_grow(JsonKeyTable* table) {
+    size_t slot_count = table->slots ? (table->mask + 1) * 2 : KEY_TABLE_INITIAL_SLOTS;
+    JsonKeySlot* slots = calloc(slot_count, sizeof(JsonKeySlot));
+    if (!slots) return false;
+    
+    // The successors are slot numbers, so they start over
+    JsonKeyTable grown = { slots, slot_count - 1, table->count, 0 };
+    for (size_t i = 0; table->slots && i <= table->mask; i++) {
+        const JsonKeySlot* entry = &table->slots[i];
+        if (!entry->data) continue;
+        JsonKeySlot* slot = key_table_slot(&grown, entry->data, entry->length, entry->hash);
+        *slot = *entry;
+        slot->next = 0;
+    }
+    free(table->slots);
+    *table = grown;
+    return true;
+}
+
+// Records repeat their names in the same order, so the name that followed
+// the previous one last time is tried before hashing
+bool json_key_intern(JsonKeyTable* table, JsonSlice* name) {
+    if (!table) return false;
+    
+    size_t next = table->last ? table->slots[table->last - 1].next : 0;
+    if (next) {
+        const JsonKeySlot* guess = &table->slots[next - 1];
+        if (guess->length == name->length && memcmp(guess->data, name->data, name->length) == 0) {
+            name->data = guess->data;
+            table->last = next;
+            return true;
+        }
+    }
+    if (table->count * 2 >= table->mask && !key_table_grow(table)) return false;
+    
+    uint64_t hash = key_hash(name->data, name->length);
+    JsonKeySlot* slot = key_table_slot(table, name->data, name->length, hash);
+    if (!slot->data) {
+        if (table->count >= JSON_KEY_TABLE_MAX) return false;
+        *slot = (JsonKeySlot){ name->data, name->length, hash, 0 };
+        table->count++;
+    }
+    
+    next = (size_t)(slot - table->slots) + 1;
+    if (table->last) table->slots[table->last - 1].next = next;
+    table->last = next;
+    name->data = slot->data;
+    return true;
+}
+
+const char* json_key_find(const JsonKeyTable* table, const char* key, size_t len) {
+    if (!table || table->count == 0) return NULL;
+    return key_table_slot(table, key, len, key_hash(key, len))->data;
+}
+
+// Hash index of an object's keys. Slots hold the position of a member plus
+// one (0 when empty) and the low bits of its key hash, which settle most
+// probes without comparing names.
+typedef struct {
+    uint32_t hash;
+    uint32_t member;
+} KeySlot;
+
+struct JsonKeyIndex {
+    struct JsonKeyIndex* next;
+    size_t mask;
+    KeySlot slots[];
+};
+
+// A parsed tree: the arena and the root node share the arena's first
+// allocation, so tree_node_destroy(root) can find and release the arena
+typedef struct {
+    JsonArena arena;
+    JsonKeyTable keys;                  // Member names
+    struct JsonKeyIndex* key_indexes;   // Of objects in the tree, chained
+    TreeNode root;
+} TreeDocument;
+
+// Starts a new arena-backed tree for `parser` and returns its empty root
+TreeNode* json_tree_begin(JsonParser* parser) {
     parser->pos = 0;
-    parser->line = 1;
-    parser->column = 0;
     parser->error_count = 0;
-    return parse_value(parser);
+    parser->node_stack_len = 0;
+    
+    JsonArena arena;
+    json_arena_init(&arena);
+    TreeDocument* doc = json_arena_alloc(&arena, sizeof(TreeDocument));
+    if (!doc) return NULL;
+    doc->arena = arena;
+    json_key_table_init(&doc->keys);
+    doc->key_indexes = NULL;
+    
+    parser->arena = &doc->arena;
+    parser->keys = &doc->keys;
+    TreeNode* root = &doc->root;
+    root->name = (JsonSlice){ NULL, 0 };
+    root->value = (JsonSlice){ NULL, 0 };
+    root->type = JSON_NULL;
+    root->flags = TREE_NODE_ARENA | TREE_NODE_ARENA_ROOT;
+    root->children = NULL;
+    root->children_count = 0;
+    root->children_capacity = 0;
+    root->parent = NULL;
+    root->key_index = NULL;
+    return root;
+}
+
+// Completes the tree started by json_tree_begin(), discarding it on failure
+TreeNode* json_tree_end(JsonParser* parser, TreeNode* root, bool ok) {
+    parser->arena = NULL;
+    parser->keys = NULL;
+    if (!ok) {
+        tree_node_destroy(root);
+        return NULL;
+    }
+    return root;
+}
+
+TreeNode* json_parse_tree(JsonParser* parser) {
+    if (!parser) return NULL;
+    
+    if (parser->engine == JSON_ENGINE_STRUCTURAL) {
+        // Anything the structural engine does not accept is re-parsed by the
+        // reference parser below, which also produces the error messages
+        TreeNode* root = json_parse_tree_structural(parser);
+        if (root) return root;
+    }
+    if (parser->engine == JSON_ENGINE_PARALLEL) {
+        TreeNode* root = json_parse_tree_parallel(parser);
+        if (root) return root;
+    }
+    
+    TreeNode* root = json_tree_begin(parser);
+    if (!root) return NULL;
+    return json_tree_end(parser, root, parse_value(parser, root));
 }
 
 TreeNode* tree_node_create(const char* name, const char* value, JsonType type) {
     TreeNode* node = malloc(sizeof(TreeNode));
     if (!node) return NULL;
     
-    node->name = name ? strdup(name) : NULL;
-    node->value = value ? strdup(value) : NULL;
+    // Hand-built nodes own copies of their strings
+    node->name = (JsonSlice){ name ? strdup(name) : NULL, name ? strlen(name) : 0 };
+    node->value = (JsonSlice){ value ? strdup(value) : NULL, value ? strlen(value) : 0 };
     node->type = type;
+    node->flags = 0;
+    if (type == JSON_NUMBER && !json_number_parse(node->value, &node->number)) {
+        node->number = (JsonNumber){ .type = JSON_NUMBER_DOUBLE, .d = 0.0 };
+    }
     node->children = NULL;
     node->children_count = 0;
     node->children_capacity = 0;
     node->parent = NULL;
+    node->key_index = NULL;
     
     return node;
 }
 
 void tree_node_add_child(TreeNode* parent, TreeNode* child) {
     if (!parent || !child) return;
+    if (parent->flags & TREE_NODE_ARENA) return; // Parsed trees are read-only
+    
+    free(parent->key_index);
+    parent->key_index = NULL;
     
     if (parent->children_count >= parent->children_capacity) {
         size_t new_capacity = parent->children_capacity == 0 ? INITIAL_CAPACITY : parent->children_capacity * 2;
@@ -352,16 +653,166 @@ void tree_node_add_child(TreeNode* parent, TreeNode* child) {
 void tree_node_destroy(TreeNode* node) {
     if (!node) return;
     
+    if (node->flags & TREE_NODE_ARENA_ROOT) {
+        TreeDocument* doc = (TreeDocument*)((char*)node - offsetof(TreeDocument, root));
+        while (doc->key_indexes) {
+            struct JsonKeyIndex* next = doc->key_indexes->next;
+            free(doc->key_indexes);
+            doc->key_indexes = next;
+        }
+        json_key_table_release(&doc->keys);
+        json_arena_release(&doc->arena);
+        return;
+    }
+    if (node->flags & TREE_NODE_ARENA) return; // Freed with its root
+    
     for (size_t i = 0; i < node->children_count; i++) {
         tree_node_destroy(node->children[i]);
     }
     
-    free(node->name);
-    free(node->value);
+    free((char*)node->name.data);
+    free((char*)node->value.data);
     free(node->children);
+    free(node->key_index);
     free(node);
 }
 
+// Document of an arena node, or NULL for hand-built nodes
+static TreeDocument* node_document(const TreeNode* node) {
+    if (!(node->flags & TREE_NODE_ARENA)) return NULL;
+    while (node->parent) node = node->parent;
+    if (!(node->flags & TREE_NODE_ARENA_ROOT)) return NULL;
+    return (TreeDocument*)((char*)node - offsetof(TreeDocument, root));
+}
+
+// The document's copy of the raw name key[0..len), hashed with key_hash()
+static const char* interned_name(const TreeDocument* doc, const char* key, size_t len, uint64_t hash) {
+    if (!doc || doc->keys.count == 0) return NULL;
+    return key_table_slot(&doc->keys, key, len, hash)->data;
+}
+
+// Unescaped name of a member. Escaped names are decoded into *decoded,
+// which the caller frees; the name has no data if that fails.
+static JsonSlice member_name(const TreeNode* member, char** decoded) {
+    *decoded = NULL;
+    if (!(member->flags & TREE_NODE_NAME_ESCAPED)) return member->name;
+    
+    *decoded = malloc(member->name.length + 1);
+    if (!*decoded) return (JsonSlice){ NULL, 0 };
+    return (JsonSlice){ *decoded, json_unescape_into(member->name, *decoded) };
+}
+
+// Whether `member` is named key[0..len). `interned` is the document's copy
+// of the key: an interned name without escapes is the key only if it is
+// that very pointer.
+static bool name_equals(const TreeNode* member, const char* key, size_t len, const char* interned) {
+    if ((member->flags & (TREE_NODE_NAME_INTERNED | TREE_NODE_NAME_ESCAPED)) == TREE_NODE_NAME_INTERNED) {
+        return member->name.data == interned;
+    }
+    
+    char* decoded;
+    JsonSlice name = member_name(member, &decoded);
+    bool equal = name.data && name.length == len && memcmp(name.data, key, len) == 0;
+    free(decoded);
+    return equal;
+}
+
+// Slot holding key[0..len), or the empty slot where it would go
+static KeySlot* find_slot(const TreeNode* object, struct JsonKeyIndex* index,
+                          const char* key, size_t len, const char* interned, uint64_t hash) {
+    size_t slot = (size_t)hash & index->mask;
+    while (index->slots[slot].member != 0) {
+        const KeySlot* entry = &index->slots[slot];
+        if (entry->hash == (uint32_t)hash &&
+            name_equals(object->children[entry->member - 1], key, len, interned)) {
+            break;
+        }
+        slot = (slot + 1) & index->mask;
+    }
+    return &index->slots[slot];
+}
+
+static struct JsonKeyIndex* build_key_index(const TreeNode* object, const TreeDocument* doc) {
+    size_t slot_count = 1;
+    while (slot_count < object->children_count * 2) slot_count *= 2;
+    
+    struct JsonKeyIndex* index = calloc(1, sizeof(struct JsonKeyIndex) + slot_count * sizeof(KeySlot));
+    if (!index) return NULL;
+    index->mask = slot_count - 1;
+    
+    // Later duplicates find the slot of the first one taken
+    for (size_t i = 0; i < object->children_count; i++) {
+        const TreeNode* member = object->children[i];
+        char* decoded;
+        JsonSlice name = member_name(member, &decoded);
+        if (!name.data) {
+            free(index);
+            return NULL;
+        }
+        
+        uint64_t hash = key_hash(name.data, name.length);
+        const char* interned = (member->flags & TREE_NODE_NAME_INTERNED) && !decoded ? name.data :
+                               interned_name(doc, name.data, name.length, hash);
+        KeySlot* slot = find_slot(object, index, name.data, name.length, interned, hash);
+        if (slot->member == 0) {
+            slot->hash = (uint32_t)hash;
+            slot->member = (uint32_t)(i + 1);
+        }
+        free(decoded);
+    }
+    return index;
+}
+
+// Builds the index of `object` unless another thread has, and hands it to
+// the document so it is freed with the arena
+static struct JsonKeyIndex* attach_key_index(TreeNode* object, TreeDocument* doc) {
+    if ((object->flags & TREE_NODE_ARENA) && !doc) return NULL;
+    
+    struct JsonKeyIndex* index = build_key_index(object, doc);
+    if (!index) return NULL;
+    
+    struct JsonKeyIndex* current = NULL;
+    if (!__atomic_compare_exchange_n(&object->key_index, &current, index, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(index);
+        return current;
+    }
+    
+    if (doc) {
+        index->next = __atomic_load_n(&doc->key_indexes, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&doc->key_indexes, &index->next, index, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+    return index;
+}
+
+TreeNode* json_object_get(const TreeNode* object, const char* key, size_t len) {
+    if (!object || object->type != JSON_OBJECT || (!key && len > 0)) return NULL;
+    if (!key) key = "";
+    
+    // Interned names are compared by pointer with the document's copy
+    TreeDocument* doc = node_document(object);
+    uint64_t hash = key_hash(key, len);
+    const char* interned = interned_name(doc, key, len, hash);
+    
+    // The index is a cache: building it leaves the tree logically unchanged
+    size_t count = object->children_count;
+    if (count >= JSON_OBJECT_INDEX_MIN && count < UINT32_MAX) {
+        struct JsonKeyIndex* index = __atomic_load_n(&object->key_index, __ATOMIC_ACQUIRE);
+        if (!index) index = attach_key_index((TreeNode*)object, doc);
+        if (index) {
+            const KeySlot* slot = find_slot(object, index, key, len, interned, hash);
+            return slot->member != 0 ? object->children[slot->member - 1] : NULL;
+        }
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        if (name_equals(object->children[i], key, len, interned)) return object->children[i];
+    }
+    return NULL;
+}
+
 void json_free(void* ptr) {
     free(ptr);
 } 
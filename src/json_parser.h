@@ -11,6 +11,9 @@
 #define JSON_BUFFER_SIZE 1024
 #define JSON_PATH_MAX_LENGTH 256
 #define JSON_MAX_DEPTH 1000
+#define JSON_WRITER_BUFFER_SIZE (64 * 1024)
+#define JSON_WRITER_DIRECT_SIZE 4096
+#define JSON_OBJECT_INDEX_MIN 32     // Members before json_object_get() hashes the keys
 
 // JSON value types
 typedef enum {
@@ -22,6 +25,22 @@ typedef enum {
     JSON_OBJECT
 } JsonType;
 
+// Tree construction engines. The recursive descent parser is the reference
+// implementation; the structural engine first indexes all structural
+// characters with SIMD, then builds the tree from that index; the parallel
+// engine splits a root array into ranges parsed on separate threads.
+typedef enum {
+    JSON_ENGINE_RECURSIVE,
+    JSON_ENGINE_STRUCTURAL,
+    JSON_ENGINE_PARALLEL
+} JsonEngine;
+
+// Binary interchange formats for json_write_binary() and json_read_binary()
+typedef enum {
+    JSON_BINARY_CBOR,
+    JSON_BINARY_MSGPACK
+} JsonBinaryFormat;
+
 // Token types for syntax highlighting
 typedef enum {
     TOKEN_BRACE,
@@ -34,17 +53,112 @@ typedef enum {
     TOKEN_NULL
 } TokenType;
 
-// Tree node structure for hierarchical view
+// Read-only view of bytes, usually inside the parser input. Not
+// NUL-terminated; print with "%.*s" and JSON_SLICE_ARGS().
+typedef struct {
+    const char* data;
+    size_t length;
+} JsonSlice;
+
+#define JSON_SLICE_ARGS(slice) (int)(slice).length, (slice).data
+
+// Binary value of a number. Integers that fit are kept exactly, as int64
+// or, above INT64_MAX, as uint64; fractions, exponents, larger integers
+// and -0 become the nearest double.
+typedef enum {
+    JSON_NUMBER_INT,
+    JSON_NUMBER_UINT,
+    JSON_NUMBER_DOUBLE
+} JsonNumberType;
+
+typedef struct {
+    JsonNumberType type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+    };
+} JsonNumber;
+
+// TreeNode flags
+#define TREE_NODE_ARENA         0x1u  // Allocated in a document arena
+#define TREE_NODE_ARENA_ROOT    0x2u  // Root that owns the arena of its tree
+#define TREE_NODE_NAME_ESCAPED  0x4u  // name contains backslash escapes
+#define TREE_NODE_VALUE_ESCAPED 0x8u  // value contains backslash escapes
+#define TREE_NODE_NAME_INTERNED 0x10u // name.data is shared by the same names
+
+// Tree node structure for hierarchical view. Trees returned by
+// json_parse_tree() live in a single arena owned by the root: destroying
+// the root frees the whole tree at once, and their structure is read-only
+// (tree_node_add_child() ignores arena nodes).
+//
+// name and value are raw JSON text exactly as it appears in the input:
+// keys and strings without their quotes and still escaped, numbers and
+// literals verbatim. In parsed trees they point into the parser input,
+// which must outlive the tree, and names are interned: members spelled
+// alike share the name.data of the first one, so two names flagged
+// TREE_NODE_NAME_INTERNED in a tree are equal exactly when their pointers
+// are. Documents with very many distinct names leave the rest uninterned,
+// and hand-built nodes are never interned. Only object members have a
+// name; array elements and the root have name.data == NULL. Containers
+// have no value. Numbers also carry their parsed value in `number`; the
+// text stays the lexeme, so output reproduces the input digits.
 typedef struct TreeNode {
-    char* name;
-    char* value;
+    JsonSlice name;
+    JsonSlice value;
+    JsonNumber number;                // JSON_NUMBER only
     JsonType type;
+    uint32_t flags;
     struct TreeNode** children;
     size_t children_count;
     size_t children_capacity;
     struct TreeNode* parent;
+    struct JsonKeyIndex* key_index;   // Built by json_object_get()
 } TreeNode;
 
+// Flat document built by json_parse_tape(), the alternative to a TreeNode
+// tree: every value in one array, in document order. A container's entry
+// is followed by its members or elements, each followed by its own
+// contents, and its `end` is the index just past all of them, so walks
+// over the tape are forward scans and a container is skipped by jumping
+// to `end`. For a scalar, `end` is the next index. name, value, number and
+// the TREE_NODE_*_ESCAPED flags are as in TreeNode, except that the text
+// is held as offsets from tape->text, so a tape holds no pointers and can
+// be saved and mapped back as it is. tape->text is the parser input, or a
+// copy the tape keeps for stream parsers. Use json_tape_slice() to read it.
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} JsonTapeText;
+
+typedef struct {
+    JsonTapeText name;                // Object members only
+    JsonTapeText value;               // Scalars only
+    JsonType type;
+    uint32_t flags;
+    size_t end;
+    union {
+        JsonNumber number;            // JSON_NUMBER
+        size_t count;                 // Containers: members or elements
+    };
+} JsonTapeEntry;
+
+typedef struct {
+    JsonTapeEntry* entries;           // The root is entries[0]
+    size_t count;
+    size_t capacity;
+    const char* text;                 // Base of the entry text
+    char* copy;                       // Streamed text, when text points here
+    size_t copy_size;
+    size_t copy_capacity;
+    void* mapping;                    // Cache file the entries are mapped from
+    size_t mapping_size;
+} JsonTape;
+
+static inline JsonSlice json_tape_slice(const JsonTape* tape, JsonTapeText text) {
+    return (JsonSlice){ tape->text + text.offset, (size_t)text.length };
+}
+
 // Token structure for syntax highlighting
 typedef struct {
     TokenType type;
@@ -67,6 +181,68 @@ typedef struct {
     } types;
 } JsonStats;
 
+// Per-path profile built by json_profile_add(). Paths are normalized:
+// members by key and all the elements of an array as one [*] path, so
+// the records of an array share their statistics. An object path keeps
+// at most JSON_PROFILE_MAX_KEYS member keys, later ones share a .* path,
+// and past JSON_PROFILE_MAX_PATHS paths new values all go to one overflow
+// path, so objects used as maps and irregular documents stay bounded.
+// Lengths are counted in power-of-two buckets (0, 1, 2-3, 4-7, ..., the
+// last one open-ended); string lengths are in bytes as written, escapes
+// included. A value's bytes run from its first to its last character.
+#define JSON_PROFILE_BUCKETS 16
+#define JSON_PROFILE_MAX_KEYS 256
+#define JSON_PROFILE_MAX_PATHS 16384
+
+typedef enum {
+    JSON_PATH_ROOT,                 // $
+    JSON_PATH_MEMBER,               // .key
+    JSON_PATH_ELEMENT,              // [*]
+    JSON_PATH_OTHER_MEMBERS,        // .*
+    JSON_PATH_OVERFLOW
+} JsonPathKind;
+
+typedef struct {
+    JsonPathKind kind;
+    JsonSlice key;                  // Raw key of a member
+    size_t parent;                  // SIZE_MAX for the root and overflow paths
+    size_t members;                 // Distinct keys below, at most JSON_PROFILE_MAX_KEYS
+    size_t count;                   // Values seen at this path
+    size_t types[JSON_OBJECT + 1];  // Values by JsonType
+    size_t string_lengths[JSON_PROFILE_BUCKETS];
+    double number_min;
+    double number_max;
+    double number_sum;
+    size_t array_lengths[JSON_PROFILE_BUCKETS];
+    size_t array_min;
+    size_t array_max;
+    size_t array_elements;          // Total over all arrays
+    size_t bytes;                   // Total over all values
+    size_t bytes_max;
+} JsonPathStats;
+
+typedef struct {
+    size_t path;                    // Path of the container
+    size_t element_path;            // Path of its elements, once seen
+    size_t member_path;             // Path of the value after the last key
+    size_t start;                   // Stream offset of the opening bracket
+    size_t length;                  // Values so far
+    bool is_array;
+} JsonProfileFrame;
+
+typedef struct {
+    JsonStats totals;
+    JsonPathStats* paths;           // In order of first appearance, root first
+    size_t path_count;
+    size_t path_capacity;
+    size_t* slots;                  // Hash index by parent and key
+    size_t slot_count;
+    struct JsonArena* keys;         // Copies of the keys
+    JsonProfileFrame* stack;        // Open containers while reading
+    size_t depth;
+    size_t stack_capacity;
+} JsonProfile;
+
 // Validation error structure
 typedef struct {
     char* message;
@@ -78,19 +254,202 @@ typedef struct {
 
 // Main parser context
 typedef struct {
-    char* input;
+    const char* input;
     size_t input_len;
     size_t pos;
-    size_t line;
-    size_t column;
     ValidationError* errors;
     size_t error_count;
     size_t error_capacity;
+    bool owns_input;
+    bool input_complete;              // False while more may be fed in
+    size_t input_capacity;            // Owned input only
+    FILE* source;                     // Refills the input, if set
+    size_t line_offset;               // Position of input[0] in the stream,
+    size_t column_offset;             // once consumed input is discarded
+    size_t input_offset;              // Bytes discarded before input[0]
+    JsonEngine engine;                // Used by json_parse_tree()
+    size_t workers;                   // Parallel engine threads, 0 for all CPUs
+    struct JsonArena* arena;          // Arena of the tree being built
+    struct JsonKeyTable* keys;        // Its member names, interned
+    struct TreeNode** node_stack;     // Children of the open containers
+    size_t node_stack_len;
+    size_t node_stack_capacity;
 } JsonParser;
 
+// Events produced by the pull reader, in document order
+typedef enum {
+    JSON_EVENT_START_OBJECT,
+    JSON_EVENT_END_OBJECT,
+    JSON_EVENT_START_ARRAY,
+    JSON_EVENT_END_ARRAY,
+    JSON_EVENT_KEY,
+    JSON_EVENT_STRING,
+    JSON_EVENT_NUMBER,
+    JSON_EVENT_BOOL,
+    JSON_EVENT_NULL,
+    JSON_EVENT_END,      // The root value is complete
+    JSON_EVENT_ERROR,    // Parse error, recorded in parser->errors
+    JSON_EVENT_NEED_MORE // Input ran out mid-document; feed more and call again
+} JsonEventType;
+
+// text holds keys and scalars as raw JSON text, like TreeNode name and
+// value. depth is the nesting level of the value (0 for the root; a key has
+// the depth of its value) and index its position in the parent container.
+// Number events also carry the parsed value.
+typedef struct {
+    JsonEventType type;
+    JsonSlice text;
+    JsonNumber number;
+    bool escaped;
+    size_t depth;
+    size_t index;
+} JsonEvent;
+
+typedef enum {
+    JSON_READER_VALUE,       // Expecting the root value or a member value
+    JSON_READER_CONTAINER,   // Expecting an element, a key or a closing bracket
+    JSON_READER_SKIP,        // Skipping to the end of the innermost container
+    JSON_READER_DONE,
+    JSON_READER_FAILED
+} JsonReaderState;
+
+typedef struct {
+    JsonType type;           // JSON_ARRAY or JSON_OBJECT
+    size_t count;            // Values read so far
+} JsonReaderFrame;
+
+// Pull parser over a JsonParser's input. It accepts exactly what
+// json_parse_tree() accepts and builds nothing: its only memory is one
+// frame per open container.
+typedef struct {
+    JsonParser* parser;
+    JsonReaderState state;
+    JsonReaderFrame* stack;
+    size_t depth;
+    size_t capacity;
+    size_t skip_depth;       // Brackets left to close while skipping
+    uint64_t skip_escaped;   // String state carried between skipped blocks
+    uint64_t skip_in_string;
+} JsonReader;
+
+typedef bool (*JsonEventHandler)(const JsonEvent* event, void* context);
+
+// One record of JSON Lines input: a non-blank line, without its newline
+typedef struct {
+    JsonSlice text;
+    size_t line;          // 1-based line number in the input
+    size_t index;         // 0-based position among the records
+    size_t worker;        // Thread running the handler, below the worker count
+} JsonLineRecord;
+
+typedef void (*JsonLineHandler)(const JsonLineRecord* record, FILE* out, void* context);
+
+// Input source loaded by json_input_open(): either a read-only file
+// mapping or a heap buffer filled from a pipe or other unseekable stream
+typedef struct {
+    const char* data;
+    size_t size;
+    bool mapped;
+    FILE* stream;     // Unread source left by json_input_open_stream()
+} JsonInput;
+
+// Output sink for the formatters. Writes to a file descriptor or FILE*
+// go through a fixed buffer of JSON_WRITER_BUFFER_SIZE bytes, so output
+// memory stays constant and output starts before formatting ends. Runs of
+// at least JSON_WRITER_DIRECT_SIZE bytes that do not fit are not copied: on
+// a descriptor they are sent straight from where they are, together with
+// the buffered bytes, by one writev(). A memory writer grows instead and hands over its
+// contents as a string. All writes take explicit lengths; indentation is
+// copied in bulk from a constant run of spaces.
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+    int fd;           // -1 unless writing to a descriptor
+    FILE* stream;     // Set when writing through stdio
+    bool grows;       // Memory writer
+    bool failed;      // A write failed; later writes are dropped
+} JsonWriter;
+
+// Value index, collected by a JsonIndexBuilder and saved as a file that
+// json_index_open() maps without parsing. Paths are "$" followed by
+// ".key" for members and ".N" for array elements.
+#define JSON_INDEX_MAGIC "JCINDEX2"
+#define JSON_INDEX_DOCUMENT SIZE_MAX    // json_index_add() record of a whole document
+
+typedef struct JsonIndexBuilder JsonIndexBuilder;
+typedef struct JsonQuery JsonQuery;
+
+// Identity of an input file, to tell a stale index or parse cache
+typedef struct {
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} JsonIndexSource;
+
+// Index file header; offsets are in bytes from the start of the file
+typedef struct {
+    char magic[8];
+    JsonIndexSource source;
+    uint64_t bucket_count;
+    uint64_t value_count;
+    uint64_t posting_count;
+    uint64_t key_count;
+    uint64_t buckets_offset;
+    uint64_t values_offset;
+    uint64_t postings_offset;
+    uint64_t keys_offset;
+    uint64_t paths_offset;
+    uint64_t paths_size;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+} JsonIndexHeader;
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    const JsonIndexHeader* header;
+} JsonIndex;
+
+// One occurrence of a looked up value. `path` is only valid during the call.
+typedef struct {
+    JsonType type;
+    JsonSlice value;
+    uint64_t offset;      // Of the value in the input; strings start at the quote
+    const char* path;
+} JsonIndexMatch;
+
+typedef bool (*JsonIndexHandler)(const JsonIndexMatch* match, void* context);
+
+// Parse cache file written by json_tape_save(): this header, then the
+// entries of a tape exactly as they are in memory. They refer to the text
+// of the input by offset, so the file holds no text of its own.
+#define JSON_TAPE_MAGIC "JCTAPE01"
+
+typedef struct {
+    char magic[8];
+    uint64_t entry_size;              // sizeof(JsonTapeEntry) of the writer
+    JsonIndexSource source;
+    uint64_t input_hash;
+    uint64_t count;
+    uint64_t entries_offset;
+} JsonTapeHeader;
+
 // Core parsing functions
 JsonParser* json_parser_create(const char* input, size_t len);
+JsonParser* json_parser_create_borrowed(const char* input, size_t len);
 void json_parser_destroy(JsonParser* parser);
+
+// Incremental input. A stream parser starts empty and takes the document
+// in chunks, either pushed with json_parser_feed() or pulled from `source`
+// by the reader as it runs out. Consumed input is dropped on each feed, so
+// memory is bounded by the chunk size plus the longest token. Event text
+// is only valid until the next feed (with a source, until the next event),
+// and the input can be read only once.
+JsonParser* json_parser_create_stream(FILE* source);
+bool json_parser_feed(JsonParser* parser, const char* data, size_t len);
+void json_parser_finish(JsonParser* parser);
+bool json_parser_fill(JsonParser* parser);
 TreeNode* json_parse_tree(JsonParser* parser);
 char* json_format(JsonParser* parser, size_t indent);
 char* json_compact(JsonParser* parser);
@@ -98,14 +457,203 @@ Token* json_tokenize(JsonParser* parser, size_t* token_count);
 JsonStats json_stats(JsonParser* parser);
 bool json_validate(JsonParser* parser);
 
+// Profiling. json_profile_add() reads one document from the event stream,
+// without a tree, and adds it to the totals and path statistics; it fails
+// on a parse error, leaving them partial. json_profile_merge() adds up
+// profiles gathered separately, such as one per thread.
+bool json_profile_init(JsonProfile* profile);
+bool json_profile_add(JsonProfile* profile, JsonParser* parser);
+bool json_profile_merge(JsonProfile* dst, const JsonProfile* src);
+void json_profile_release(JsonProfile* profile);
+
+// Indexing. json_index_add() reads one document from the event stream and
+// records every scalar with its path and input offset; `offset` is where
+// the parser's input starts in the indexed file, and `record` the JSON
+// Lines record index that prefixes the paths, or JSON_INDEX_DOCUMENT.
+// Strings are indexed by their unescaped text. json_index_merge() adds
+// the contents of a builder gathered separately, such as one per thread.
+// json_index_write() replaces `path` atomically. json_index_count() is
+// the number of values recorded.
+JsonIndexBuilder* json_index_builder_create(void);
+void json_index_builder_destroy(JsonIndexBuilder* builder);
+bool json_index_add(JsonIndexBuilder* builder, JsonParser* parser, size_t offset, size_t record);
+bool json_index_merge(JsonIndexBuilder* dst, const JsonIndexBuilder* src);
+bool json_index_write(const JsonIndexBuilder* builder, const char* path, const JsonIndexSource* source);
+size_t json_index_count(const JsonIndexBuilder* builder);
+
+// Lookups. json_index_open() checks the header and section bounds;
+// json_index_lookup() calls `handler` for every occurrence of `value`, in
+// input order, until it returns false, and fails on a corrupt entry.
+bool json_index_open(JsonIndex* index, const char* path);
+void json_index_close(JsonIndex* index);
+bool json_index_lookup(const JsonIndex* index, JsonSlice value, JsonIndexHandler handler, void* context);
+
+// JSONPath queries: $ followed by .name, ['name'], [N], .* or [*] steps.
+// json_query_compile() returns NULL and points `error` at a message for a
+// malformed path. json_query_run() writes every value the query selects,
+// in document order, as compact JSON on a line of its own. Containers
+// that cannot hold a match are skipped with json_reader_skip(), so only
+// their brackets and strings are scanned and parse errors inside them go
+// unnoticed; the time taken follows the size of the selected data rather
+// than that of the document.
+JsonQuery* json_query_compile(const char* path, const char** error);
+void json_query_destroy(JsonQuery* query);
+bool json_query_run(const JsonQuery* query, JsonParser* parser, JsonWriter* writer, size_t* matches);
+
+// Formatting straight from the event stream, without a tree. The output is
+// that of json_write_tree() and json_compact_tree() for the same document,
+// and stops at the first error, which is left in the parser.
+// json_format() and json_compact() return the same text as a string.
+bool json_write_pretty(JsonParser* parser, size_t indent, JsonWriter* writer);
+bool json_minify(JsonParser* parser, JsonWriter* writer);
+
+// Binary formats. json_write_binary() converts the document from the
+// event stream, without a tree, and stops at the first error, which is
+// left in the parser. CBOR is written in one pass with indefinite-length
+// containers, so it works on stream parsers in constant memory.
+// MessagePack puts the size of a container before its contents: a first
+// pass counts them, keeping one size_t per container, so the parser must
+// hold the whole input. Strings are unescaped; numbers the parser kept
+// exact become integers and the others floats, 32-bit when that is exact.
+//
+// json_read_binary() decodes a sequence of items (an RFC 8742 CBOR
+// sequence, or MessagePack objects back to back) and writes each as
+// compact JSON on a line of its own, so one item reads back as a JSON
+// document and several as JSON Lines. Byte strings and MessagePack
+// extensions become base64url strings, CBOR tags are dropped, undefined
+// and non-finite floats become null, and integer map keys are quoted. On
+// failure, `error` describes the first problem and `offset` is its byte.
+bool json_write_binary(JsonParser* parser, JsonBinaryFormat format, JsonWriter* writer);
+bool json_read_binary(const char* data, size_t size, JsonBinaryFormat format, JsonWriter* writer,
+                      const char** error, size_t* offset);
+
+// Flattened documents: a "PATH: VALUE" line per scalar, in document order,
+// where the path is `root` followed by .name for members, ["name"] for
+// names that are not plain letters, digits, '_', '-' and '$', and [N] for
+// elements, and the value is the scalar as written. Empty containers are
+// written as {} or []. json_write_flat() reads the event stream and stops
+// at the first error, which is left in the parser.
+//
+// json_read_flat() rebuilds the document from such lines rooted at $, in
+// one pass that keeps only the containers on the current path open, and
+// writes it as compact JSON on one line. json_read_flat_stream() does the
+// same reading `source` a line at a time, so only the current line and the
+// open containers are held. Lines must come in document order, elements
+// numbered from [0] up. A member name that comes again where the path
+// cannot go on inside its last value is kept as a duplicate member, as the
+// parser accepts them; an element that comes again is an error. On failure, `error` describes the first problem and `line` is
+// its line number.
+//
+// json_path_name_is_plain() tells whether a member name goes in a path as
+// .name rather than ["name"], for other path printers to quote alike.
+bool json_write_flat(JsonParser* parser, const char* root, JsonWriter* writer);
+bool json_read_flat(const char* data, size_t size, JsonWriter* writer, const char** error, size_t* line);
+bool json_read_flat_stream(FILE* source, JsonWriter* writer, const char** error, size_t* line);
+bool json_path_name_is_plain(JsonSlice name);
+
+// Rendering from an already parsed tree, so one parse can feed every
+// output mode. json_tokenize() parses and then calls json_tokenize_tree().
+char* json_format_tree(const TreeNode* root, size_t indent);
+char* json_compact_tree(const TreeNode* root);
+bool json_write_tree(const TreeNode* root, size_t indent, JsonWriter* writer);
+Token* json_tokenize_tree(const TreeNode* root, size_t* token_count);
+JsonStats json_stats_tree(const TreeNode* root);
+
+// Tape documents. json_parse_tape() reads the whole document as events,
+// accepting what json_parse_tree() does, and returns NULL with the error
+// left in the parser. The rendering functions produce the same output as
+// their tree counterparts.
+JsonTape* json_parse_tape(JsonParser* parser);
+void json_tape_destroy(JsonTape* tape);
+bool json_write_tape(const JsonTape* tape, size_t indent, JsonWriter* writer);
+void json_print_tape(const JsonTape* tape, FILE* output);
+JsonStats json_stats_tape(const JsonTape* tape);
+
+// Parse cache. json_tape_save() writes a tape parsed from input[0..size),
+// the contents of the file identified by `source`, replacing `path`
+// atomically. json_tape_load() maps such a file back, without parsing: it
+// checks the header and the nesting of the entries, and hashes the whole
+// input to be sure it is the text the tape was parsed from. It returns
+// NULL for a missing or stale cache. The loaded tape's text is `input`,
+// which must outlive it.
+bool json_tape_save(const JsonTape* tape, const char* path, const char* input, size_t size,
+                    const JsonIndexSource* source);
+JsonTape* json_tape_load(const char* path, const char* input, size_t size, const JsonIndexSource* source);
+
+// Event parsing. json_reader_next() returns false once it has produced
+// JSON_EVENT_END or JSON_EVENT_ERROR, or JSON_EVENT_NEED_MORE when a
+// stream parser without a source needs json_parser_feed() or
+// json_parser_finish() before it can go on. json_parse_events() drives a
+// reader and stops early if the handler returns false.
+//
+// json_reader_skip() drops the rest of the innermost open container: the
+// next event is its end. Skipped input is only scanned for strings and
+// brackets, with no events and no checks beyond bracket balance, so it
+// goes at memory speed. It does nothing outside a container.
+void json_reader_init(JsonReader* reader, JsonParser* parser);
+bool json_reader_next(JsonReader* reader, JsonEvent* event);
+void json_reader_skip(JsonReader* reader);
+void json_reader_release(JsonReader* reader);
+bool json_parse_events(JsonParser* parser, JsonEventHandler handler, void* context);
+
+// JSON Lines. Runs `handler` on every record of data using `workers`
+// threads (0 for one per online CPU). What the handler writes to `out` is
+// copied to `output` in input order, or batch by batch as soon as each is
+// done when `ordered` is false. Per-thread state can be kept in the
+// context, indexed by record->worker.
+bool json_lines_process(const char* data, size_t size, size_t workers, bool ordered,
+                        JsonLineHandler handler, void* context, FILE* output);
+size_t json_lines_default_workers(void);
+
+// Output sinks. A FILE* writer flushes the stream and then bypasses it
+// when the stream has a descriptor. json_writer_finish() flushes and
+// releases the writer and reports whether everything was written;
+// json_writer_take() does the same for a memory writer and returns its
+// NUL-terminated contents, to be released with json_free().
+bool json_writer_init_fd(JsonWriter* writer, int fd);
+bool json_writer_init_file(JsonWriter* writer, FILE* stream);
+bool json_writer_init_memory(JsonWriter* writer);
+bool json_writer_write(JsonWriter* writer, const char* data, size_t len);
+bool json_writer_spaces(JsonWriter* writer, size_t count);
+bool json_writer_flush(JsonWriter* writer);
+bool json_writer_finish(JsonWriter* writer);
+char* json_writer_take(JsonWriter* writer);
+
 // Tree node operations
 TreeNode* tree_node_create(const char* name, const char* value, JsonType type);
 void tree_node_add_child(TreeNode* parent, TreeNode* child);
 void tree_node_destroy(TreeNode* node);
 
-// Utility functions
+// Member of `object` named key[0..len), unescaped, or NULL; the first one
+// if the key repeats. Objects with at least JSON_OBJECT_INDEX_MIN members
+// get a hash index of their keys on the first lookup, so later lookups
+// take constant time; smaller ones are scanned. The index is kept with the
+// tree and released with it, and is built safely when several threads
+// look up the same tree.
+TreeNode* json_object_get(const TreeNode* object, const char* key, size_t len);
+
+// Input loading ("-" reads standard input)
+bool json_input_open(JsonInput* input, const char* path);
+bool json_input_open_stream(JsonInput* input, const char* path);
+void json_input_close(JsonInput* input);
+
+// Numbers. json_number_parse() accepts exactly the RFC 8259 number
+// grammar and stores the value in `number` (which may be NULL to only
+// check the text).
+bool json_number_parse(JsonSlice text, JsonNumber* number);
+double json_number_double(JsonNumber number);
+
+// Utility functions. json_unescape_into() decodes the escapes of raw
+// string text into `out`, which needs text.length bytes, and returns the
+// decoded length: \u escapes become UTF-8, surrogate pairs combined, a
+// lone surrogate becomes U+FFFD and a malformed escape is kept as written.
+// json_unescape_slice() returns the same text NUL-terminated; it may hold
+// NULs of its own, from \u0000.
 char* json_escape_string(const char* str);
 char* json_unescape_string(const char* str);
+char* json_unescape_slice(JsonSlice slice);
+size_t json_unescape_into(JsonSlice text, char* out);
+char* json_slice_dup(JsonSlice slice);
 void json_free(void* ptr);
 
 // Add the function declaration
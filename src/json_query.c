@@ -0,0 +1,245 @@
+#include "json_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+// JSONPath queries over the event stream. A query is a chain of child
+// steps, so the values it can reach at depth d are all reached through
+// containers that matched the first d steps. Every other container is
+// handed to json_reader_skip() as soon as it opens, and an array whose
+// step is an index is dropped right after that element. Only the matches
+// are read event by event, and written out as compact JSON.
+
+typedef enum {
+    QUERY_MEMBER,        // .name or ['name']
+    QUERY_INDEX,         // [N]
+    QUERY_ANY            // .* or [*]
+} QueryStepKind;
+
+typedef struct {
+    QueryStepKind kind;
+    char* name;
+    size_t length;
+    size_t index;
+} QueryStep;
+
+struct JsonQuery {
+    QueryStep* steps;
+    size_t count;
+    size_t capacity;
+};
+
+static bool add_step(JsonQuery* query, QueryStepKind kind, const char* name, size_t length, size_t index) {
+    if (query->count >= query->capacity) {
+        size_t new_capacity = query->capacity == 0 ? JSON_INITIAL_CAPACITY : query->capacity * 2;
+        QueryStep* new_steps = realloc(query->steps, new_capacity * sizeof(QueryStep));
+        if (!new_steps) return false;
+        query->steps = new_steps;
+        query->capacity = new_capacity;
+    }
+    
+    QueryStep* step = &query->steps[query->count];
+    step->kind = kind;
+    step->name = NULL;
+    step->length = length;
+    step->index = index;
+    if (kind == QUERY_MEMBER) {
+        step->name = malloc(length + 1);
+        if (!step->name) return false;
+        memcpy(step->name, name, length);
+        step->name[length] = '\0';
+    }
+    query->count++;
+    return true;
+}
+
+// Quoted name in brackets, starting at the quote. Backslash escapes the
+// next character. Returns the length consumed, or 0 if unterminated.
+static size_t parse_quoted(const char* p, char* name, size_t* length) {
+    char quote = p[0];
+    size_t i = 1;
+    *length = 0;
+    while (p[i] != quote) {
+        if (p[i] == '\0') return 0;
+        if (p[i] == '\\' && p[i + 1] != '\0') i++;
+        name[(*length)++] = p[i++];
+    }
+    return i + 1;
+}
+
+// Grammar: $ followed by .name, .*, [N], [*], ['name'] or ["name"] steps
+static bool parse_steps(JsonQuery* query, const char* path, const char** error) {
+    size_t path_length = strlen(path);
+    char* name = malloc(path_length + 1);
+    if (!name) {
+        *error = "Out of memory";
+        return false;
+    }
+    
+    bool ok = path[0] == '$';
+    if (!ok) *error = "A query starts with $";
+    
+    const char* p = path + 1;
+    while (ok && *p) {
+        if (p[0] == '.' && p[1] == '.') {
+            *error = "Recursive descent (..) is not supported";
+            ok = false;
+            break;
+        } else if (p[0] == '.' && p[1] == '*') {
+            ok = add_step(query, QUERY_ANY, NULL, 0, 0);
+            p += 2;
+        } else if (p[0] == '.') {
+            size_t length = strcspn(p + 1, ".[");
+            if (length == 0) {
+                *error = "Expected a member name after '.'";
+                ok = false;
+                break;
+            }
+            ok = add_step(query, QUERY_MEMBER, p + 1, length, 0);
+            p += 1 + length;
+        } else if (p[0] == '[' && p[1] == '*' && p[2] == ']') {
+            ok = add_step(query, QUERY_ANY, NULL, 0, 0);
+            p += 3;
+        } else if (p[0] == '[' && (p[1] == '\'' || p[1] == '"')) {
+            size_t length;
+            size_t consumed = parse_quoted(p + 1, name, &length);
+            if (consumed == 0 || p[1 + consumed] != ']') {
+                *error = "Unterminated member name";
+                ok = false;
+                break;
+            }
+            ok = add_step(query, QUERY_MEMBER, name, length, 0);
+            p += consumed + 2;
+        } else if (p[0] == '[' && p[1] >= '0' && p[1] <= '9') {
+            char* end;
+            unsigned long long index = strtoull(p + 1, &end, 10);
+            if (*end != ']') {
+                *error = "Expected ']' after an index";
+                ok = false;
+                break;
+            }
+            ok = add_step(query, QUERY_INDEX, NULL, 0, (size_t)index);
+            p = end + 1;
+        } else {
+            *error = "Expected .name, .*, [N], [*] or ['name']";
+            ok = false;
+            break;
+        }
+        if (!ok && !*error) *error = "Out of memory";
+    }
+    
+    free(name);
+    return ok;
+}
+
+JsonQuery* json_query_compile(const char* path, const char** error) {
+    const char* message = NULL;
+    JsonQuery* query = path ? calloc(1, sizeof(JsonQuery)) : NULL;
+    if (!query) {
+        message = path ? "Out of memory" : "No query";
+    } else if (!parse_steps(query, path, &message)) {
+        json_query_destroy(query);
+        query = NULL;
+    }
+    
+    if (error) *error = message;
+    return query;
+}
+
+void json_query_destroy(JsonQuery* query) {
+    if (!query) return;
+    
+    for (size_t i = 0; i < query->count; i++) {
+        free(query->steps[i].name);
+    }
+    free(query->steps);
+    free(query);
+}
+
+static bool key_matches(const QueryStep* step, const JsonEvent* event) {
+    if (step->kind == QUERY_ANY) return true;
+    if (step->kind != QUERY_MEMBER) return false;
+    if (!event->escaped) {
+        return event->text.length == step->length && memcmp(event->text.data, step->name, step->length) == 0;
+    }
+    
+    // Decoded with its length: \u0000 may put a NUL inside the key
+    char* key = malloc(event->text.length + 1);
+    bool matches = key && json_unescape_into(event->text, key) == step->length &&
+                   memcmp(key, step->name, step->length) == 0;
+    free(key);
+    return matches;
+}
+
+// Whether the children of a container opened by `event` can match `step`
+static bool children_can_match(const QueryStep* step, const JsonEvent* event) {
+    switch (step->kind) {
+        case QUERY_MEMBER:
+            return event->type == JSON_EVENT_START_OBJECT;
+        case QUERY_INDEX:
+            return event->type == JSON_EVENT_START_ARRAY;
+        case QUERY_ANY:
+            break;
+    }
+    return true;
+}
+
+bool json_query_run(const JsonQuery* query, JsonParser* parser, JsonWriter* writer, size_t* matches) {
+    if (matches) *matches = 0;
+    if (!query || !parser || !writer) return false;
+    
+    JsonReader reader;
+    JsonEvent event;
+    bool member_matches = false;    // Key of the member being read
+    bool has_key = false;
+    bool writing = false;           // Inside a matched container
+    bool after_key = false;
+    size_t count = 0;
+    
+    json_reader_init(&reader, parser);
+    while (json_reader_next(&reader, &event)) {
+        bool is_end = event.type == JSON_EVENT_END_OBJECT || event.type == JSON_EVENT_END_ARRAY;
+        if (writing) {
+            json_minify_event(writer, &event, &after_key);
+            if (!is_end || event.depth != query->count) continue;
+            json_writer_put(writer, "\n", 1);
+            writing = false;
+        } else if (event.type == JSON_EVENT_KEY) {
+            member_matches = key_matches(&query->steps[event.depth - 1], &event);
+            has_key = true;
+            continue;
+        }
+        
+        // A value at depth d > 0 is the child that step d - 1 selects or not
+        size_t depth = event.depth;
+        const QueryStep* step = depth > 0 ? &query->steps[depth - 1] : NULL;
+        if (!is_end) {
+            bool selected = !step || (has_key ? member_matches : step->kind == QUERY_ANY ||
+                                      (step->kind == QUERY_INDEX && step->index == event.index));
+            bool opens = event.type == JSON_EVENT_START_OBJECT || event.type == JSON_EVENT_START_ARRAY;
+            has_key = false;
+            
+            if (selected && depth == query->count) {
+                JsonEvent first = event;
+                first.index = 0;
+                after_key = false;
+                json_minify_event(writer, &first, &after_key);
+                count++;
+                if (opens) {
+                    writing = true;
+                    continue;
+                }
+                json_writer_put(writer, "\n", 1);
+            } else if (opens) {
+                if (!selected || !children_can_match(&query->steps[depth], &event)) json_reader_skip(&reader);
+                continue;
+            }
+        }
+        
+        // Past the element an index selects, the rest of its array can go
+        if (step && step->kind == QUERY_INDEX && event.index >= step->index) json_reader_skip(&reader);
+    }
+    json_reader_release(&reader);
+    
+    if (matches) *matches = count;
+    return event.type == JSON_EVENT_END && !writer->failed;
+}
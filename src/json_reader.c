@@ -0,0 +1,357 @@
+#include "json_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// Pull parser. It follows the recursive descent grammar of json_parser.c
+// step by step, keeping on an explicit stack what parse_array() and
+// parse_object() keep in their C frames, so that the two accept the same
+// documents and fail with the same error at the same position.
+//
+// Each event is read as a unit. If the input of a stream parser runs out
+// before the event is complete, the reader rewinds to where the event
+// started and asks for more input, so no token is ever split.
+
+void json_reader_init(JsonReader* reader, JsonParser* parser) {
+    parser->pos = 0;
+    parser->error_count = 0;
+    
+    reader->parser = parser;
+    reader->state = JSON_READER_VALUE;
+    reader->stack = NULL;
+    reader->depth = 0;
+    reader->capacity = 0;
+    reader->skip_depth = 0;
+    reader->skip_escaped = 0;
+    reader->skip_in_string = 0;
+}
+
+void json_reader_release(JsonReader* reader) {
+    free(reader->stack);
+    reader->stack = NULL;
+    reader->depth = 0;
+    reader->capacity = 0;
+}
+
+// Records `message` (unless the error was already reported) and stops the reader
+static bool reader_fail(JsonReader* reader, JsonEvent* event, const char* message) {
+    if (message) json_parser_error(reader->parser, message);
+    reader->state = JSON_READER_FAILED;
+    event->type = JSON_EVENT_ERROR;
+    return false;
+}
+
+// The input ended inside the current event. A stream parser may still get
+// the rest; otherwise this is the reference parser's error.
+static bool reader_truncated(JsonReader* reader, JsonEvent* event, size_t start, const char* message) {
+    JsonParser* parser = reader->parser;
+    if (parser->input_complete) return reader_fail(reader, event, message);
+    
+    parser->pos = start;
+    event->type = JSON_EVENT_NEED_MORE;
+    return false;
+}
+
+static bool reader_push(JsonReader* reader, JsonType type) {
+    if (reader->depth >= reader->capacity) {
+        size_t new_capacity = reader->capacity == 0 ? JSON_INITIAL_CAPACITY : reader->capacity * 2;
+        JsonReaderFrame* new_stack = realloc(reader->stack, new_capacity * sizeof(JsonReaderFrame));
+        if (!new_stack) return false;
+        
+        reader->stack = new_stack;
+        reader->capacity = new_capacity;
+    }
+    
+    reader->stack[reader->depth].type = type;
+    reader->stack[reader->depth].count = 0;
+    reader->depth++;
+    reader->state = JSON_READER_CONTAINER;
+    return true;
+}
+
+// Called once a complete value (scalar or closed container) has been read
+static void reader_value_done(JsonReader* reader) {
+    if (reader->depth == 0) {
+        reader->state = JSON_READER_DONE;
+    } else {
+        reader->stack[reader->depth - 1].count++;
+        reader->state = JSON_READER_CONTAINER;
+    }
+}
+
+// Reads the string whose opening quote is at parser->pos
+static bool read_string(JsonReader* reader, JsonEvent* event, size_t start) {
+    JsonParser* parser = reader->parser;
+    size_t body = parser->pos + 1;
+    size_t len = json_scan_string_body(&parser->input[body], parser->input_len - body, &event->escaped);
+    
+    if (body + len >= parser->input_len) {
+        parser->pos = parser->input_len;
+        return reader_truncated(reader, event, start, "Unterminated string");
+    }
+    
+    event->text = (JsonSlice){ &parser->input[body], len };
+    parser->pos = body + len + 1;
+    return true;
+}
+
+static bool read_literal(JsonReader* reader, JsonEvent* event, size_t start,
+                         const char* literal, size_t len, const char* message) {
+    JsonParser* parser = reader->parser;
+    size_t available = parser->input_len - parser->pos;
+    
+    if (available < len && !parser->input_complete) {
+        return reader_truncated(reader, event, start, message);
+    }
+    if (available < len || memcmp(&parser->input[parser->pos], literal, len) != 0) {
+        return reader_fail(reader, event, message);
+    }
+    
+    event->text = (JsonSlice){ &parser->input[parser->pos], len };
+    parser->pos += len;
+    return true;
+}
+
+static bool read_value(JsonReader* reader, JsonEvent* event, size_t start) {
+    JsonParser* parser = reader->parser;
+    json_skip_whitespace(parser);
+    
+    if (parser->pos >= parser->input_len) {
+        return reader_truncated(reader, event, start, "Unexpected end of input");
+    }
+    
+    event->depth = reader->depth;
+    event->index = reader->depth > 0 ? reader->stack[reader->depth - 1].count : 0;
+    
+    char c = parser->input[parser->pos];
+    switch (c) {
+        case '"':
+            if (!read_string(reader, event, start)) return false;
+            event->type = JSON_EVENT_STRING;
+            break;
+        case '{':
+        case '[':
+            parser->pos++;
+            if (!reader_push(reader, c == '{' ? JSON_OBJECT : JSON_ARRAY)) {
+                return reader_fail(reader, event, NULL);
+            }
+            event->type = c == '{' ? JSON_EVENT_START_OBJECT : JSON_EVENT_START_ARRAY;
+            return true;
+        case 't':
+            if (!read_literal(reader, event, start, "true", 4, "Invalid true value")) return false;
+            event->type = JSON_EVENT_BOOL;
+            break;
+        case 'f':
+            if (!read_literal(reader, event, start, "false", 5, "Invalid false value")) return false;
+            event->type = JSON_EVENT_BOOL;
+            break;
+        case 'n':
+            if (!read_literal(reader, event, start, "null", 4, "Invalid null value")) return false;
+            event->type = JSON_EVENT_NULL;
+            break;
+        default:
+            if (c != '-' && !isdigit(c)) return reader_fail(reader, event, "Invalid value");
+            
+            event->text.data = &parser->input[parser->pos];
+            event->text.length = json_scan_number(event->text.data, parser->input_len - parser->pos);
+            
+            // A number that reaches the end of the input may continue
+            if (parser->pos + event->text.length == parser->input_len && !parser->input_complete) {
+                return reader_truncated(reader, event, start, NULL);
+            }
+            if (!json_number_parse(event->text, &event->number)) {
+                return reader_fail(reader, event, "Invalid number");
+            }
+            parser->pos += event->text.length;
+            event->type = JSON_EVENT_NUMBER;
+            break;
+    }
+    
+    reader_value_done(reader);
+    return true;
+}
+
+// Closes the innermost container, whose closing bracket is at parser->pos
+static bool close_container(JsonReader* reader, JsonEvent* event) {
+    JsonParser* parser = reader->parser;
+    bool is_array = reader->stack[reader->depth - 1].type == JSON_ARRAY;
+    
+    parser->pos++;
+    reader->depth--;
+    event->type = is_array ? JSON_EVENT_END_ARRAY : JSON_EVENT_END_OBJECT;
+    event->depth = reader->depth;
+    event->index = reader->depth > 0 ? reader->stack[reader->depth - 1].count : 0;
+    reader_value_done(reader);
+    return true;
+}
+
+// Scans past the rest of the innermost container 64 bytes at a time, as
+// the parallel engine does: brackets inside strings are masked off and the
+// others counted, and only a block where the count can reach zero is
+// walked bracket by bracket. A stream parser is fed until the container
+// ends. It asks for more input only from the end of a block outside any
+// string, as the consumed input is then dropped on the assumption that it
+// ends between tokens; the bracket count there is kept in the reader.
+static bool skip_container(JsonReader* reader, JsonEvent* event) {
+    JsonParser* parser = reader->parser;
+    size_t pos = parser->pos;
+    size_t resume = pos;
+    size_t resume_depth = reader->skip_depth;
+    
+    while (pos < parser->input_len) {
+        size_t available = parser->input_len - pos;
+        if (available < JSON_BLOCK_SIZE && !parser->input_complete) break;
+        
+        // The last block of the input is padded with whitespace
+        JsonBlockMasks m;
+        if (available >= JSON_BLOCK_SIZE) {
+            json_classify_block(parser->input + pos, &m);
+        } else {
+            char tail[JSON_BLOCK_SIZE];
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, parser->input + pos, available);
+            json_classify_block(tail, &m);
+        }
+        
+        uint64_t escaped = json_escaped_mask(m.backslash, &reader->skip_escaped);
+        uint64_t in_string = json_string_mask(m.quote & ~escaped, &reader->skip_in_string);
+        uint64_t open = m.open & ~in_string;
+        uint64_t close = m.close & ~in_string;
+        
+        size_t closes = (size_t)__builtin_popcountll(close);
+        if (closes < reader->skip_depth) {
+            reader->skip_depth += (size_t)__builtin_popcountll(open) - closes;
+            pos += JSON_BLOCK_SIZE;
+            if (!reader->skip_in_string && !reader->skip_escaped) {
+                resume = pos;
+                resume_depth = reader->skip_depth;
+            }
+            continue;
+        }
+        
+        for (uint64_t brackets = open | close; brackets; brackets &= brackets - 1) {
+            if (open & brackets & -brackets) {
+                reader->skip_depth++;
+            } else if (--reader->skip_depth == 0) {
+                parser->pos = pos + (size_t)__builtin_ctzll(brackets);
+                bool is_array = reader->stack[reader->depth - 1].type == JSON_ARRAY;
+                if (parser->input[parser->pos] != (is_array ? ']' : '}')) {
+                    return reader_fail(reader, event, "Mismatched bracket");
+                }
+                return close_container(reader, event);
+            }
+        }
+        pos += JSON_BLOCK_SIZE;
+        if (!reader->skip_in_string && !reader->skip_escaped) {
+            resume = pos;
+            resume_depth = reader->skip_depth;
+        }
+    }
+    
+    bool is_array = reader->stack[reader->depth - 1].type == JSON_ARRAY;
+    if (!parser->input_complete) {
+        // Blocks after `resume` are scanned again with more input
+        pos = resume;
+        reader->skip_depth = resume_depth;
+        reader->skip_escaped = 0;
+        reader->skip_in_string = 0;
+    }
+    parser->pos = pos < parser->input_len ? pos : parser->input_len;
+    return reader_truncated(reader, event, parser->pos, is_array ? "Unterminated array" : "Unterminated object");
+}
+
+static bool reader_step(JsonReader* reader, JsonEvent* event) {
+    JsonParser* parser = reader->parser;
+    size_t start = parser->pos;
+    event->text = (JsonSlice){ NULL, 0 };
+    event->escaped = false;
+    event->depth = reader->depth;
+    event->index = 0;
+    
+    switch (reader->state) {
+        case JSON_READER_VALUE:
+            return read_value(reader, event, start);
+            
+        case JSON_READER_DONE:
+            event->type = JSON_EVENT_END;
+            return false;
+            
+        case JSON_READER_FAILED:
+            event->type = JSON_EVENT_ERROR;
+            return false;
+            
+        case JSON_READER_SKIP:
+            return skip_container(reader, event);
+            
+        case JSON_READER_CONTAINER:
+            break;
+    }
+    
+    JsonReaderFrame* frame = &reader->stack[reader->depth - 1];
+    bool is_array = frame->type == JSON_ARRAY;
+    
+    // Separators are optional, as in parse_array() and parse_object()
+    json_skip_whitespace(parser);
+    if (frame->count > 0 && parser->pos < parser->input_len && parser->input[parser->pos] == ',') {
+        parser->pos++;
+        json_skip_whitespace(parser);
+    }
+    
+    if (parser->pos >= parser->input_len) {
+        return reader_truncated(reader, event, start, is_array ? "Unterminated array" : "Unterminated object");
+    }
+    
+    if (parser->input[parser->pos] == (is_array ? ']' : '}')) return close_container(reader, event);
+    
+    if (is_array) return read_value(reader, event, start);
+    
+    if (parser->input[parser->pos] != '"') return reader_fail(reader, event, "Expected string");
+    if (!read_string(reader, event, start)) return false;
+    
+    json_skip_whitespace(parser);
+    if (parser->pos >= parser->input_len) return reader_truncated(reader, event, start, "Expected ':'");
+    if (parser->input[parser->pos] != ':') return reader_fail(reader, event, "Expected ':'");
+    parser->pos++; // Skip :
+    
+    event->type = JSON_EVENT_KEY;
+    event->index = frame->count;
+    reader->state = JSON_READER_VALUE;
+    return true;
+}
+
+bool json_reader_next(JsonReader* reader, JsonEvent* event) {
+    for (;;) {
+        if (reader_step(reader, event)) return true;
+        
+        // Pull the next chunk ourselves if the parser has a source
+        JsonParser* parser = reader->parser;
+        if (event->type != JSON_EVENT_NEED_MORE || !parser->source) return false;
+        if (!json_parser_fill(parser)) return reader_fail(reader, event, "Cannot read input");
+    }
+}
+
+void json_reader_skip(JsonReader* reader) {
+    if (reader->depth == 0) return;
+    if (reader->state != JSON_READER_CONTAINER && reader->state != JSON_READER_VALUE) return;
+    
+    reader->state = JSON_READER_SKIP;
+    reader->skip_depth = 1;
+    reader->skip_escaped = 0;
+    reader->skip_in_string = 0;
+}
+
+bool json_parse_events(JsonParser* parser, JsonEventHandler handler, void* context) {
+    if (!parser || !handler) return false;
+    
+    JsonReader reader;
+    JsonEvent event;
+    bool ok = true;
+    
+    json_reader_init(&reader, parser);
+    while (ok && json_reader_next(&reader, &event)) {
+        ok = handler(&event, context);
+    }
+    json_reader_release(&reader);
+    
+    return ok && event.type == JSON_EVENT_END;
+}
@@ -1,10 +1,13 @@
-#include "json_parser.h"
+#include "json_internal.h"
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define NO_PATH SIZE_MAX
 
-static void collect_stats(TreeNode* node, JsonStats* stats, size_t depth) {
+static void collect_stats(const TreeNode* node, JsonStats* stats, size_t depth) {
     if (!node || !stats) return;
     
     // Update depth
@@ -35,8 +38,8 @@ static void collect_stats(TreeNode* node, JsonStats* stats, size_t depth) {
     // Count total values
     stats->total_values++;
     
-    // Count keys (only for named nodes)
-    if (node->name) {
+    // Count keys (every member and array element below the root)
+    if (depth > 0) {
         stats->total_keys++;
     }
     
@@ -46,38 +49,422 @@ static void collect_stats(TreeNode* node, JsonStats* stats, size_t depth) {
     }
 }
 
-JsonStats json_stats(JsonParser* parser) {
+JsonStats json_stats_tree(const TreeNode* root) {
     JsonStats stats = {0}; // Initialize all fields to 0
     
-    if (!parser) return stats;
-    
-    TreeNode* root = json_parse_tree(parser);
     if (!root) return stats;
     
     collect_stats(root, &stats, 0);
-    tree_node_destroy(root);
+    return stats;
+}
+
+// collect_stats() over a tape: one pass in order, with the ends of the
+// open containers on a stack to tell the depth
+JsonStats json_stats_tape(const JsonTape* tape) {
+    JsonStats stats = {0};
+    if (!tape) return stats;
+    
+    size_t* ends = NULL;
+    size_t depth = 0;
+    size_t capacity = 0;
+    for (size_t i = 0; i < tape->count; i++) {
+        const JsonTapeEntry* entry = &tape->entries[i];
+        while (depth > 0 && ends[depth - 1] == i) depth--;
+        
+        stats.depth = MAX(stats.depth, depth);
+        switch (entry->type) {
+            case JSON_STRING:
+                stats.types.string_count++;
+                break;
+            case JSON_NUMBER:
+                stats.types.number_count++;
+                break;
+            case JSON_BOOL:
+                stats.types.bool_count++;
+                break;
+            case JSON_NULL:
+                stats.types.null_count++;
+                break;
+            case JSON_ARRAY:
+                stats.types.array_count++;
+                break;
+            case JSON_OBJECT:
+                stats.types.object_count++;
+                break;
+        }
+        stats.total_values++;
+        if (depth > 0) stats.total_keys++;
+        
+        // Empty containers have no entries to pop them
+        if ((entry->type == JSON_ARRAY || entry->type == JSON_OBJECT) && entry->end > i + 1) {
+            if (depth >= capacity) {
+                size_t new_capacity = capacity == 0 ? JSON_INITIAL_CAPACITY : capacity * 2;
+                size_t* new_ends = realloc(ends, new_capacity * sizeof(size_t));
+                if (!new_ends) break;
+                ends = new_ends;
+                capacity = new_capacity;
+            }
+            ends[depth++] = entry->end;
+        }
+    }
     
+    free(ends);
     return stats;
 }
 
-bool json_validate(JsonParser* parser) {
-    if (!parser) return false;
+// Counts one value the way collect_stats() does for a tree node
+static void count_event(const JsonEvent* event, JsonStats* stats) {
+    switch (event->type) {
+        case JSON_EVENT_STRING:
+            stats->types.string_count++;
+            break;
+        case JSON_EVENT_NUMBER:
+            stats->types.number_count++;
+            break;
+        case JSON_EVENT_BOOL:
+            stats->types.bool_count++;
+            break;
+        case JSON_EVENT_NULL:
+            stats->types.null_count++;
+            break;
+        case JSON_EVENT_START_ARRAY:
+            stats->types.array_count++;
+            break;
+        case JSON_EVENT_START_OBJECT:
+            stats->types.object_count++;
+            break;
+        default:
+            // Keys and closing events are not values
+            return;
+    }
     
-    // Reset parser state
-    parser->pos = 0;
-    parser->line = 1;
-    parser->column = 0;
-    parser->error_count = 0;
+    stats->depth = MAX(stats->depth, event->depth);
+    stats->total_values++;
+    if (event->depth > 0) {
+        stats->total_keys++;
+    }
+}
+
+// Computed from the event stream without building a tree. On a parse
+// error, parser->error_count is non-zero and the counts are partial.
+JsonStats json_stats(JsonParser* parser) {
+    JsonStats stats = {0};
     
-    // Try to parse the tree
-    TreeNode* root = json_parse_tree(parser);
-    bool is_valid = (root != NULL && parser->error_count == 0);
+    if (!parser) return stats;
     
-    if (root) {
-        tree_node_destroy(root);
+    JsonReader reader;
+    JsonEvent event;
+    json_reader_init(&reader, parser);
+    while (json_reader_next(&reader, &event)) {
+        count_event(&event, &stats);
     }
+    json_reader_release(&reader);
     
-    return is_valid;
+    return stats;
+}
+
+bool json_profile_init(JsonProfile* profile) {
+    memset(profile, 0, sizeof(*profile));
+    profile->keys = malloc(sizeof(JsonArena));
+    profile->slot_count = JSON_INITIAL_CAPACITY;
+    profile->slots = malloc(profile->slot_count * sizeof(size_t));
+    if (!profile->keys || !profile->slots) {
+        free(profile->keys);
+        free(profile->slots);
+        return false;
+    }
+    
+    json_arena_init(profile->keys);
+    memset(profile->slots, 0xff, profile->slot_count * sizeof(size_t));
+    return true;
+}
+
+void json_profile_release(JsonProfile* profile) {
+    if (!profile) return;
+    
+    if (profile->keys) json_arena_release(profile->keys);
+    free(profile->keys);
+    free(profile->slots);
+    free(profile->paths);
+    free(profile->stack);
+    memset(profile, 0, sizeof(*profile));
+}
+
+static size_t path_hash(size_t parent, JsonSlice key, JsonPathKind kind) {
+    uint64_t hash = 14695981039346656037ull ^ (parent * 8 + kind);
+    hash *= 1099511628211ull;
+    for (size_t i = 0; i < key.length; i++) {
+        hash ^= (unsigned char)key.data[i];
+        hash *= 1099511628211ull;
+    }
+    return (size_t)(hash ^ (hash >> 32));
+}
+
+static bool path_matches(const JsonPathStats* path, size_t parent, JsonSlice key, JsonPathKind kind) {
+    return path->parent == parent && path->kind == kind && path->key.length == key.length &&
+           (key.length == 0 || memcmp(path->key.data, key.data, key.length) == 0);
+}
+
+// Doubles the hash index and reinserts every path
+static bool grow_slots(JsonProfile* profile) {
+    size_t slot_count = profile->slot_count * 2;
+    size_t* slots = malloc(slot_count * sizeof(size_t));
+    if (!slots) return false;
+    
+    memset(slots, 0xff, slot_count * sizeof(size_t));
+    for (size_t i = 0; i < profile->path_count; i++) {
+        const JsonPathStats* path = &profile->paths[i];
+        size_t slot = path_hash(path->parent, path->key, path->kind) & (slot_count - 1);
+        while (slots[slot] != NO_PATH) slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = i;
+    }
+    
+    free(profile->slots);
+    profile->slots = slots;
+    profile->slot_count = slot_count;
+    return true;
+}
+
+// Index of the path of `kind` below `parent` (NO_PATH for the root and
+// overflow paths), created on first use unless a limit folds it into
+// another path
+static size_t profile_path(JsonProfile* profile, size_t parent, JsonSlice key, JsonPathKind kind) {
+    if (parent != NO_PATH && profile->paths[parent].kind == JSON_PATH_OVERFLOW) return parent;
+    
+    size_t mask = profile->slot_count - 1;
+    size_t slot = path_hash(parent, key, kind) & mask;
+    while (profile->slots[slot] != NO_PATH) {
+        size_t index = profile->slots[slot];
+        if (path_matches(&profile->paths[index], parent, key, kind)) return index;
+        slot = (slot + 1) & mask;
+    }
+    
+    if (profile->path_count >= JSON_PROFILE_MAX_PATHS && kind != JSON_PATH_ROOT && kind != JSON_PATH_OVERFLOW) {
+        return profile_path(profile, NO_PATH, (JsonSlice){ NULL, 0 }, JSON_PATH_OVERFLOW);
+    }
+    if (kind == JSON_PATH_MEMBER && profile->paths[parent].members >= JSON_PROFILE_MAX_KEYS) {
+        return profile_path(profile, parent, (JsonSlice){ NULL, 0 }, JSON_PATH_OTHER_MEMBERS);
+    }
+    
+    if (profile->path_count >= profile->path_capacity) {
+        size_t new_capacity = profile->path_capacity == 0 ? JSON_INITIAL_CAPACITY : profile->path_capacity * 2;
+        JsonPathStats* new_paths = realloc(profile->paths, new_capacity * sizeof(JsonPathStats));
+        if (!new_paths) return NO_PATH;
+        
+        profile->paths = new_paths;
+        profile->path_capacity = new_capacity;
+    }
+    
+    char* copy = key.length > 0 ? json_arena_strndup(profile->keys, key.data, key.length) : NULL;
+    if (key.length > 0 && !copy) return NO_PATH;
+    
+    size_t index = profile->path_count++;
+    JsonPathStats* path = &profile->paths[index];
+    memset(path, 0, sizeof(*path));
+    path->kind = kind;
+    path->key = (JsonSlice){ copy, key.length };
+    path->parent = parent;
+    if (kind == JSON_PATH_MEMBER) profile->paths[parent].members++;
+    path->number_min = INFINITY;
+    path->number_max = -INFINITY;
+    path->array_min = SIZE_MAX;
+    
+    profile->slots[slot] = index;
+    if (profile->path_count * 2 > profile->slot_count && !grow_slots(profile)) return NO_PATH;
+    return index;
+}
+
+static size_t length_bucket(size_t length) {
+    size_t bucket = 0;
+    while (length > 0 && bucket < JSON_PROFILE_BUCKETS - 1) {
+        length >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void add_bytes(JsonPathStats* path, size_t bytes) {
+    path->bytes += bytes;
+    path->bytes_max = MAX(path->bytes_max, bytes);
+}
+
+static bool push_frame(JsonProfile* profile, size_t path, size_t start, bool is_array) {
+    if (profile->depth >= profile->stack_capacity) {
+        size_t new_capacity = profile->stack_capacity == 0 ? JSON_INITIAL_CAPACITY : profile->stack_capacity * 2;
+        JsonProfileFrame* new_stack = realloc(profile->stack, new_capacity * sizeof(JsonProfileFrame));
+        if (!new_stack) return false;
+        
+        profile->stack = new_stack;
+        profile->stack_capacity = new_capacity;
+    }
+    
+    profile->stack[profile->depth++] = (JsonProfileFrame){
+        .path = path,
+        .element_path = NO_PATH,
+        .member_path = NO_PATH,
+        .start = start,
+        .is_array = is_array
+    };
+    return true;
+}
+
+static bool profile_event(JsonProfile* profile, const JsonParser* parser, const JsonEvent* event) {
+    JsonProfileFrame* frame = profile->depth > 0 ? &profile->stack[profile->depth - 1] : NULL;
+    
+    if (event->type == JSON_EVENT_KEY) {
+        frame->member_path = profile_path(profile, frame->path, event->text, JSON_PATH_MEMBER);
+        return frame->member_path != NO_PATH;
+    }
+    
+    // Closing brackets complete the byte size and length of a container
+    if (event->type == JSON_EVENT_END_ARRAY || event->type == JSON_EVENT_END_OBJECT) {
+        JsonPathStats* path = &profile->paths[frame->path];
+        add_bytes(path, parser->input_offset + parser->pos - frame->start);
+        if (frame->is_array) {
+            path->array_lengths[length_bucket(frame->length)]++;
+            path->array_min = MIN(path->array_min, frame->length);
+            path->array_max = MAX(path->array_max, frame->length);
+            path->array_elements += frame->length;
+        }
+        profile->depth--;
+        return true;
+    }
+    
+    size_t index;
+    if (!frame) {
+        index = profile_path(profile, NO_PATH, (JsonSlice){ NULL, 0 }, JSON_PATH_ROOT);
+    } else if (frame->is_array) {
+        if (frame->element_path == NO_PATH) {
+            frame->element_path = profile_path(profile, frame->path, (JsonSlice){ NULL, 0 }, JSON_PATH_ELEMENT);
+        }
+        index = frame->element_path;
+    } else {
+        index = frame->member_path;
+    }
+    if (index == NO_PATH) return false;
+    if (frame) frame->length++;
+    
+    JsonPathStats* path = &profile->paths[index];
+    path->count++;
+    switch (event->type) {
+        case JSON_EVENT_STRING:
+            path->types[JSON_STRING]++;
+            path->string_lengths[length_bucket(event->text.length)]++;
+            add_bytes(path, event->text.length + 2);
+            break;
+        case JSON_EVENT_NUMBER: {
+            double value = json_number_double(event->number);
+            path->types[JSON_NUMBER]++;
+            path->number_min = MIN(path->number_min, value);
+            path->number_max = MAX(path->number_max, value);
+            path->number_sum += value;
+            add_bytes(path, event->text.length);
+            break;
+        }
+        case JSON_EVENT_BOOL:
+            path->types[JSON_BOOL]++;
+            add_bytes(path, event->text.length);
+            break;
+        case JSON_EVENT_NULL:
+            path->types[JSON_NULL]++;
+            add_bytes(path, event->text.length);
+            break;
+        case JSON_EVENT_START_ARRAY:
+        case JSON_EVENT_START_OBJECT: {
+            bool is_array = event->type == JSON_EVENT_START_ARRAY;
+            path->types[is_array ? JSON_ARRAY : JSON_OBJECT]++;
+            return push_frame(profile, index, parser->input_offset + parser->pos - 1, is_array);
+        }
+        default:
+            break;
+    }
+    return true;
+}
+
+bool json_profile_add(JsonProfile* profile, JsonParser* parser) {
+    if (!profile || !parser) return false;
+    
+    JsonReader reader;
+    JsonEvent event;
+    bool ok = true;
+    
+    profile->depth = 0;
+    json_reader_init(&reader, parser);
+    while (ok && json_reader_next(&reader, &event)) {
+        count_event(&event, &profile->totals);
+        ok = profile_event(profile, parser, &event);
+    }
+    json_reader_release(&reader);
+    
+    return ok && event.type == JSON_EVENT_END;
+}
+
+static void merge_path(JsonPathStats* dst, const JsonPathStats* src) {
+    dst->count += src->count;
+    for (size_t i = 0; i <= JSON_OBJECT; i++) {
+        dst->types[i] += src->types[i];
+    }
+    for (size_t i = 0; i < JSON_PROFILE_BUCKETS; i++) {
+        dst->string_lengths[i] += src->string_lengths[i];
+        dst->array_lengths[i] += src->array_lengths[i];
+    }
+    dst->number_min = MIN(dst->number_min, src->number_min);
+    dst->number_max = MAX(dst->number_max, src->number_max);
+    dst->number_sum += src->number_sum;
+    dst->array_min = MIN(dst->array_min, src->array_min);
+    dst->array_max = MAX(dst->array_max, src->array_max);
+    dst->array_elements += src->array_elements;
+    dst->bytes += src->bytes;
+    dst->bytes_max = MAX(dst->bytes_max, src->bytes_max);
+}
+
+bool json_profile_merge(JsonProfile* dst, const JsonProfile* src) {
+    if (!dst || !src) return false;
+    
+    JsonStats* totals = &dst->totals;
+    totals->total_keys += src->totals.total_keys;
+    totals->total_values += src->totals.total_values;
+    totals->depth = MAX(totals->depth, src->totals.depth);
+    totals->types.string_count += src->totals.types.string_count;
+    totals->types.number_count += src->totals.types.number_count;
+    totals->types.bool_count += src->totals.types.bool_count;
+    totals->types.null_count += src->totals.types.null_count;
+    totals->types.array_count += src->totals.types.array_count;
+    totals->types.object_count += src->totals.types.object_count;
+    if (src->path_count == 0) return true;
+    
+    // Parents come before their children, so each one is mapped first.
+    // Paths past the limits of dst fold the same way new ones would.
+    size_t* map = malloc(src->path_count * sizeof(size_t));
+    if (!map) return false;
+    
+    bool ok = true;
+    for (size_t i = 0; ok && i < src->path_count; i++) {
+        const JsonPathStats* path = &src->paths[i];
+        size_t parent = path->parent == NO_PATH ? NO_PATH : map[path->parent];
+        map[i] = profile_path(dst, parent, path->key, path->kind);
+        ok = map[i] != NO_PATH;
+        if (ok) merge_path(&dst->paths[map[i]], path);
+    }
+    
+    free(map);
+    return ok;
+}
+
+bool json_validate(JsonParser* parser) {
+    if (!parser) return false;
+    
+    // Read the whole document without building a tree; the reader resets
+    // the parser state and records the first error
+    JsonReader reader;
+    JsonEvent event;
+    json_reader_init(&reader, parser);
+    while (json_reader_next(&reader, &event)) {
+        // Only the outcome matters
+    }
+    json_reader_release(&reader);
+    
+    return event.type == JSON_EVENT_END && parser->error_count == 0;
 }
 
 char* json_escape_string(const char* str) {
@@ -143,59 +530,132 @@ char* json_escape_string(const char* str) {
 
 char* json_unescape_string(const char* str) {
     if (!str) return NULL;
+    return json_unescape_slice((JsonSlice){ str, strlen(str) });
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Code unit of the \uXXXX escape at text[i], or -1
+static long escape_unit(JsonSlice text, size_t i) {
+    if (i + 6 > text.length || text.data[i] != '\\' || text.data[i + 1] != 'u') return -1;
     
-    size_t len = strlen(str);
-    char* result = malloc(len + 1);
-    if (!result) return NULL;
-    
+    long unit = 0;
+    for (size_t j = i + 2; j < i + 6; j++) {
+        int digit = hex_digit(text.data[j]);
+        if (digit < 0) return -1;
+        unit = unit * 16 + digit;
+    }
+    return unit;
+}
+
+static size_t put_utf8(char* out, unsigned long code) {
+    if (code < 0x80) {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = (char)(0xc0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3f));
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = (char)(0xe0 | (code >> 12));
+        out[1] = (char)(0x80 | ((code >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (code & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | (code >> 18));
+    out[1] = (char)(0x80 | ((code >> 12) & 0x3f));
+    out[2] = (char)(0x80 | ((code >> 6) & 0x3f));
+    out[3] = (char)(0x80 | (code & 0x3f));
+    return 4;
+}
+
+size_t json_unescape_into(JsonSlice text, char* out) {
     size_t j = 0;
-    bool escaped = false;
-    
-    for (size_t i = 0; i < len; i++) {
-        char c = str[i];
+    for (size_t i = 0; i < text.length; i++) {
+        char c = text.data[i];
+        if (c != '\\' || i + 1 == text.length) {
+            out[j++] = c;
+            continue;
+        }
+        
+        char decoded;
+        switch (text.data[i + 1]) {
+            case '"':
+            case '\\':
+            case '/':
+                decoded = text.data[i + 1];
+                break;
+            case 'b':
+                decoded = '\b';
+                break;
+            case 'f':
+                decoded = '\f';
+                break;
+            case 'n':
+                decoded = '\n';
+                break;
+            case 'r':
+                decoded = '\r';
+                break;
+            case 't':
+                decoded = '\t';
+                break;
+            default:
+                decoded = '\0';
+                break;
+        }
+        if (decoded != '\0') {
+            out[j++] = decoded;
+            i++;
+            continue;
+        }
+        
+        long unit = escape_unit(text, i);
+        if (unit < 0) {
+            out[j++] = c;
+            continue;
+        }
+        i += 5;
         
-        if (escaped) {
-            switch (c) {
-                case '"':
-                case '\\':
-                case '/':
-                    result[j++] = c;
-                    break;
-                case 'b':
-                    result[j++] = '\b';
-                    break;
-                case 'f':
-                    result[j++] = '\f';
-                    break;
-                case 'n':
-                    result[j++] = '\n';
-                    break;
-                case 'r':
-                    result[j++] = '\r';
-                    break;
-                case 't':
-                    result[j++] = '\t';
-                    break;
-                default:
-                    // Invalid escape sequence, copy as is
-                    result[j++] = '\\';
-                    result[j++] = c;
-                    break;
+        unsigned long code = (unsigned long)unit;
+        if (unit >= 0xd800 && unit < 0xdc00) {
+            long low = escape_unit(text, i + 1);
+            if (low >= 0xdc00 && low < 0xe000) {
+                code = 0x10000 + (((unsigned long)unit - 0xd800) << 10) + ((unsigned long)low - 0xdc00);
+                i += 6;
+            } else {
+                code = 0xfffd;
             }
-            escaped = false;
-        } else if (c == '\\') {
-            escaped = true;
-        } else {
-            result[j++] = c;
+        } else if (unit >= 0xdc00 && unit < 0xe000) {
+            code = 0xfffd;
         }
+        j += put_utf8(out + j, code);
     }
+    return j;
+}
+
+char* json_unescape_slice(JsonSlice slice) {
+    if (!slice.data) return NULL;
     
-    // Handle trailing backslash
-    if (escaped) {
-        result[j++] = '\\';
-    }
+    char* result = malloc(slice.length + 1);
+    if (!result) return NULL;
     
-    result[j] = '\0';
+    result[json_unescape_into(slice, result)] = '\0';
     return result;
-} 
+}
 
+char* json_slice_dup(JsonSlice slice) {
+    char* result = malloc(slice.length + 1);
+    if (!result) return NULL;
+    
+    if (slice.length > 0) memcpy(result, slice.data, slice.length);
+    result[slice.length] = '\0';
+    return result;
+}
@@ -0,0 +1,313 @@
+#include "json_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Two-stage parse engine.
+//
+// Stage one classifies the input 64 bytes at a time into bitmasks and
+// records the offset of every structural character: {}[]:, outside
+// strings, every unescaped quote, and the first byte of each literal or
+// number. Escapes are resolved with carry arithmetic on the backslash mask
+// and the inside-string mask is the prefix XOR of the quote mask, so no
+// per-byte branches are taken.
+//
+// Stage two walks those offsets to build the tree. It is stricter than the
+// reference parser (no trailing or missing commas, nothing after the root)
+// and reports no errors: json_parse_tree() falls back to the reference
+// parser whenever this engine gives up.
+//
+// Stage one runs in batches of BATCH_BLOCKS blocks, interleaved with stage
+// two, so the index never grows beyond one batch.
+
+#define BLOCK_SIZE 64
+#define BATCH_BLOCKS 1024
+
+typedef struct {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t whitespace;
+    uint64_t op;
+} BlockMasks;
+
+typedef struct {
+    const char* input;
+    size_t input_len;
+    size_t indexed;          // Input bytes already classified
+    uint64_t prev_escaped;   // Carries between blocks
+    uint64_t prev_in_string;
+    uint64_t prev_scalar;
+    size_t* positions;       // Offsets found in the current batch
+    size_t count;
+    size_t next;
+} StructuralIndex;
+
+static void classify_block(const char* block, BlockMasks* m) {
+#if defined(__AVX2__)
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');   // '[' | 0x20 == '{'
+    const __m256i close = _mm256_set1_epi8('}');  // ']' | 0x20 == '}'
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    
+    m->quote = m->backslash = m->whitespace = m->op = 0;
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(block + 32 * i));
+        __m256i folded = _mm256_or_si256(v, lower);
+        __m256i ws = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, newline), _mm256_cmpeq_epi8(v, cr)));
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)));
+        int shift = 32 * i;
+        m->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << shift;
+        m->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) << shift;
+        m->whitespace |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << shift;
+        m->op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << shift;
+    }
+#elif defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');   // '[' | 0x20 == '{'
+    const __m128i close = _mm_set1_epi8('}');  // ']' | 0x20 == '}'
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    
+    m->quote = m->backslash = m->whitespace = m->op = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(block + 16 * i));
+        __m128i folded = _mm_or_si128(v, lower);
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, newline), _mm_cmpeq_epi8(v, cr)));
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+        int shift = 16 * i;
+        m->quote |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << shift;
+        m->backslash |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << shift;
+        m->whitespace |= (uint64_t)(uint32_t)_mm_movemask_epi8(ws) << shift;
+        m->op |= (uint64_t)(uint32_t)_mm_movemask_epi8(op) << shift;
+    }
+#else
+    m->quote = m->backslash = m->whitespace = m->op = 0;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        uint64_t bit = 1ULL << i;
+        switch (block[i]) {
+            case '"': m->quote |= bit; break;
+            case '\\': m->backslash |= bit; break;
+            case ' ': case '\t': case '\n': case '\r': m->whitespace |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',': m->op |= bit; break;
+            default: break;
+        }
+    }
+#endif
+}
+
+static void index_block(StructuralIndex* ix, const char* block, size_t base) {
+    BlockMasks m;
+    classify_block(block, &m);
+    
+    uint64_t escaped = json_escaped_mask(m.backslash, &ix->prev_escaped);
+    uint64_t quote = m.quote & ~escaped;
+    uint64_t in_string = json_string_mask(quote, &ix->prev_in_string);
+    
+    uint64_t op = m.op & ~in_string;
+    uint64_t scalar = ~(m.op | m.whitespace | m.quote) & ~in_string;
+    uint64_t follows_scalar = scalar << 1 | ix->prev_scalar;
+    ix->prev_scalar = scalar >> 63;
+    
+    uint64_t structurals = op | quote | (scalar & ~follows_scalar);
+    while (structurals) {
+        ix->positions[ix->count++] = base + (size_t)__builtin_ctzll(structurals);
+        structurals &= structurals - 1;
+    }
+}
+
+static void index_next_batch(StructuralIndex* ix) {
+    ix->count = 0;
+    ix->next = 0;
+    
+    for (size_t blocks = 0; blocks < BATCH_BLOCKS && ix->indexed < ix->input_len; blocks++) {
+        size_t remaining = ix->input_len - ix->indexed;
+        if (remaining >= BLOCK_SIZE) {
+            index_block(ix, ix->input + ix->indexed, ix->indexed);
+            ix->indexed += BLOCK_SIZE;
+        } else {
+            // Pad the final partial block with whitespace
+            char tail[BLOCK_SIZE];
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, ix->input + ix->indexed, remaining);
+            index_block(ix, tail, ix->indexed);
+            ix->indexed = ix->input_len;
+        }
+    }
+}
+
+static bool next_structural(StructuralIndex* ix, size_t* pos) {
+    while (ix->next == ix->count) {
+        if (ix->indexed >= ix->input_len) return false;
+        index_next_batch(ix);
+    }
+    
+    *pos = ix->positions[ix->next++];
+    return true;
+}
+
+// Whether a literal or number ending at `pos` ends where the reference
+// parser's token would, so both engines produce the same slice
+static bool is_token_end(const StructuralIndex* ix, size_t pos) {
+    if (pos >= ix->input_len) return true;
+    
+    char c = ix->input[pos];
+    return json_is_whitespace(c) || c == ',' || c == ']' || c == '}';
+}
+
+// The structural after an opening quote is always its closing quote
+static bool parse_string(StructuralIndex* ix, size_t open, JsonSlice* out, bool* has_escapes) {
+    size_t close;
+    if (!next_structural(ix, &close) || ix->input[close] != '"') return false;
+    
+    out->data = ix->input + open + 1;
+    out->length = close - open - 1;
+    *has_escapes = memchr(out->data, '\\', out->length) != NULL;
+    return true;
+}
+
+static bool parse_literal(StructuralIndex* ix, TreeNode* node, size_t pos,
+                          const char* literal, size_t len, JsonType type) {
+    if (ix->input_len - pos < len || memcmp(ix->input + pos, literal, len) != 0 ||
+        !is_token_end(ix, pos + len)) {
+        return false;
+    }
+    
+    node->type = type;
+    node->value = (JsonSlice){ ix->input + pos, len };
+    return true;
+}
+
+static bool parse_value(JsonParser* parser, StructuralIndex* ix, TreeNode* node, size_t pos);
+
+static bool parse_array(JsonParser* parser, StructuralIndex* ix, TreeNode* node) {
+    node->type = JSON_ARRAY;
+    size_t base = parser->node_stack_len;
+    
+    size_t pos;
+    if (!next_structural(ix, &pos)) return false;
+    
+    if (ix->input[pos] != ']') {
+        for (;;) {
+            TreeNode* value = json_tree_node_alloc(parser, node);
+            if (!value || !parse_value(parser, ix, value, pos) ||
+                !json_tree_push_child(parser, value)) {
+                return false;
+            }
+            
+            if (!next_structural(ix, &pos)) return false;
+            if (ix->input[pos] == ']') break;
+            if (ix->input[pos] != ',' || !next_structural(ix, &pos)) return false;
+        }
+    }
+    
+    return json_tree_finish_container(parser, node, base);
+}
+
+static bool parse_object(JsonParser* parser, StructuralIndex* ix, TreeNode* node) {
+    node->type = JSON_OBJECT;
+    size_t base = parser->node_stack_len;
+    
+    size_t pos;
+    if (!next_structural(ix, &pos)) return false;
+    
+    if (ix->input[pos] != '}') {
+        for (;;) {
+            JsonSlice key;
+            bool key_escaped;
+            if (ix->input[pos] != '"' || !parse_string(ix, pos, &key, &key_escaped)) return false;
+            if (!next_structural(ix, &pos) || ix->input[pos] != ':') return false;
+            if (!next_structural(ix, &pos)) return false;
+            
+            TreeNode* value = json_tree_node_alloc(parser, node);
+            if (!value || !parse_value(parser, ix, value, pos)) return false;
+            
+            value->name = key;
+            if (key_escaped) value->flags |= TREE_NODE_NAME_ESCAPED;
+            if (json_key_intern(parser->keys, &value->name)) value->flags |= TREE_NODE_NAME_INTERNED;
+            if (!json_tree_push_child(parser, value)) return false;
+            
+            if (!next_structural(ix, &pos)) return false;
+            if (ix->input[pos] == '}') break;
+            if (ix->input[pos] != ',' || !next_structural(ix, &pos)) return false;
+        }
+    }
+    
+    return json_tree_finish_container(parser, node, base);
+}
+
+static bool parse_value(JsonParser* parser, StructuralIndex* ix, TreeNode* node, size_t pos) {
+    char c = ix->input[pos];
+    switch (c) {
+        case '{':
+            return parse_object(parser, ix, node);
+        case '[':
+            return parse_array(parser, ix, node);
+        case '"': {
+            bool escaped;
+            node->type = JSON_STRING;
+            if (!parse_string(ix, pos, &node->value, &escaped)) return false;
+            if (escaped) node->flags |= TREE_NODE_VALUE_ESCAPED;
+            return true;
+        }
+        case 't':
+            return parse_literal(ix, node, pos, "true", 4, JSON_BOOL);
+        case 'f':
+            return parse_literal(ix, node, pos, "false", 5, JSON_BOOL);
+        case 'n':
+            return parse_literal(ix, node, pos, "null", 4, JSON_NULL);
+        default:
+            if (c == '-' || (c >= '0' && c <= '9')) {
+                size_t len = json_scan_number(ix->input + pos, ix->input_len - pos);
+                if (!is_token_end(ix, pos + len)) return false;
+                node->type = JSON_NUMBER;
+                node->value = (JsonSlice){ ix->input + pos, len };
+                return json_number_parse(node->value, &node->number);
+            }
+            return false;
+    }
+}
+
+TreeNode* json_parse_tree_structural(JsonParser* parser) {
+    StructuralIndex ix = {
+        .input = parser->input,
+        .input_len = parser->input_len
+    };
+    ix.positions = malloc(BATCH_BLOCKS * BLOCK_SIZE * sizeof(size_t));
+    if (!ix.positions) return NULL;
+    
+    TreeNode* root = json_tree_begin(parser);
+    if (!root) {
+        free(ix.positions);
+        return NULL;
+    }
+    
+    size_t pos;
+    bool ok = next_structural(&ix, &pos) && parse_value(parser, &ix, root, pos);
+    
+    // Trailing content is left to the reference parser
+    if (ok && next_structural(&ix, &pos)) ok = false;
+    if (ok) parser->pos = parser->input_len;
+    
+    free(ix.positions);
+    return json_tree_end(parser, root, ok);
+}
@@ -0,0 +1,314 @@
+#include "json_internal.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Tape documents are built from the reader's events: values are appended
+// as they start, and a container's end is filled in when it closes, from
+// a stack of the entries still open. Keys are not entries of their own;
+// the name is held until the member's value arrives.
+
+static bool tape_reserve(JsonTape* tape) {
+    if (tape->count < tape->capacity) return true;
+    
+    size_t new_capacity = tape->capacity == 0 ? JSON_BUFFER_SIZE : tape->capacity * 2;
+    JsonTapeEntry* new_entries = realloc(tape->entries, new_capacity * sizeof(JsonTapeEntry));
+    if (!new_entries) return false;
+    
+    tape->entries = new_entries;
+    tape->capacity = new_capacity;
+    return true;
+}
+
+// Stores where `text` is: its offset in the parser input or, since
+// streamed text only lasts until the next event, in the tape's own copy
+static bool tape_text(JsonTape* tape, const JsonParser* parser, JsonSlice text, JsonTapeText* out) {
+    out->length = text.length;
+    if (!parser->source) {
+        out->offset = (uint64_t)(text.data - parser->input);
+        return true;
+    }
+    
+    if (text.length > tape->copy_capacity - tape->copy_size) {
+        size_t new_capacity = tape->copy_capacity == 0 ? JSON_WRITER_BUFFER_SIZE : tape->copy_capacity * 2;
+        while (new_capacity - tape->copy_size < text.length) new_capacity *= 2;
+        char* new_copy = realloc(tape->copy, new_capacity);
+        if (!new_copy) return false;
+        tape->copy = new_copy;
+        tape->copy_capacity = new_capacity;
+    }
+    memcpy(tape->copy + tape->copy_size, text.data, text.length);
+    out->offset = tape->copy_size;
+    tape->copy_size += text.length;
+    return true;
+}
+
+static JsonType event_value_type(JsonEventType type) {
+    switch (type) {
+        case JSON_EVENT_START_OBJECT:
+            return JSON_OBJECT;
+        case JSON_EVENT_START_ARRAY:
+            return JSON_ARRAY;
+        case JSON_EVENT_STRING:
+            return JSON_STRING;
+        case JSON_EVENT_NUMBER:
+            return JSON_NUMBER;
+        case JSON_EVENT_BOOL:
+            return JSON_BOOL;
+        default:
+            break;
+    }
+    return JSON_NULL;
+}
+
+JsonTape* json_parse_tape(JsonParser* parser) {
+    if (!parser) return NULL;
+    
+    JsonTape* tape = calloc(1, sizeof(JsonTape));
+    if (!tape) return NULL;
+    
+    size_t* open = NULL;          // Entries of the open containers
+    size_t depth = 0;
+    size_t open_capacity = 0;
+    JsonTapeText name = { 0, 0 };
+    uint32_t name_flags = 0;
+    bool ok = true;
+    
+    JsonReader reader;
+    JsonEvent event;
+    json_reader_init(&reader, parser);
+    while (ok && json_reader_next(&reader, &event)) {
+        if (event.type == JSON_EVENT_KEY) {
+            name_flags = event.escaped ? TREE_NODE_NAME_ESCAPED : 0;
+            ok = tape_text(tape, parser, event.text, &name);
+            continue;
+        }
+        if (event.type == JSON_EVENT_END_OBJECT || event.type == JSON_EVENT_END_ARRAY) {
+            tape->entries[open[--depth]].end = tape->count;
+            continue;
+        }
+        
+        if (!tape_reserve(tape)) {
+            ok = false;
+            break;
+        }
+        if (depth > 0) tape->entries[open[depth - 1]].count++;
+        
+        // Zeroed whole, padding included, so saved tapes are reproducible
+        JsonTapeEntry* entry = &tape->entries[tape->count];
+        memset(entry, 0, sizeof(*entry));
+        entry->name = name;
+        entry->type = event_value_type(event.type);
+        entry->flags = name_flags;
+        entry->end = ++tape->count;
+        name = (JsonTapeText){ 0, 0 };
+        name_flags = 0;
+        
+        if (entry->type == JSON_OBJECT || entry->type == JSON_ARRAY) {
+            entry->count = 0;
+            if (depth >= open_capacity) {
+                size_t new_capacity = open_capacity == 0 ? JSON_INITIAL_CAPACITY : open_capacity * 2;
+                size_t* new_open = realloc(open, new_capacity * sizeof(size_t));
+                if (!new_open) {
+                    ok = false;
+                    break;
+                }
+                open = new_open;
+                open_capacity = new_capacity;
+            }
+            open[depth++] = tape->count - 1;
+        } else {
+            if (entry->type == JSON_NUMBER) entry->number = event.number;
+            if (event.escaped) entry->flags |= TREE_NODE_VALUE_ESCAPED;
+            ok = tape_text(tape, parser, event.text, &entry->value);
+        }
+    }
+    json_reader_release(&reader);
+    free(open);
+    
+    if (!ok || event.type != JSON_EVENT_END) {
+        json_tape_destroy(tape);
+        return NULL;
+    }
+    
+    tape->text = parser->source ? tape->copy : parser->input;
+    
+    // Give back the spare capacity of the last doubling
+    JsonTapeEntry* entries = realloc(tape->entries, tape->count * sizeof(JsonTapeEntry));
+    if (entries) {
+        tape->entries = entries;
+        tape->capacity = tape->count;
+    }
+    return tape;
+}
+
+void json_tape_destroy(JsonTape* tape) {
+    if (!tape) return;
+    
+    if (tape->mapping) {
+        munmap(tape->mapping, tape->mapping_size);
+    } else {
+        free(tape->entries);
+    }
+    free(tape->copy);
+    free(tape);
+}
+
+// Parse cache
+
+static inline uint64_t rotate_left(uint64_t x, unsigned n) {
+    return (x << n) | (x >> (64 - n));
+}
+
+// Hash of the input a saved tape was parsed from. Four independent lanes
+// over 32-byte blocks keep it at memory speed; it only has to tell
+// changed inputs apart, not resist attacks.
+static uint64_t input_hash(const char* data, size_t size) {
+    const uint64_t prime = 0x9e3779b97f4a7c15ull;
+    uint64_t lanes[4] = { size, size + prime, size ^ prime, ~size };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, data + i + 8 * lane, sizeof(word));
+            lanes[lane] = rotate_left(lanes[lane] ^ word, 29) * prime;
+        }
+    }
+    
+    uint64_t hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) +
+                    rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+    for (; i < size; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * prime;
+    }
+    
+    // Final avalanche (MurmurHash3 fmix64)
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool json_tape_save(const JsonTape* tape, const char* path, const char* input, size_t size,
+                    const JsonIndexSource* source) {
+    if (!tape || tape->count == 0 || tape->text != input || !path || !source) return false;
+    
+    JsonTapeHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, JSON_TAPE_MAGIC, sizeof(header.magic));
+    header.entry_size = sizeof(JsonTapeEntry);
+    header.source = *source;
+    header.input_hash = input_hash(input, size);
+    header.count = tape->count;
+    header.entries_offset = sizeof(JsonTapeHeader);
+    
+    // Written aside and renamed over the old file, as json_index_write()
+    // does, so readers never see a partial file
+    size_t length = strlen(path);
+    char* temp = malloc(length + 5);
+    if (!temp) return false;
+    memcpy(temp, path, length);
+    memcpy(temp + length, ".tmp", 5);
+    
+    FILE* file = fopen(temp, "wb");
+    bool ok = file && fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(tape->entries, sizeof(JsonTapeEntry), tape->count, file) == tape->count;
+    if (file && fclose(file) != 0) ok = false;
+    if (ok) ok = rename(temp, path) == 0;
+    if (!ok && file) remove(temp);
+    
+    free(temp);
+    return ok;
+}
+
+static bool text_fits(JsonTapeText text, size_t size) {
+    return text.offset <= size && text.length <= size - text.offset;
+}
+
+// Whether the entries of a loaded tape nest properly and their text lies
+// in the input: then every walk over the tape stays in bounds, whatever
+// the file held
+static bool tape_valid(const JsonTape* tape, size_t text_size) {
+    if (tape->entries[0].end != tape->count) return false;
+    
+    size_t* ends = NULL;          // Ends of the open containers
+    size_t depth = 0;
+    size_t capacity = 0;
+    bool ok = true;
+    for (size_t i = 0; ok && i < tape->count; i++) {
+        const JsonTapeEntry* entry = &tape->entries[i];
+        while (depth > 0 && ends[depth - 1] == i) depth--;
+        
+        size_t limit = depth > 0 ? ends[depth - 1] : tape->count;
+        if ((i > 0 && depth == 0) || (unsigned)entry->type > JSON_OBJECT ||
+            entry->end <= i || entry->end > limit ||
+            !text_fits(entry->name, text_size) || !text_fits(entry->value, text_size)) {
+            ok = false;
+        } else if (entry->type != JSON_ARRAY && entry->type != JSON_OBJECT) {
+            ok = entry->end == i + 1;
+        } else if (entry->end > i + 1) {
+            if (depth >= capacity) {
+                size_t new_capacity = capacity == 0 ? JSON_INITIAL_CAPACITY : capacity * 2;
+                size_t* new_ends = realloc(ends, new_capacity * sizeof(size_t));
+                if (!new_ends) {
+                    ok = false;
+                    break;
+                }
+                ends = new_ends;
+                capacity = new_capacity;
+            }
+            ends[depth++] = entry->end;
+        }
+    }
+    free(ends);
+    return ok;
+}
+
+JsonTape* json_tape_load(const char* path, const char* input, size_t size, const JsonIndexSource* source) {
+    if (!path || !input || !source) return NULL;
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    
+    struct stat st;
+    void* addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(JsonTapeHeader)) {
+        addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED) return NULL;
+    
+    size_t file_size = (size_t)st.st_size;
+    const JsonTapeHeader* header = addr;
+    bool ok = memcmp(header->magic, JSON_TAPE_MAGIC, sizeof(header->magic)) == 0 &&
+              header->entry_size == sizeof(JsonTapeEntry) &&
+              header->source.size == source->size && source->size == size &&
+              header->source.mtime_sec == source->mtime_sec &&
+              header->source.mtime_nsec == source->mtime_nsec &&
+              header->count > 0 && header->entries_offset % 8 == 0 &&
+              header->entries_offset <= file_size &&
+              header->count <= (file_size - header->entries_offset) / sizeof(JsonTapeEntry);
+    
+    JsonTape* tape = ok ? calloc(1, sizeof(JsonTape)) : NULL;
+    if (!tape) {
+        munmap(addr, file_size);
+        return NULL;
+    }
+    
+    tape->entries = (JsonTapeEntry*)((char*)addr + header->entries_offset);
+    tape->count = (size_t)header->count;
+    tape->capacity = tape->count;
+    tape->text = input;
+    tape->mapping = addr;
+    tape->mapping_size = file_size;
+    if (input_hash(input, size) != header->input_hash || !tape_valid(tape, size)) {
+        json_tape_destroy(tape);
+        return NULL;
+    }
+    return tape;
+}
@@ -0,0 +1,162 @@
+#include "json_parser.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static bool writer_init(JsonWriter* writer, size_t capacity) {
+    writer->data = malloc(capacity);
+    writer->size = 0;
+    writer->capacity = capacity;
+    writer->fd = -1;
+    writer->stream = NULL;
+    writer->grows = false;
+    writer->failed = writer->data == NULL;
+    return !writer->failed;
+}
+
+bool json_writer_init_fd(JsonWriter* writer, int fd) {
+    if (!writer || !writer_init(writer, JSON_WRITER_BUFFER_SIZE)) return false;
+    writer->fd = fd;
+    return true;
+}
+
+bool json_writer_init_file(JsonWriter* writer, FILE* stream) {
+    if (!writer || !stream || !writer_init(writer, JSON_WRITER_BUFFER_SIZE)) return false;
+    
+    // Memory streams have no descriptor and keep going through stdio
+    int fd = fileno(stream);
+    if (fd >= 0 && fflush(stream) == 0) {
+        writer->fd = fd;
+    } else {
+        writer->stream = stream;
+    }
+    return true;
+}
+
+bool json_writer_init_memory(JsonWriter* writer) {
+    if (!writer || !writer_init(writer, JSON_BUFFER_SIZE)) return false;
+    writer->grows = true;
+    return true;
+}
+
+// Writes all of iov[0..count), resuming after short writes
+static bool write_all(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        
+        size_t written = (size_t)n;
+        while (count > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+// Sends the buffered bytes followed by data[0..len)
+static bool writer_send(JsonWriter* writer, const char* data, size_t len) {
+    bool ok;
+    if (writer->fd >= 0) {
+        struct iovec iov[2] = {
+            { writer->data, writer->size },
+            { (void*)data, len }
+        };
+        ok = write_all(writer->fd, iov, 2);
+    } else {
+        ok = fwrite(writer->data, 1, writer->size, writer->stream) == writer->size &&
+             (len == 0 || fwrite(data, 1, len, writer->stream) == len);
+    }
+    
+    writer->size = 0;
+    if (!ok) writer->failed = true;
+    return ok;
+}
+
+static bool writer_grow(JsonWriter* writer, size_t needed) {
+    size_t new_capacity = writer->capacity * 2;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    
+    char* new_data = realloc(writer->data, new_capacity);
+    if (!new_data) {
+        writer->failed = true;
+        return false;
+    }
+    
+    writer->data = new_data;
+    writer->capacity = new_capacity;
+    return true;
+}
+
+bool json_writer_write(JsonWriter* writer, const char* data, size_t len) {
+    if (writer->failed) return false;
+    if (len == 0) return true;
+    
+    if (len > writer->capacity - writer->size) {
+        if (writer->grows) {
+            if (!writer_grow(writer, writer->size + len)) return false;
+        } else if (len >= JSON_WRITER_DIRECT_SIZE) {
+            return writer_send(writer, data, len);
+        } else if (!writer_send(writer, NULL, 0)) {
+            return false;
+        }
+    }
+    
+    memcpy(writer->data + writer->size, data, len);
+    writer->size += len;
+    return true;
+}
+
+bool json_writer_spaces(JsonWriter* writer, size_t count) {
+    static const char spaces[] =
+        "                                                                "
+        "                                                                ";
+    
+    while (count > 0) {
+        size_t n = count < sizeof(spaces) - 1 ? count : sizeof(spaces) - 1;
+        if (!json_writer_write(writer, spaces, n)) return false;
+        count -= n;
+    }
+    return true;
+}
+
+bool json_writer_flush(JsonWriter* writer) {
+    if (writer->failed) return false;
+    if (writer->grows || writer->size == 0) return true;
+    return writer_send(writer, NULL, 0);
+}
+
+bool json_writer_finish(JsonWriter* writer) {
+    bool ok = json_writer_flush(writer);
+    
+    free(writer->data);
+    writer->data = NULL;
+    writer->size = 0;
+    writer->capacity = 0;
+    return ok;
+}
+
+char* json_writer_take(JsonWriter* writer) {
+    char* data = NULL;
+    if (writer->grows && !writer->failed &&
+        (writer->size < writer->capacity || writer_grow(writer, writer->size + 1))) {
+        data = writer->data;
+        data[writer->size] = '\0';
+        writer->data = NULL;
+    }
+    
+    json_writer_finish(writer);
+    return data;
+}
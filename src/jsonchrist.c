@@ -1,9 +1,12 @@
+#define _DEFAULT_SOURCE // realpath()
 #include "json_parser.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 // ANSI color codes
 #define COLOR_RESET   "\x1b[0m"
@@ -13,8 +16,9 @@
 #define COLOR_WHITE   "\x1b[37m"
 #define COLOR_RED     "\x1b[31m"
 
-// Global output file pointer
-static FILE* output = NULL;
+// Global output file pointer. Per thread: --lines workers point it at
+// their own batch buffer.
+static _Thread_local FILE* output = NULL;
 
 typedef struct {
     bool tree;
@@ -28,37 +32,100 @@ typedef struct {
     bool edit;
     bool index;
     bool no_color;
+    bool lines;
+    bool unordered;
+    bool tape;
+    bool cache;
+    bool to_binary;
+    bool from_binary;
+    bool unflatten;
+    size_t jobs;
     size_t indent;
+    JsonEngine engine;
+    JsonBinaryFormat to;
+    JsonBinaryFormat from;
     const char* input_file;
     const char* output_file;
+    const char* index_file;
+    const char* lookup;
+    const char* cache_dir;
+    JsonQuery* query;
 } Options;
 
 static void print_usage(const char* program) {
     fprintf(stderr, "Usage: %s [options] input.json\n", program);
+    fprintf(stderr, "       (use - as input.json to read from standard input)\n");
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  --tree           Output hierarchical tree structure\n");
     fprintf(stderr, "  --pretty         Output formatted JSON\n");
-    fprintf(stderr, "  --compact        Output compact JSON\n");
+    fprintf(stderr, "  --compact        Output compact JSON on one line\n");
     fprintf(stderr, "  --flatten        Output flattened key-value pairs\n");
     fprintf(stderr, "  --stream         Output parsing events stream\n");
+    fprintf(stderr, "  --query PATH     Output the values a JSONPath selects, e.g. '$.items[*].id'\n");
     fprintf(stderr, "  --validate       Validate JSON and show errors\n");
-    fprintf(stderr, "  --stats          Output JSON statistics\n");
+    fprintf(stderr, "  --stats          Output JSON statistics and a per-path profile\n");
     fprintf(stderr, "  --highlight      Output syntax-highlighted JSON\n");
     fprintf(stderr, "  --edit           Output editable node structure\n");
-    fprintf(stderr, "  --index          Output searchable index\n");
+    fprintf(stderr, "  --to FORMAT      Convert to binary FORMAT: cbor or msgpack\n");
+    fprintf(stderr, "  --from FORMAT    Read binary FORMAT input (cbor or msgpack) as JSON\n");
+    fprintf(stderr, "  --unflatten      Read --flatten output as the JSON it was made from\n");
+    fprintf(stderr, "  --index          Write a value index file (INPUT.jcidx)\n");
+    fprintf(stderr, "  --lookup VALUE   Find VALUE in the index file without parsing the input\n");
+    fprintf(stderr, "  --index-file FILE Index file for --index and --lookup\n");
     fprintf(stderr, "  --no-color       Disable colored output\n");
     fprintf(stderr, "  --indent N       Set indentation level (default: 4)\n");
+    fprintf(stderr, "  --engine=NAME    Parse engine: recursive (default), structural or parallel\n");
+    fprintf(stderr, "  --tape           Build a flat tape rather than a node tree for --tree, --highlight and --edit\n");
+    fprintf(stderr, "  --cache          Keep the tape of an input file for later runs of those modes\n");
+    fprintf(stderr, "  --cache-dir DIR  Directory for --cache (default: ~/.cache/jsonchrist)\n");
+    fprintf(stderr, "  --lines          Treat input as JSON Lines, one document per line\n");
+    fprintf(stderr, "  --unordered      With --lines, write records as they finish\n");
+    fprintf(stderr, "  --jobs N         Worker threads for --lines and the parallel engine (default: all CPUs)\n");
     fprintf(stderr, "  -o, --output FILE Write output to FILE\n");
     fprintf(stderr, "  -h, --help       Display this help message\n");
     fprintf(stderr, "\nExamples:\n");
     fprintf(stderr, "  %s --tree input.json\n", program);
     fprintf(stderr, "  %s --pretty --indent 2 input.json\n", program);
     fprintf(stderr, "  %s --validate --stats input.json\n", program);
+    fprintf(stderr, "  %s --query '$.items[*].id' input.json\n", program);
+    fprintf(stderr, "  %s --to msgpack -o input.msgpack input.json\n", program);
+    fprintf(stderr, "  %s --lookup alice@example.com input.json\n", program);
+}
+
+// Whether any mode writing text but --lookup was asked for
+static bool has_text_modes(const Options* opts) {
+    return opts->tree || opts->pretty || opts->compact || opts->flatten ||
+           opts->stream || opts->validate || opts->stats || opts->highlight ||
+           opts->edit || opts->index || opts->query;
+}
+
+// Whether any mode but --lookup was asked for
+static bool has_modes(const Options* opts) {
+    return has_text_modes(opts) || opts->to_binary;
+}
+
+// Value of an option that takes it either as --name=VALUE or as the next
+// argument, or NULL if missing
+static const char* option_value(int argc, char* argv[], int* i, size_t length) {
+    if (argv[*i][length] == '=') return argv[*i] + length + 1;
+    return *i + 1 < argc ? argv[++*i] : NULL;
+}
+
+static JsonBinaryFormat binary_format(const char* option, const char* name) {
+    if (!name) {
+        fprintf(stderr, "Error: %s requires a format\n", option);
+        exit(1);
+    }
+    if (strcmp(name, "cbor") == 0) return JSON_BINARY_CBOR;
+    if (strcmp(name, "msgpack") == 0) return JSON_BINARY_MSGPACK;
+    fprintf(stderr, "Error: Unknown format '%s'\n", name);
+    exit(1);
 }
 
 static Options parse_options(int argc, char* argv[]) {
     Options opts = {
         .indent = 4,  // Default indentation
+        .engine = JSON_ENGINE_RECURSIVE,
         .no_color = false
     };
     
@@ -74,6 +141,18 @@ static Options parse_options(int argc, char* argv[]) {
         else if (strcmp(argv[i], "--edit") == 0) opts.edit = true;
         else if (strcmp(argv[i], "--index") == 0) opts.index = true;
         else if (strcmp(argv[i], "--no-color") == 0) opts.no_color = true;
+        else if (strcmp(argv[i], "--lines") == 0) opts.lines = true;
+        else if (strcmp(argv[i], "--unordered") == 0) opts.unordered = true;
+        else if (strcmp(argv[i], "--unflatten") == 0) opts.unflatten = true;
+        else if (strcmp(argv[i], "--tape") == 0) opts.tape = true;
+        else if (strcmp(argv[i], "--cache") == 0) opts.cache = true;
+        else if (strcmp(argv[i], "--jobs") == 0) {
+            if (++i >= argc || atoi(argv[i]) <= 0) {
+                fprintf(stderr, "Error: --jobs requires a positive number\n");
+                exit(1);
+            }
+            opts.jobs = (size_t)atoi(argv[i]);
+        }
         else if (strcmp(argv[i], "--indent") == 0) {
             if (++i >= argc) {
                 fprintf(stderr, "Error: --indent requires a number\n");
@@ -84,6 +163,63 @@ static Options parse_options(int argc, char* argv[]) {
                 fprintf(stderr, "Warning: Large indentation may cause wide output\n");
             }
         }
+        else if (strncmp(argv[i], "--engine", 8) == 0 && (argv[i][8] == '=' || argv[i][8] == '\0')) {
+            const char* name = option_value(argc, argv, &i, 8);
+            if (!name) {
+                fprintf(stderr, "Error: --engine requires a name\n");
+                exit(1);
+            }
+            if (strcmp(name, "recursive") == 0) opts.engine = JSON_ENGINE_RECURSIVE;
+            else if (strcmp(name, "structural") == 0) opts.engine = JSON_ENGINE_STRUCTURAL;
+            else if (strcmp(name, "parallel") == 0) opts.engine = JSON_ENGINE_PARALLEL;
+            else {
+                fprintf(stderr, "Error: Unknown engine '%s'\n", name);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "--to", 4) == 0 && (argv[i][4] == '=' || argv[i][4] == '\0')) {
+            opts.to = binary_format("--to", option_value(argc, argv, &i, 4));
+            opts.to_binary = true;
+        }
+        else if (strncmp(argv[i], "--from", 6) == 0 && (argv[i][6] == '=' || argv[i][6] == '\0')) {
+            opts.from = binary_format("--from", option_value(argc, argv, &i, 6));
+            opts.from_binary = true;
+        }
+        else if (strcmp(argv[i], "--query") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: --query requires a path\n");
+                exit(1);
+            }
+            const char* error;
+            json_query_destroy(opts.query);
+            opts.query = json_query_compile(argv[i], &error);
+            if (!opts.query) {
+                fprintf(stderr, "Error: Invalid query '%s': %s\n", argv[i], error);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--lookup") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: --lookup requires a value\n");
+                exit(1);
+            }
+            opts.lookup = argv[i];
+        }
+        else if (strcmp(argv[i], "--cache-dir") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: --cache-dir requires a directory\n");
+                exit(1);
+            }
+            opts.cache_dir = argv[i];
+            opts.cache = true;
+        }
+        else if (strcmp(argv[i], "--index-file") == 0) {
+            if (++i >= argc) {
+                fprintf(stderr, "Error: --index-file requires a filename\n");
+                exit(1);
+            }
+            opts.index_file = argv[i];
+        }
         else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) {
             if (++i >= argc) {
                 fprintf(stderr, "Error: -o/--output requires a filename\n");
@@ -95,7 +231,7 @@ static Options parse_options(int argc, char* argv[]) {
             print_usage(argv[0]);
             exit(0);
         }
-        else if (argv[i][0] != '-') {
+        else if (argv[i][0] != '-' || strcmp(argv[i], "-") == 0) {
             if (opts.input_file) {
                 fprintf(stderr, "Error: Multiple input files specified\n");
                 exit(1);
@@ -113,86 +249,223 @@ static Options parse_options(int argc, char* argv[]) {
         exit(1);
     }
     
+    if ((opts.index || opts.lookup) && !opts.index_file && strcmp(opts.input_file, "-") == 0) {
+        fprintf(stderr, "Error: --index and --lookup need --index-file with standard input\n");
+        exit(1);
+    }
+    
+    if (opts.cache && opts.lines) {
+        fprintf(stderr, "Error: --cache cannot be combined with --lines\n");
+        exit(1);
+    }
+    
+    // Binary output cannot share the output with text
+    if (opts.to_binary && (has_text_modes(&opts) || opts.lookup)) {
+        fprintf(stderr, "Error: --to cannot be combined with other modes\n");
+        exit(1);
+    }
+    
+    // Index offsets would point into the decoded text, not the input file
+    if (opts.from_binary && (opts.index || opts.lookup)) {
+        fprintf(stderr, "Error: --from cannot be combined with --index or --lookup\n");
+        exit(1);
+    }
+    if (opts.unflatten && (opts.from_binary || opts.index || opts.lookup)) {
+        fprintf(stderr, "Error: --unflatten cannot be combined with --from, --index or --lookup\n");
+        exit(1);
+    }
+    
     // If no output format is specified, default to pretty print
-    if (!opts.tree && !opts.pretty && !opts.compact && !opts.flatten &&
-        !opts.stream && !opts.validate && !opts.stats && !opts.highlight &&
-        !opts.edit && !opts.index) {
+    if (!has_modes(&opts) && !opts.lookup) {
         opts.pretty = true;
     }
     
     return opts;
 }
 
-static void print_path_value(const TreeNode* node, char* path, size_t path_len) {
-    switch (node->type) {
-        case JSON_NULL:
-            fprintf(output, "%s: null\n", path);
-            break;
-        case JSON_BOOL:
-        case JSON_NUMBER:
-            fprintf(output, "%s: %s\n", path, node->value);
-            break;
-        case JSON_STRING:
-            fprintf(output, "%s: \"%s\"\n", path, node->value);
-            break;
-        case JSON_ARRAY:
-        case JSON_OBJECT:
-            for (size_t i = 0; i < node->children_count; i++) {
-                const TreeNode* child = node->children[i];
-                size_t new_len = path_len;
-                char new_path[JSON_PATH_MAX_LENGTH];
-                strncpy(new_path, path, JSON_PATH_MAX_LENGTH);
-                
-                if (node->type == JSON_ARRAY) {
-                    new_len += snprintf(new_path + path_len, JSON_PATH_MAX_LENGTH - path_len,
-                                      "[%zu]", i);
-                } else {
-                    new_len += snprintf(new_path + path_len, JSON_PATH_MAX_LENGTH - path_len,
-                                      ".%s", child->name);
-                }
-                
-                print_path_value(child, new_path, new_len);
-            }
-            break;
+// Index file of the input: --index-file, or INPUT.jcidx
+static char* index_file_name(const Options* opts) {
+    if (opts->index_file) return strdup(opts->index_file);
+    
+    size_t length = strlen(opts->input_file);
+    char* name = malloc(length + sizeof(".jcidx"));
+    if (name) {
+        memcpy(name, opts->input_file, length);
+        memcpy(name + length, ".jcidx", sizeof(".jcidx"));
     }
+    return name;
 }
 
-static void print_stream_events(const TreeNode* node) {
-    switch (node->type) {
-        case JSON_OBJECT:
-            fprintf(output, "START_OBJECT\n");
-            for (size_t i = 0; i < node->children_count; i++) {
-                const TreeNode* child = node->children[i];
-                fprintf(output, "FIELD_NAME: \"%s\"\n", child->name);
-                print_stream_events(child);
-            }
-            fprintf(output, "END_OBJECT\n");
-            break;
-            
-        case JSON_ARRAY:
-            fprintf(output, "START_ARRAY\n");
-            for (size_t i = 0; i < node->children_count; i++) {
-                print_stream_events(node->children[i]);
-            }
-            fprintf(output, "END_ARRAY\n");
-            break;
-            
-        case JSON_STRING:
-            fprintf(output, "VALUE_STRING: \"%s\"\n", node->value);
-            break;
-            
-        case JSON_NUMBER:
-            fprintf(output, "VALUE_NUMBER: %s\n", node->value);
-            break;
-            
-        case JSON_BOOL:
-            fprintf(output, "VALUE_BOOLEAN: %s\n", node->value);
-            break;
-            
-        case JSON_NULL:
-            fprintf(output, "VALUE_NULL\n");
-            break;
+// Size and modification time of the input file; zero for standard input
+static JsonIndexSource input_identity(const char* path) {
+    JsonIndexSource source = { 0, 0, 0 };
+    struct stat st;
+    if (strcmp(path, "-") != 0 && stat(path, &st) == 0) {
+        source.size = (uint64_t)st.st_size;
+        source.mtime_sec = st.st_mtim.tv_sec;
+        source.mtime_nsec = st.st_mtim.tv_nsec;
+    }
+    return source;
+}
+
+// Creates `path` as a private directory unless it exists
+static bool make_directory(const char* path) {
+    return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+
+// --cache file of the input: one per input path, named by a hash of its
+// absolute path, in --cache-dir or else $XDG_CACHE_HOME/jsonchrist or
+// ~/.cache/jsonchrist, which are created if missing. NULL for standard input.
+static char* cache_file_name(const Options* opts) {
+    if (strcmp(opts->input_file, "-") == 0) return NULL;
+    
+    char* input = realpath(opts->input_file, NULL);
+    if (!input) return NULL;
+    uint64_t hash = 0xcbf29ce484222325ull;  // FNV-1a
+    for (const char* p = input; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 0x100000001b3ull;
+    }
+    free(input);
+    
+    char dir[4096];
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (opts->cache_dir) {
+        snprintf(dir, sizeof(dir), "%s", opts->cache_dir);
+    } else if (xdg && xdg[0] == '/') {
+        snprintf(dir, sizeof(dir), "%s/jsonchrist", xdg);
+    } else if (home && home[0]) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+        if (!make_directory(dir)) return NULL;
+        snprintf(dir, sizeof(dir), "%s/.cache/jsonchrist", home);
+    } else {
+        return NULL;
     }
+    if (!make_directory(dir)) return NULL;
+    
+    size_t size = strlen(dir) + sizeof("/0123456789abcdef.jctape");
+    char* name = malloc(size);
+    if (name) snprintf(name, size, "%s/%016llx.jctape", dir, (unsigned long long)hash);
+    return name;
+}
+
+static bool save_index(const Options* opts, const JsonIndexBuilder* builder) {
+    char* name = index_file_name(opts);
+    JsonIndexSource source = input_identity(opts->input_file);
+    bool ok = name && json_index_write(builder, name, &source);
+    if (ok) {
+        fprintf(output, "Indexed %zu values into %s\n", json_index_count(builder), name);
+    } else {
+        fprintf(stderr, "Error: Cannot write index file '%s'\n", name ? name : opts->input_file);
+    }
+    free(name);
+    return ok;
+}
+
+typedef struct {
+    size_t count;
+    char* escaped;        // The value as a JSON string body
+} LookupContext;
+
+static bool print_lookup_match(const JsonIndexMatch* match, void* context) {
+    LookupContext* lookup = context;
+    lookup->count++;
+    
+    if (match->type == JSON_STRING) {
+        fprintf(output, "%s: \"%s\" (offset %llu)\n", match->path, lookup->escaped,
+                (unsigned long long)match->offset);
+    } else {
+        fprintf(output, "%s: %.*s (offset %llu)\n", match->path, JSON_SLICE_ARGS(match->value),
+                (unsigned long long)match->offset);
+    }
+    return true;
+}
+
+// --lookup: answers from the index file alone, after checking that it
+// was built from the input as it is now
+static bool run_lookup(const Options* opts) {
+    char* name = index_file_name(opts);
+    JsonIndex index;
+    if (!name || !json_index_open(&index, name)) {
+        fprintf(stderr, "Error: Cannot open index file '%s' (build it with --index)\n",
+                name ? name : opts->input_file);
+        free(name);
+        return false;
+    }
+    
+    static const JsonIndexSource unknown = { 0, 0, 0 };
+    JsonIndexSource source = input_identity(opts->input_file);
+    const JsonIndexSource* indexed = &index.header->source;
+    bool ok = memcmp(indexed, &unknown, sizeof(unknown)) == 0 ||
+              memcmp(&source, &unknown, sizeof(unknown)) == 0 ||
+              memcmp(indexed, &source, sizeof(source)) == 0;
+    if (!ok) {
+        fprintf(stderr, "Error: Index file '%s' is out of date (rebuild it with --index)\n", name);
+    }
+    
+    LookupContext lookup = { 0, NULL };
+    if (ok) {
+        lookup.escaped = json_escape_string(opts->lookup);
+        ok = lookup.escaped != NULL;
+    }
+    if (ok) {
+        fprintf(output, "\nIndex Lookup:\n");
+        JsonSlice value = { opts->lookup, strlen(opts->lookup) };
+        ok = json_index_lookup(&index, value, print_lookup_match, &lookup);
+        if (ok) {
+            fprintf(output, "%zu matches\n", lookup.count);
+        } else {
+            fprintf(stderr, "Error: Index file '%s' is corrupt\n", name);
+        }
+    }
+    
+    json_free(lookup.escaped);
+    json_index_close(&index);
+    free(name);
+    return ok;
+}
+
+static bool print_stream_events(JsonParser* parser) {
+    JsonReader reader;
+    JsonEvent event;
+    
+    json_reader_init(&reader, parser);
+    while (json_reader_next(&reader, &event)) {
+        switch (event.type) {
+            case JSON_EVENT_START_OBJECT:
+                fprintf(output, "START_OBJECT\n");
+                break;
+            case JSON_EVENT_END_OBJECT:
+                fprintf(output, "END_OBJECT\n");
+                break;
+            case JSON_EVENT_START_ARRAY:
+                fprintf(output, "START_ARRAY\n");
+                break;
+            case JSON_EVENT_END_ARRAY:
+                fprintf(output, "END_ARRAY\n");
+                break;
+            case JSON_EVENT_KEY:
+                fprintf(output, "FIELD_NAME: \"%.*s\"\n", JSON_SLICE_ARGS(event.text));
+                break;
+            case JSON_EVENT_STRING:
+                fprintf(output, "VALUE_STRING: \"%.*s\"\n", JSON_SLICE_ARGS(event.text));
+                break;
+            case JSON_EVENT_NUMBER:
+                fprintf(output, "VALUE_NUMBER: %.*s\n", JSON_SLICE_ARGS(event.text));
+                break;
+            case JSON_EVENT_BOOL:
+                fprintf(output, "VALUE_BOOLEAN: %.*s\n", JSON_SLICE_ARGS(event.text));
+                break;
+            case JSON_EVENT_NULL:
+                fprintf(output, "VALUE_NULL\n");
+                break;
+            default:
+                break;
+        }
+    }
+    json_reader_release(&reader);
+    
+    return event.type == JSON_EVENT_END;
 }
 
 static void print_validation_result(const JsonParser* parser) {
@@ -225,6 +498,181 @@ static void print_stats(const JsonStats* stats) {
     fprintf(output, "    - Objects: %zu\n", stats->types.object_count);
 }
 
+static void print_length_histogram(const char* label, const size_t* buckets) {
+    fprintf(output, "    %s:", label);
+    const char* separator = " ";
+    for (size_t b = 0; b < JSON_PROFILE_BUCKETS; b++) {
+        if (buckets[b] == 0) continue;
+        
+        size_t low = b == 0 ? 0 : (size_t)1 << (b - 1);
+        if (b < 2) {
+            fprintf(output, "%s%zu: %zu", separator, low, buckets[b]);
+        } else if (b == JSON_PROFILE_BUCKETS - 1) {
+            fprintf(output, "%s%zu+: %zu", separator, low, buckets[b]);
+        } else {
+            fprintf(output, "%s%zu-%zu: %zu", separator, low, 2 * low - 1, buckets[b]);
+        }
+        separator = ", ";
+    }
+    fprintf(output, "\n");
+}
+
+static void print_path_stats(const char* path, const JsonPathStats* stats) {
+    static const char* const type_names[] = { "null", "bool", "number", "string", "array", "object" };
+    
+    fprintf(output, "%s\n", path);
+    fprintf(output, "    count: %zu, bytes: %zu (max %zu)\n", stats->count, stats->bytes, stats->bytes_max);
+    fprintf(output, "    types:");
+    const char* separator = " ";
+    for (size_t t = 0; t <= JSON_OBJECT; t++) {
+        if (stats->types[t] == 0) continue;
+        fprintf(output, "%s%s %zu", separator, type_names[t], stats->types[t]);
+        separator = ", ";
+    }
+    fprintf(output, "\n");
+    
+    if (stats->types[JSON_STRING] > 0) {
+        print_length_histogram("string lengths", stats->string_lengths);
+    }
+    if (stats->types[JSON_NUMBER] > 0) {
+        fprintf(output, "    numbers: min %.15g, max %.15g, mean %.15g\n", stats->number_min,
+                stats->number_max, stats->number_sum / (double)stats->types[JSON_NUMBER]);
+    }
+    if (stats->types[JSON_ARRAY] > 0) {
+        fprintf(output, "    array lengths: min %zu, max %zu, mean %.2f\n", stats->array_min,
+                stats->array_max, (double)stats->array_elements / (double)stats->types[JSON_ARRAY]);
+        print_length_histogram("array length histogram", stats->array_lengths);
+    }
+}
+
+// Orders paths by parent, then [*], members by key and .*
+static int compare_paths(const void* a, const void* b) {
+    const JsonPathStats* x = *(const JsonPathStats* const*)a;
+    const JsonPathStats* y = *(const JsonPathStats* const*)b;
+    
+    if (x->parent != y->parent) return x->parent < y->parent ? -1 : 1;
+    if (x->kind != y->kind) {
+        if (x->kind == JSON_PATH_ELEMENT || y->kind == JSON_PATH_OTHER_MEMBERS) return -1;
+        if (y->kind == JSON_PATH_ELEMENT || x->kind == JSON_PATH_OTHER_MEMBERS) return 1;
+    }
+    
+    size_t length = x->key.length < y->key.length ? x->key.length : y->key.length;
+    int order = length > 0 ? memcmp(x->key.data, y->key.data, length) : 0;
+    if (order != 0) return order;
+    return x->key.length < y->key.length ? -1 : x->key.length > y->key.length;
+}
+
+// Prints every path depth first from the root, siblings sorted so that
+// profiles merged from several threads print the same, and then the
+// overflow path. The path text is built up in one buffer as the walk goes
+// down.
+static bool print_profile(const JsonProfile* profile) {
+    size_t count = profile->path_count;
+    if (count == 0) return true;
+    
+    const JsonPathStats** sorted = malloc(count * sizeof(JsonPathStats*));
+    size_t* first_child = malloc(count * sizeof(size_t));
+    size_t* last_child = malloc(count * sizeof(size_t));
+    size_t* next_sibling = malloc(count * sizeof(size_t));
+    size_t* path_end = malloc(count * sizeof(size_t));
+    size_t capacity = JSON_PATH_MAX_LENGTH;
+    char* path = malloc(capacity);
+    bool ok = sorted && first_child && last_child && next_sibling && path_end && path;
+    
+    for (size_t i = 0; ok && i < count; i++) {
+        sorted[i] = &profile->paths[i];
+        first_child[i] = SIZE_MAX;
+        next_sibling[i] = SIZE_MAX;
+    }
+    if (ok) qsort(sorted, count, sizeof(JsonPathStats*), compare_paths);
+    
+    for (size_t k = 0; ok && k < count; k++) {
+        size_t i = (size_t)(sorted[k] - profile->paths);
+        size_t parent = profile->paths[i].parent;
+        if (parent == SIZE_MAX) continue;
+        
+        if (first_child[parent] == SIZE_MAX) {
+            first_child[parent] = i;
+        } else {
+            next_sibling[last_child[parent]] = i;
+        }
+        last_child[parent] = i;
+    }
+    
+    fprintf(output, "Paths:\n");
+    size_t i = 0;
+    while (ok && i != SIZE_MAX) {
+        const JsonPathStats* stats = &profile->paths[i];
+        size_t start = stats->parent == SIZE_MAX ? 0 : path_end[stats->parent];
+        size_t needed = start + stats->key.length + 5;
+        if (needed > capacity) {
+            while (capacity < needed) capacity *= 2;
+            char* new_path = realloc(path, capacity);
+            if (!new_path) {
+                ok = false;
+                break;
+            }
+            path = new_path;
+        }
+        
+        switch (stats->kind) {
+            case JSON_PATH_MEMBER: {
+                // Quoted as --flatten quotes it, so paths stay unambiguous
+                bool plain = json_path_name_is_plain(stats->key);
+                size_t end = start;
+                if (plain) {
+                    path[end++] = '.';
+                } else {
+                    memcpy(path + end, "[\"", 2);
+                    end += 2;
+                }
+                if (stats->key.length > 0) memcpy(path + end, stats->key.data, stats->key.length);
+                end += stats->key.length;
+                if (!plain) {
+                    memcpy(path + end, "\"]", 2);
+                    end += 2;
+                }
+                path[end] = '\0';
+                path_end[i] = end;
+                break;
+            }
+            case JSON_PATH_ELEMENT:
+                path_end[i] = start + (size_t)sprintf(path + start, "[*]");
+                break;
+            case JSON_PATH_OTHER_MEMBERS:
+                path_end[i] = start + (size_t)sprintf(path + start, ".*");
+                break;
+            default:
+                path_end[i] = start + (size_t)sprintf(path + start, "$");
+                break;
+        }
+        print_path_stats(path, stats);
+        
+        // Next in depth-first order: the first child, or else the next
+        // sibling of this path or of its nearest ancestor that has one
+        if (first_child[i] != SIZE_MAX) {
+            i = first_child[i];
+        } else {
+            while (i != SIZE_MAX && next_sibling[i] == SIZE_MAX) i = profile->paths[i].parent;
+            if (i != SIZE_MAX) i = next_sibling[i];
+        }
+    }
+    
+    for (size_t k = 0; ok && k < count; k++) {
+        if (profile->paths[k].kind == JSON_PATH_OVERFLOW) {
+            print_path_stats("(other paths)", &profile->paths[k]);
+        }
+    }
+    
+    free(sorted);
+    free(first_child);
+    free(last_child);
+    free(next_sibling);
+    free(path_end);
+    free(path);
+    return ok;
+}
+
 static void print_highlighted_value(const TreeNode* node, int indent) {
     for (int i = 0; i < indent; i++) fprintf(output, " ");
     
@@ -233,13 +681,13 @@ static void print_highlighted_value(const TreeNode* node, int indent) {
             fprintf(output, "%s%s%s", COLOR_BLUE, "null", COLOR_RESET);
             break;
         case JSON_BOOL:
-            fprintf(output, "%s%s%s", COLOR_BLUE, node->value, COLOR_RESET);
+            fprintf(output, "%s%.*s%s", COLOR_BLUE, JSON_SLICE_ARGS(node->value), COLOR_RESET);
             break;
         case JSON_NUMBER:
-            fprintf(output, "%s%s%s", COLOR_BLUE, node->value, COLOR_RESET);
+            fprintf(output, "%s%.*s%s", COLOR_BLUE, JSON_SLICE_ARGS(node->value), COLOR_RESET);
             break;
         case JSON_STRING:
-            fprintf(output, "%s\"%s\"%s", COLOR_YELLOW, node->value, COLOR_RESET);
+            fprintf(output, "%s\"%.*s\"%s", COLOR_YELLOW, JSON_SLICE_ARGS(node->value), COLOR_RESET);
             break;
         case JSON_ARRAY:
             fprintf(output, "%s[%s\n", COLOR_WHITE, COLOR_RESET);
@@ -259,7 +707,7 @@ static void print_highlighted_value(const TreeNode* node, int indent) {
             for (size_t i = 0; i < node->children_count; i++) {
                 const TreeNode* child = node->children[i];
                 for (int j = 0; j < indent + 4; j++) fprintf(output, " ");
-                fprintf(output, "%s\"%s\"%s%s: %s", COLOR_GREEN, child->name,
+                fprintf(output, "%s\"%.*s\"%s%s: %s", COLOR_GREEN, JSON_SLICE_ARGS(child->name),
                        COLOR_RESET, COLOR_WHITE, COLOR_RESET);
                 print_highlighted_value(child, 0);
                 if (i < node->children_count - 1) {
@@ -274,10 +722,12 @@ static void print_highlighted_value(const TreeNode* node, int indent) {
     }
 }
 
-static void print_editable_node(const TreeNode* node) {
+static void print_editable_node(const TreeNode* node, size_t index) {
     fprintf(output, "EditableNode {\n");
-    if (node->name) {
-        fprintf(output, "    \"key\": \"%s\",\n", node->name);
+    if (node->name.data) {
+        fprintf(output, "    \"key\": \"%.*s\",\n", JSON_SLICE_ARGS(node->name));
+    } else if (node->parent && node->parent->type == JSON_ARRAY) {
+        fprintf(output, "    \"key\": \"%zu\",\n", index);
     }
     fprintf(output, "    \"type\": \"%s\",\n",
            node->type == JSON_NULL ? "NULL" :
@@ -286,15 +736,15 @@ static void print_editable_node(const TreeNode* node) {
            node->type == JSON_STRING ? "STRING" :
            node->type == JSON_ARRAY ? "ARRAY" : "OBJECT");
     
-    if (node->value) {
-        fprintf(output, "    \"value\": \"%s\",\n", node->value);
+    if (node->value.data) {
+        fprintf(output, "    \"value\": \"%.*s\",\n", JSON_SLICE_ARGS(node->value));
     }
     
     fprintf(output, "    \"children\": [");
     if (node->children_count > 0) {
         fprintf(output, "\n");
         for (size_t i = 0; i < node->children_count; i++) {
-            print_editable_node(node->children[i]);
+            print_editable_node(node->children[i], i);
             if (i < node->children_count - 1) fprintf(output, ",");
             fprintf(output, "\n");
         }
@@ -303,32 +753,463 @@ static void print_editable_node(const TreeNode* node) {
     fprintf(output, "]\n}");
 }
 
-static void build_index(const TreeNode* node, const char* path) {
-    char new_path[JSON_PATH_MAX_LENGTH];
-    
-    if (node->name) {
-        snprintf(new_path, sizeof(new_path), "%s.%s", path, node->name);
-    } else {
-        strncpy(new_path, path, sizeof(new_path));
-    }
+// print_highlighted_value() for the tape entry at `i`
+static void print_highlighted_entry(const JsonTape* tape, size_t i, int indent) {
+    const JsonTapeEntry* entry = &tape->entries[i];
+    for (int k = 0; k < indent; k++) fprintf(output, " ");
     
-    switch (node->type) {
-        case JSON_STRING:
-        case JSON_NUMBER:
-        case JSON_BOOL:
+    switch (entry->type) {
         case JSON_NULL:
-            fprintf(output, "\"%s\" => [%s]\n", node->value, new_path);
+            fprintf(output, "%s%s%s", COLOR_BLUE, "null", COLOR_RESET);
+            break;
+        case JSON_BOOL:
+        case JSON_NUMBER:
+            fprintf(output, "%s%.*s%s", COLOR_BLUE, JSON_SLICE_ARGS(json_tape_slice(tape, entry->value)),
+                   COLOR_RESET);
+            break;
+        case JSON_STRING:
+            fprintf(output, "%s\"%.*s\"%s", COLOR_YELLOW, JSON_SLICE_ARGS(json_tape_slice(tape, entry->value)),
+                   COLOR_RESET);
             break;
-            
         case JSON_ARRAY:
         case JSON_OBJECT:
-            for (size_t i = 0; i < node->children_count; i++) {
-                build_index(node->children[i], new_path);
+            fprintf(output, "%s%c%s\n", COLOR_WHITE, entry->type == JSON_ARRAY ? '[' : '{', COLOR_RESET);
+            for (size_t child = i + 1; child < entry->end; child = tape->entries[child].end) {
+                const JsonTapeEntry* value = &tape->entries[child];
+                if (entry->type == JSON_OBJECT) {
+                    for (int k = 0; k < indent + 4; k++) fprintf(output, " ");
+                    fprintf(output, "%s\"%.*s\"%s%s: %s", COLOR_GREEN, JSON_SLICE_ARGS(json_tape_slice(tape, value->name)),
+                           COLOR_RESET, COLOR_WHITE, COLOR_RESET);
+                    print_highlighted_entry(tape, child, 0);
+                } else {
+                    print_highlighted_entry(tape, child, indent + 4);
+                }
+                if (value->end < entry->end) {
+                    fprintf(output, "%s,%s\n", COLOR_WHITE, COLOR_RESET);
+                } else {
+                    fprintf(output, "\n");
+                }
             }
+            for (int k = 0; k < indent; k++) fprintf(output, " ");
+            fprintf(output, "%s%c%s", COLOR_WHITE, entry->type == JSON_ARRAY ? ']' : '}', COLOR_RESET);
             break;
     }
 }
 
+// print_editable_node() for the tape entry at `i`, member or element
+// `index` of `parent`, which is NULL for the root
+static void print_editable_entry(const JsonTape* tape, size_t i, size_t index, const JsonTapeEntry* parent) {
+    const JsonTapeEntry* entry = &tape->entries[i];
+    bool scalar = entry->type != JSON_ARRAY && entry->type != JSON_OBJECT;
+    fprintf(output, "EditableNode {\n");
+    if (parent && parent->type == JSON_OBJECT) {
+        fprintf(output, "    \"key\": \"%.*s\",\n", JSON_SLICE_ARGS(json_tape_slice(tape, entry->name)));
+    } else if (parent) {
+        fprintf(output, "    \"key\": \"%zu\",\n", index);
+    }
+    fprintf(output, "    \"type\": \"%s\",\n",
+           entry->type == JSON_NULL ? "NULL" :
+           entry->type == JSON_BOOL ? "BOOL" :
+           entry->type == JSON_NUMBER ? "NUMBER" :
+           entry->type == JSON_STRING ? "STRING" :
+           entry->type == JSON_ARRAY ? "ARRAY" : "OBJECT");
+    
+    if (scalar) {
+        fprintf(output, "    \"value\": \"%.*s\",\n", JSON_SLICE_ARGS(json_tape_slice(tape, entry->value)));
+    }
+    
+    fprintf(output, "    \"children\": [");
+    if (entry->end > i + 1) {
+        fprintf(output, "\n");
+        size_t n = 0;
+        for (size_t child = i + 1; child < entry->end; child = tape->entries[child].end) {
+            print_editable_entry(tape, child, n++, entry);
+            if (tape->entries[child].end < entry->end) fprintf(output, ",");
+            fprintf(output, "\n");
+        }
+        fprintf(output, "    ");
+    }
+    fprintf(output, "]\n}");
+}
+
+static bool needs_tree(const Options* opts) {
+    return opts->tree || opts->highlight || opts->edit;
+}
+
+// What --tree, --highlight and --edit run over: a node tree, or with
+// --tape a tape
+typedef struct {
+    TreeNode* root;
+    JsonTape* tape;
+} Document;
+
+static bool parse_document(const Options* opts, JsonParser* parser, Document* doc) {
+    doc->root = NULL;
+    doc->tape = NULL;
+    if (opts->tape) {
+        doc->tape = json_parse_tape(parser);
+        return doc->tape != NULL;
+    }
+    doc->root = json_parse_tree(parser);
+    return doc->root != NULL;
+}
+
+// --cache: maps the tape saved by an earlier run on the same unchanged
+// file, or parses the input into a tape and saves it for the next run.
+// Inputs that cannot be mapped are only parsed.
+static bool load_document(const Options* opts, const JsonInput* input, JsonParser* parser, Document* doc) {
+    doc->root = NULL;
+    doc->tape = NULL;
+    char* path = input->mapped ? cache_file_name(opts) : NULL;
+    JsonIndexSource source = input_identity(opts->input_file);
+    if (path) doc->tape = json_tape_load(path, input->data, input->size, &source);
+    
+    if (!doc->tape) {
+        doc->tape = json_parse_tape(parser);
+        if (doc->tape && path && !json_tape_save(doc->tape, path, input->data, input->size, &source)) {
+            fprintf(stderr, "Warning: Cannot write cache file '%s'\n", path);
+        }
+    }
+    free(path);
+    return doc->tape != NULL;
+}
+
+static void release_document(Document* doc) {
+    if (doc->root) tree_node_destroy(doc->root);
+    json_tape_destroy(doc->tape);
+}
+
+static void print_document_tree(const Document* doc) {
+    if (doc->tape) {
+        json_print_tape(doc->tape, output);
+    } else {
+        json_print_tree(doc->root, output);
+    }
+}
+
+// Streams the formatted document to the output as it is produced
+static bool print_formatted(const Document* doc, size_t indent) {
+    JsonWriter writer;
+    if (!json_writer_init_file(&writer, output)) return false;
+    
+    if (doc->tape) {
+        json_write_tape(doc->tape, indent, &writer);
+    } else {
+        json_write_tree(doc->root, indent, &writer);
+    }
+    return json_writer_finish(&writer);
+}
+
+static void print_highlighted(const Document* doc, bool color, size_t indent) {
+    if (!color) {
+        print_formatted(doc, indent);
+    } else if (doc->tape) {
+        print_highlighted_entry(doc->tape, 0, 0);
+    } else {
+        print_highlighted_value(doc->root, 0);
+    }
+}
+
+static void print_editable(const Document* doc) {
+    if (doc->tape) {
+        print_editable_entry(doc->tape, 0, 0, NULL);
+    } else {
+        print_editable_node(doc->root, 0);
+    }
+}
+
+// Formats the document straight from the input
+static bool print_pretty(JsonParser* parser, size_t indent) {
+    JsonWriter writer;
+    if (!json_writer_init_file(&writer, output)) return false;
+    
+    bool ok = json_write_pretty(parser, indent, &writer);
+    return json_writer_finish(&writer) && ok;
+}
+
+// Minifies the document straight from the input
+static bool print_compact(JsonParser* parser) {
+    JsonWriter writer;
+    if (!json_writer_init_file(&writer, output)) return false;
+    
+    bool ok = json_minify(parser, &writer);
+    ok = json_writer_finish(&writer) && ok;
+    fprintf(output, "\n");
+    return ok;
+}
+
+// Writes the values the query selects, one per line
+static bool print_query(JsonParser* parser, const JsonQuery* query) {
+    JsonWriter writer;
+    if (!json_writer_init_file(&writer, output)) return false;
+    
+    bool ok = json_query_run(query, parser, &writer, NULL);
+    return json_writer_finish(&writer) && ok;
+}
+
+// Writes a "PATH: VALUE" line per scalar, paths starting at `root`
+static bool print_flat(JsonParser* parser, const char* root) {
+    JsonWriter writer;
+    if (!json_writer_init_file(&writer, output)) return false;
+    
+    bool ok = json_write_flat(parser, root, &writer);
+    return json_writer_finish(&writer) && ok;
+}
+
+// Converts the document straight from the input
+static bool print_binary(JsonParser* parser, JsonBinaryFormat format) {
+    JsonWriter writer;
+    if (!json_writer_init_file(&writer, output)) return false;
+    
+    bool ok = json_write_binary(parser, format, &writer);
+    return json_writer_finish(&writer) && ok;
+}
+
+static void print_flat_error(const char* error, size_t line) {
+    if (!error) {
+        fprintf(stderr, "Error: Out of memory\n");
+    } else if (line == 0) {
+        fprintf(stderr, "Error: Invalid flattened input: %s\n", error);
+    } else {
+        fprintf(stderr, "Error: Invalid flattened input on line %zu: %s\n", line, error);
+    }
+}
+
+// --unflatten --compact on its own: the lines are read as they come and
+// the JSON written as its containers close, never holding either whole.
+// The other modes parse the result, so they go through decode_input().
+static bool run_unflatten(const Options* opts) {
+    FILE* source = strcmp(opts->input_file, "-") == 0 ? stdin : fopen(opts->input_file, "r");
+    if (!source) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", opts->input_file);
+        return false;
+    }
+    
+    fprintf(output, "\nCompact JSON:\n");
+    JsonWriter writer;
+    if (!json_writer_init_file(&writer, output)) {
+        if (source != stdin) fclose(source);
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    
+    const char* error = NULL;
+    size_t line = 0;
+    bool ok = json_read_flat_stream(source, &writer, &error, &line);
+    ok = json_writer_finish(&writer) && ok;
+    if (source != stdin) fclose(source);
+    if (!ok) print_flat_error(error, line);
+    return ok;
+}
+
+// --from and --unflatten: replace the input with its JSON text, a line per
+// item, which every mode then reads as if it were the input
+static bool decode_input(const Options* opts, JsonInput* input) {
+    JsonWriter writer;
+    if (!json_writer_init_memory(&writer)) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return false;
+    }
+    
+    const char* error = NULL;
+    size_t offset = 0;
+    bool ok = opts->unflatten ?
+        json_read_flat(input->data, input->size, &writer, &error, &offset) :
+        json_read_binary(input->data, input->size, opts->from, &writer, &error, &offset);
+    size_t size = writer.size;
+    char* text = json_writer_take(&writer);
+    if (!ok || !text) {
+        if (opts->unflatten) {
+            print_flat_error(error, offset);
+        } else if (error) {
+            fprintf(stderr, "Error: Invalid %s input at byte %zu: %s\n",
+                    opts->from == JSON_BINARY_CBOR ? "CBOR" : "MessagePack", offset, error);
+        } else {
+            fprintf(stderr, "Error: Out of memory\n");
+        }
+        json_free(text);
+        return false;
+    }
+    
+    // Compact JSON has no raw newlines: each one ends an item
+    if (!opts->lines && memchr(text, '\n', size) != text + size - 1) {
+        fprintf(stderr, "Error: The input holds several items; use --lines to read them as records\n");
+        json_free(text);
+        return false;
+    }
+    
+    json_input_close(input);
+    input->data = text;
+    input->size = size;
+    input->mapped = false;
+    return true;
+}
+
+// --lines results of one worker thread, summed up at the end
+typedef struct {
+    JsonProfile profile;
+    JsonIndexBuilder* index;
+    bool index_failed;
+    size_t records;
+    size_t invalid;
+} LineTotals;
+
+typedef struct {
+    const Options* opts;
+    LineTotals* totals;
+    const char* data;     // Start of the input, for index offsets
+    bool color;
+} LinesContext;
+
+// Runs the requested modes on one --lines record, without section headers.
+// Each record is validated before anything is printed for it, so output is
+// never partial; its --flatten and --index paths start at the record index.
+static void process_record(const JsonLineRecord* record, FILE* out, void* context) {
+    const LinesContext* lines = context;
+    const Options* opts = lines->opts;
+    LineTotals* totals = &lines->totals[record->worker];
+    output = out;
+    totals->records++;
+    
+    JsonParser* parser = json_parser_create_borrowed(record->text.data, record->text.length);
+    if (!parser) {
+        totals->invalid++;
+        return;
+    }
+    parser->engine = opts->engine;
+    parser->workers = 1; // Records already run on the worker pool
+    
+    Document doc = { NULL, NULL };
+    bool ok;
+    if (needs_tree(opts)) {
+        ok = parse_document(opts, parser, &doc);
+    } else {
+        ok = json_validate(parser);
+    }
+    
+    if (!ok) {
+        totals->invalid++;
+        if (opts->validate && parser->error_count > 0) {
+            fprintf(out, "Line %zu, column %zu: %s\n", record->line,
+                   parser->errors[0].position.column, parser->errors[0].message);
+        } else if (!opts->validate) {
+            fprintf(stderr, "Error: Failed to parse JSON on line %zu\n", record->line);
+        }
+        json_parser_destroy(parser);
+        return;
+    }
+    
+    char root_path[32];
+    if (opts->tree) print_document_tree(&doc);
+    if (opts->pretty) print_pretty(parser, opts->indent);
+    if (opts->compact) print_compact(parser);
+    if (opts->flatten) {
+        snprintf(root_path, sizeof(root_path), "$[%zu]", record->index);
+        print_flat(parser, root_path);
+    }
+    if (opts->stream) print_stream_events(parser);
+    if (opts->query) print_query(parser, opts->query);
+    if (opts->to_binary) print_binary(parser, opts->to);
+    if (opts->stats) json_profile_add(&totals->profile, parser);
+    if (opts->highlight) {
+        print_highlighted(&doc, lines->color, opts->indent);
+        if (lines->color) fprintf(out, "\n");
+    }
+    if (opts->edit) {
+        print_editable(&doc);
+        fprintf(out, "\n");
+    }
+    if (opts->index &&
+        !json_index_add(totals->index, parser, (size_t)(record->text.data - lines->data), record->index)) {
+        totals->index_failed = true;
+    }
+    
+    release_document(&doc);
+    json_parser_destroy(parser);
+}
+
+// --lines: processes the records on a worker pool, then prints the totals
+static int run_lines(const Options* opts, const JsonInput* input) {
+    size_t workers = opts->jobs > 0 ? opts->jobs : json_lines_default_workers();
+    LineTotals* totals = calloc(workers + 1, sizeof(LineTotals));
+    bool ok = totals != NULL;
+    for (size_t i = 0; ok && i <= workers; i++) {
+        ok = json_profile_init(&totals[i].profile);
+        if (ok && opts->index) {
+            totals[i].index = json_index_builder_create();
+            ok = totals[i].index != NULL;
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Out of memory\n");
+        for (size_t i = 0; totals && i <= workers; i++) {
+            json_profile_release(&totals[i].profile);
+            json_index_builder_destroy(totals[i].index);
+        }
+        free(totals);
+        return 1;
+    }
+    
+    LinesContext context = {
+        .opts = opts,
+        .totals = totals,
+        .data = input->data,
+        .color = opts->highlight && !opts->no_color && isatty(fileno(output))
+    };
+    ok = json_lines_process(input->data, input->size, workers, !opts->unordered,
+                            process_record, &context, output);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to process JSON Lines input\n");
+    }
+    
+    // The extra entry past the workers collects the sum
+    LineTotals* sum = &totals[workers];
+    for (size_t i = 0; i < workers; i++) {
+        if (opts->stats && !json_profile_merge(&sum->profile, &totals[i].profile)) ok = false;
+        if (opts->index && (totals[i].index_failed || !json_index_merge(sum->index, totals[i].index))) {
+            sum->index_failed = true;
+        }
+        json_profile_release(&totals[i].profile);
+        json_index_builder_destroy(totals[i].index);
+        sum->records += totals[i].records;
+        sum->invalid += totals[i].invalid;
+    }
+    
+    if (opts->validate) {
+        fprintf(output, "\nValidation Result:\n");
+        if (sum->invalid == 0) {
+            fprintf(output, "Valid JSON Lines (%zu records).\n", sum->records);
+        } else {
+            fprintf(output, "%zu of %zu records invalid.\n", sum->invalid, sum->records);
+        }
+    }
+    
+    if (opts->stats) {
+        fprintf(output, "\nJSON Statistics:\n");
+        fprintf(output, "Records: %zu\n", sum->records - sum->invalid);
+        print_stats(&sum->profile.totals);
+        print_profile(&sum->profile);
+    }
+    
+    // Invalid records are left out of the index, like they are of the totals
+    if (opts->index) {
+        fprintf(output, "\nSearchable Index:\n");
+        if (sum->index_failed) {
+            fprintf(stderr, "Error: Out of memory while indexing\n");
+            ok = false;
+        } else if (!save_index(opts, sum->index)) {
+            ok = false;
+        }
+    }
+    if (opts->lookup && ok && !run_lookup(opts)) ok = false;
+    
+    int status = ok && (opts->validate || sum->invalid == 0) ? 0 : 1;
+    json_profile_release(&sum->profile);
+    json_index_builder_destroy(sum->index);
+    free(totals);
+    return status;
+}
+
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         print_usage(argv[0]);
@@ -347,87 +1228,131 @@ int main(int argc, char* argv[]) {
         }
     }
     
-    // Read input file
-    FILE* fp = fopen(opts.input_file, "rb");
-    if (!fp) {
-        fprintf(stderr, "Error: Cannot open file '%s'\n", opts.input_file);
-        if (output != stdout) fclose(output);
+    if (opts.to_binary && isatty(fileno(output))) {
+        fprintf(stderr, "Error: Refusing to write binary output to a terminal; use -o FILE\n");
         return 1;
     }
     
-    fseek(fp, 0, SEEK_END);
-    size_t size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+    // A lookup on its own never reads the input
+    if (!has_modes(&opts)) {
+        int status = run_lookup(&opts) ? 0 : 1;
+        if (output != stdout) fclose(output);
+        return status;
+    }
+    
+    // Only the tree-based modes build a tree. --validate, --flatten,
+    // --stream, --query, --stats and --index read the input as events, in
+    // constant memory; without --validate they report parse errors as they
+    // hit them.
+    bool need_tree = needs_tree(&opts);
+    // MessagePack output takes two passes, to count the containers first
+    int event_passes = opts.validate + opts.pretty + opts.compact + opts.flatten + opts.stream +
+                       (opts.query != NULL) + opts.stats + opts.index +
+                       (opts.to_binary ? (opts.to == JSON_BINARY_MSGPACK ? 2 : 1) : 0);
     
-    char* input = malloc(size + 1);
-    if (!input) {
-        fprintf(stderr, "Error: Out of memory\n");
-        fclose(fp);
+    if (opts.unflatten && opts.compact && !need_tree && event_passes == 1 && !opts.lines) {
+        int status = run_unflatten(&opts) ? 0 : 1;
+        json_query_destroy(opts.query);
+        if (output != stdout) fclose(output);
+        return status;
+    }
+    
+    // Map the input file. Pipes and standard input are read into memory,
+    // unless a single event pass is all that is needed: then they are
+    // parsed chunk by chunk as they arrive. Binary input is decoded whole.
+    JsonInput input;
+    bool opened = !need_tree && event_passes == 1 && !opts.lines && !opts.from_binary && !opts.unflatten ?
+        json_input_open_stream(&input, opts.input_file) :
+        json_input_open(&input, opts.input_file);
+    if (!opened) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", opts.input_file);
+        json_query_destroy(opts.query);
         if (output != stdout) fclose(output);
         return 1;
     }
     
-    if (fread(input, 1, size, fp) != size) {
-        fprintf(stderr, "Error: Failed to read file\n");
-        free(input);
-        fclose(fp);
+    if ((opts.from_binary || opts.unflatten) && !decode_input(&opts, &input)) {
+        json_input_close(&input);
+        json_query_destroy(opts.query);
         if (output != stdout) fclose(output);
         return 1;
     }
-    input[size] = '\0';
-    fclose(fp);
     
-    // Parse JSON
-    JsonParser* parser = json_parser_create(input, size);
+    if (opts.lines) {
+        int status = run_lines(&opts, &input);
+        json_input_close(&input);
+        json_query_destroy(opts.query);
+        if (output != stdout) fclose(output);
+        return status;
+    }
+    
+    // Parse JSON directly from the input buffer
+    JsonParser* parser = input.stream ?
+        json_parser_create_stream(input.stream) :
+        json_parser_create_borrowed(input.data, input.size);
     if (!parser) {
         fprintf(stderr, "Error: Failed to create parser\n");
-        free(input);
+        json_input_close(&input);
+        json_query_destroy(opts.query);
         if (output != stdout) fclose(output);
         return 1;
     }
     
-    TreeNode* root = json_parse_tree(parser);
-    if (!root && !opts.validate) {
+    parser->engine = opts.engine;
+    parser->workers = opts.jobs;
+    
+    Document doc = { NULL, NULL };
+    bool ok = true;
+    if (need_tree && opts.cache) {
+        ok = load_document(&opts, &input, parser, &doc);
+    } else if (need_tree) {
+        ok = parse_document(&opts, parser, &doc);
+    } else if (opts.validate) {
+        ok = json_validate(parser);
+    }
+    
+    if (!ok && !opts.validate) {
         fprintf(stderr, "Error: Failed to parse JSON\n");
         json_parser_destroy(parser);
-        free(input);
+        json_input_close(&input);
+        json_query_destroy(opts.query);
         if (output != stdout) fclose(output);
         return 1;
     }
     
     // Process each requested output format
-    if (opts.tree && root) {
+    if (opts.tree && ok) {
         fprintf(output, "\nTree Structure:\n");
-        json_print_tree(root, output);
+        print_document_tree(&doc);
     }
     
-    if (opts.pretty && root) {
+    if (opts.pretty && ok) {
         fprintf(output, "\nFormatted JSON:\n");
-        char* formatted = json_format(parser, opts.indent);
-        if (formatted) {
-            fprintf(output, "%s", formatted);
-            json_free(formatted);
-        }
+        ok = print_pretty(parser, opts.indent);
     }
     
-    if (opts.compact && root) {
+    if (opts.compact && ok) {
         fprintf(output, "\nCompact JSON:\n");
-        char* compact = json_compact(parser);
-        if (compact) {
-            fprintf(output, "%s\n", compact);
-            json_free(compact);
-        }
+        ok = print_compact(parser);
     }
     
-    if (opts.flatten && root) {
+    if (opts.flatten && ok) {
         fprintf(output, "\nFlattened Key-Value Pairs:\n");
-        char path[JSON_PATH_MAX_LENGTH] = "$";
-        print_path_value(root, path, 1);
+        ok = print_flat(parser, "$");
     }
     
-    if (opts.stream && root) {
+    if (opts.stream && ok) {
         fprintf(output, "\nParsing Events Stream:\n");
-        print_stream_events(root);
+        ok = print_stream_events(parser);
+    }
+    
+    if (opts.query && ok) {
+        fprintf(output, "\nQuery Results:\n");
+        ok = print_query(parser, opts.query);
+    }
+    
+    if (opts.to_binary && ok) {
+        ok = print_binary(parser, opts.to);
     }
     
     if (opts.validate) {
@@ -435,44 +1360,58 @@ int main(int argc, char* argv[]) {
         print_validation_result(parser);
     }
     
-    if (opts.stats && root) {
-        fprintf(output, "\nJSON Statistics:\n");
-        JsonStats stats = json_stats(parser);
-        print_stats(&stats);
+    if (opts.stats && ok) {
+        JsonProfile profile;
+        ok = json_profile_init(&profile) && json_profile_add(&profile, parser);
+        if (ok) {
+            fprintf(output, "\nJSON Statistics:\n");
+            print_stats(&profile.totals);
+            ok = print_profile(&profile);
+        }
+        json_profile_release(&profile);
     }
     
-    if (opts.highlight && root) {
+    if (opts.highlight && ok) {
         fprintf(output, "\nSyntax Highlighted JSON:\n");
-        if (!opts.no_color && isatty(fileno(output))) {
-            print_highlighted_value(root, 0);
-        } else {
-            // Fallback to pretty print if no color support
-            char* formatted = json_format(parser, opts.indent);
-            if (formatted) {
-                fprintf(output, "%s", formatted);
-                json_free(formatted);
-            }
-        }
+        // Falls back to pretty printing without color support
+        print_highlighted(&doc, !opts.no_color && isatty(fileno(output)), opts.indent);
         fprintf(output, "\n");
     }
     
-    if (opts.edit && root) {
+    if (opts.edit && ok) {
         fprintf(output, "\nEditable Node Structure:\n");
-        print_editable_node(root);
+        print_editable(&doc);
         fprintf(output, "\n");
     }
     
-    if (opts.index && root) {
-        fprintf(output, "\nSearchable Index:\n");
-        build_index(root, "$");
+    bool index_ok = true;
+    if (opts.index && ok) {
+        JsonIndexBuilder* builder = json_index_builder_create();
+        ok = builder && json_index_add(builder, parser, 0, JSON_INDEX_DOCUMENT);
+        if (ok) {
+            fprintf(output, "\nSearchable Index:\n");
+            index_ok = save_index(&opts, builder);
+        }
+        json_index_builder_destroy(builder);
+    }
+    
+    // --lookup runs last, so it can use an index built by this run
+    if (opts.lookup && ok && index_ok) index_ok = run_lookup(&opts);
+    
+    // A streaming mode stopped at a parse error
+    int status = index_ok ? 0 : 1;
+    if (!ok && !opts.validate) {
+        fprintf(stderr, "Error: Failed to parse JSON\n");
+        status = 1;
     }
     
     // Cleanup
-    if (root) tree_node_destroy(root);
+    release_document(&doc);
     json_parser_destroy(parser);
-    free(input);
+    json_input_close(&input);
+    json_query_destroy(opts.query);
     if (output != stdout) fclose(output);
     
-    return 0;
+    return status;
 } 
 
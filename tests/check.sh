@@ -0,0 +1,86 @@
+#!/bin/sh
+# Round trips and edge cases through the command line, run by `make check`
+# with the binary to test as the first argument. Every failure is reported
+# before the script exits non-zero.
+
+BIN=${1:-./jsonchrist}
+DATA=$(dirname "$0")/data
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+failures=0
+
+fail() {
+    printf 'FAIL: %s\n' "$*" >&2
+    failures=$((failures + 1))
+}
+
+# Output of a mode without the heading the tool prints before it
+run() {
+    "$BIN" "$@" | tail -n +3
+}
+
+expect() {
+    [ "$2" = "$3" ] || fail "$1: got '$3', expected '$2'"
+}
+
+# Every document comes back unchanged from each way out and back in
+for file in "$DATA"/*.json; do
+    name=$(basename "$file")
+    compact=$(run --compact "$file")
+    [ -n "$compact" ] || fail "$name: no compact output"
+
+    expect "$name: --pretty" "$compact" "$(run --pretty "$file" | run --compact -)"
+    expect "$name: --compact twice" "$compact" "$(run --compact "$file" | run --compact -)"
+
+    run --flatten "$file" > "$TMP/flat"
+    expect "$name: --unflatten" "$compact" "$(run --unflatten --compact "$TMP/flat")"
+    expect "$name: --unflatten from stdin" "$compact" "$(run --unflatten --compact - < "$TMP/flat")"
+    expect "$name: --unflatten --pretty" "$compact" "$(run --unflatten --pretty "$TMP/flat" | run --compact -)"
+
+    # Binary formats keep values, not lexemes: the decoded text must then
+    # survive a second trip unchanged
+    for format in cbor msgpack; do
+        "$BIN" --to $format -o "$TMP/first" "$file" || fail "$name: --to $format"
+        run --from $format --compact "$TMP/first" > "$TMP/decoded"
+        "$BIN" --to $format -o "$TMP/second" "$TMP/decoded" || fail "$name: --to $format, decoded"
+        expect "$name: $format twice" "$(cat "$TMP/decoded")" "$(run --from $format --compact "$TMP/second")"
+    done
+done
+
+# Numbers keep their lexemes through text modes and their values through
+# binary ones: int64 and uint64 exactly, -0 as a negative zero, doubles
+# at their nearest, and infinities, which JSON cannot write, as null
+numbers="$DATA/numbers.json"
+expect "numbers: --compact" \
+    '[0,-0,-0.0,1,-1,0.1,1E+2,1e-7,0.30000000000000004,1.7976931348623157e308,-1.7976931348623157e308,2.2250738585072014e-308,4.9406564584124654e-324,2.4703282292062327e-324,9007199254740991,9007199254740992,9007199254740993,9223372036854775807,9223372036854775808,-9223372036854775808,-9223372036854775809,18446744073709551615,18446744073709551616,123456789012345678901234567890,1e400,-1e400,1e-400,-1e-400]' \
+    "$(run --compact "$numbers")"
+for format in cbor msgpack; do
+    "$BIN" --to $format -o "$TMP/numbers" "$numbers"
+    expect "numbers: $format" \
+        '[0,-0.0,-0.0,1,-1,0.1,100.0,1e-07,0.30000000000000004,1.7976931348623157e+308,-1.7976931348623157e+308,2.2250738585072014e-308,4.94065645841247e-324,0.0,9007199254740991,9007199254740992,9007199254740993,9223372036854775807,9223372036854775808,-9223372036854775808,-9.223372036854776e+18,18446744073709551615,1.8446744073709552e+19,1.2345678901234568e+29,null,null,0.0,-0.0]' \
+        "$(run --from $format --compact "$TMP/numbers")"
+done
+expect "numbers: --query" "9223372036854775808" "$(run --query '$[18]' "$numbers")"
+expect "numbers: --flatten" '$[1]: -0' "$(run --flatten "$numbers" | sed -n 2p)"
+
+# \u escapes in keys and values match their decoded text
+escapes="$DATA/escapes.json"
+cafe=$(printf 'caf\303\251')
+expect "escapes: --query by name" "1" "$(run --query '$.a' "$escapes")"
+expect "escapes: --query by quoted name" '"caf\u00e9"' "$(run --query "\$[\"$cafe\"]" "$escapes")"
+expect "escapes: --query through names" '"\u0020"' "$(run --query "\$.nested[\"$(printf '\303\251t\303\251')\"].deep" "$escapes")"
+
+"$BIN" --index --index-file "$TMP/index" "$escapes" > /dev/null || fail "escapes: --index"
+lookup() {
+    "$BIN" --lookup "$1" --index-file "$TMP/index" "$escapes" | sed -e 1,2d -e '$d'
+}
+expect "escapes: --lookup of an escaped value" "$(printf '$.caf\303\251: "caf\303\251" (offset 27)\n$.plain: "caf\303\251" (offset 49)')" "$(lookup "$cafe")"
+expect "escapes: --lookup with a surrogate pair" "$(printf '$["emoji \360\237\230\200"]: "\360\237\230\200" (offset 80)')" "$(lookup "$(printf '\360\237\230\200')")"
+expect "escapes: --lookup under a quoted name" '$["q\"uote"][1]: "ABC" (offset 116)' "$(lookup ABC)"
+expect "escapes: --lookup of an escaped space" "$(printf '$.nested.\303\251t\303\251.deep: " " (offset 166)')" "$(lookup ' ')"
+
+if [ $failures -gt 0 ]; then
+    echo "$failures check(s) failed" >&2
+    exit 1
+fi
+echo "Command line checks passed"
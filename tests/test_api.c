@@ -0,0 +1,337 @@
+#include "json_parser.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Checks of the library API, run by `make check`. Each failed check prints
+// its line and the test goes on, so one run reports every failure.
+
+static int failures = 0;
+
+#define CHECK(condition, ...) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static JsonSlice slice(const char* text) {
+    return (JsonSlice){ text, strlen(text) };
+}
+
+static bool same_double(double a, double b) {
+    return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+// --- Numbers ---
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+typedef struct {
+    const char* text;
+    JsonNumberType type;
+    int64_t i;
+    uint64_t u;
+    double d;
+} NumberCase;
+
+static void check_number(const NumberCase* c) {
+    JsonNumber number;
+    if (!json_number_parse(slice(c->text), &number)) {
+        CHECK(false, "%s: rejected", c->text);
+        return;
+    }
+    
+    CHECK(number.type == c->type, "%s: type %d, expected %d", c->text, number.type, c->type);
+    if (number.type != c->type) return;
+    switch (c->type) {
+        case JSON_NUMBER_INT:
+            CHECK(number.i == c->i, "%s: %lld", c->text, (long long)number.i);
+            break;
+        case JSON_NUMBER_UINT:
+            CHECK(number.u == c->u, "%s: %llu", c->text, (unsigned long long)number.u);
+            break;
+        case JSON_NUMBER_DOUBLE:
+            CHECK(same_double(number.d, c->d), "%s: %.17g, expected %.17g", c->text, number.d, c->d);
+            break;
+    }
+}
+
+#define INT(text, value) { text, JSON_NUMBER_INT, value, 0, 0 }
+#define UINT(text, value) { text, JSON_NUMBER_UINT, 0, value, 0 }
+#define DOUBLE(text, value) { text, JSON_NUMBER_DOUBLE, 0, 0, value }
+
+static void test_numbers(void) {
+    const NumberCase cases[] = {
+        INT("0", 0),
+        INT("-1", -1),
+        DOUBLE("-0", -0.0),
+        DOUBLE("-0.0", -0.0),
+        DOUBLE("0e5", 0.0),
+        DOUBLE("-0e-5", -0.0),
+        
+        // Integers at the edges of int64 and uint64
+        INT("9223372036854775807", INT64_MAX),
+        INT("-9223372036854775807", -INT64_MAX),
+        INT("-9223372036854775808", INT64_MIN),
+        DOUBLE("-9223372036854775809", -9223372036854775808.0),
+        UINT("9223372036854775808", 9223372036854775808ull),
+        UINT("18446744073709551615", UINT64_MAX),
+        DOUBLE("18446744073709551616", 18446744073709551616.0),
+        DOUBLE("18446744073709551617", 18446744073709551616.0),
+        DOUBLE("-18446744073709551616", -18446744073709551616.0),
+        DOUBLE("123456789012345678901234567890", 1.2345678901234568e29),
+        DOUBLE("1e2", 100.0),
+        DOUBLE("1.0", 1.0),
+        
+        // Around 2^53, where doubles stop holding every integer
+        INT("9007199254740993", 9007199254740993),
+        DOUBLE("9007199254740991.0", 9007199254740991.0),
+        DOUBLE("9007199254740993.0", 9007199254740992.0),
+        DOUBLE("9007199254740995.0", 9007199254740996.0),
+        DOUBLE("9007199254740993.0000000000000001", 9007199254740994.0),
+        
+        // Boundary doubles
+        DOUBLE("1.7976931348623157e308", DBL_MAX),
+        DOUBLE("-1.7976931348623157e308", -DBL_MAX),
+        DOUBLE("1.7976931348623158e308", DBL_MAX),
+        DOUBLE("1.7976931348623159e308", INFINITY),
+        DOUBLE("2.2250738585072014e-308", DBL_MIN),
+        DOUBLE("2.2250738585072011e-308", 2.2250738585072009e-308),
+        DOUBLE("4.9406564584124654e-324", 4.9406564584124654e-324),
+        DOUBLE("5e-324", 4.9406564584124654e-324),
+        DOUBLE("2.4703282292062328e-324", 4.9406564584124654e-324),
+        DOUBLE("2.4703282292062327e-324", 0.0),
+        DOUBLE("0.1", 0.1),
+        DOUBLE("0.30000000000000004", 0.30000000000000004),
+        DOUBLE("1e23", 1e23),
+        DOUBLE("8.98846567431158e307", 8.98846567431158e307),
+        
+        // Exponents that overflow or underflow, down to zero of either sign
+        DOUBLE("1e309", INFINITY),
+        DOUBLE("1e400", INFINITY),
+        DOUBLE("-1e400", -INFINITY),
+        DOUBLE("1e-400", 0.0),
+        DOUBLE("-1e-400", -0.0),
+        DOUBLE("1e99999999999999999999", INFINITY),
+        DOUBLE("1e-99999999999999999999", 0.0),
+        DOUBLE("0.000001e-99999999999999999999", 0.0),
+        DOUBLE("1E+2", 100.0),
+        DOUBLE("1e-7", 1e-7),
+        DOUBLE("0.0000000000000000000000000000001e331", 1e300),
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) check_number(&cases[i]);
+    
+    // The RFC 8259 grammar and nothing more
+    const char* invalid[] = {
+        "", "-", "+1", "01", "-01", "00", "1.", ".1", "1.e5", "1e", "1e+", "1e-",
+        "0x10", "1 ", " 1", "Infinity", "-Infinity", "NaN", "1.5.2", "1e5e5", "--1",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        CHECK(!json_number_parse(slice(invalid[i]), NULL), "\"%s\": accepted", invalid[i]);
+    }
+    
+    // Random doubles of up to 25 digits: every path must agree with strtod()
+    uint64_t state = 88172645463325252ull;
+    char text[64];
+    for (int n = 0; n < 200000; n++) {
+        size_t length = 0;
+        if (next_random(&state) & 1) text[length++] = '-';
+        size_t digits = 1 + next_random(&state) % 25;
+        size_t point = next_random(&state) % (digits + 1);
+        for (size_t k = 0; k < digits; k++) {
+            if (k == point && k > 0) text[length++] = '.';
+            uint64_t digit = k == 0 && digits > 1 ? 1 + next_random(&state) % 9 : next_random(&state) % 10;
+            text[length++] = (char)('0' + digit);
+        }
+        int exponent = (int)(next_random(&state) % 700) - 350;
+        length += (size_t)snprintf(text + length, sizeof(text) - length, "e%d", exponent);
+        
+        JsonNumber number;
+        if (!json_number_parse((JsonSlice){ text, length }, &number)) {
+            CHECK(false, "%s: rejected", text);
+            continue;
+        }
+        double expected = strtod(text, NULL);
+        CHECK(number.type == JSON_NUMBER_DOUBLE && same_double(number.d, expected),
+              "%s: %.17g, expected %.17g", text, number.d, expected);
+    }
+}
+
+// --- String escapes ---
+
+static void check_unescape(const char* text, const char* expected, size_t expected_length) {
+    char out[64];
+    size_t length = json_unescape_into(slice(text), out);
+    CHECK(length == expected_length && memcmp(out, expected, length) == 0,
+          "\"%s\": decoded to %zu bytes, expected %zu", text, length, expected_length);
+}
+
+static void test_unescape(void) {
+    check_unescape("plain", "plain", 5);
+    check_unescape("\\u0061", "a", 1);
+    check_unescape("caf\\u00e9", "caf\xc3\xa9", 5);
+    check_unescape("\\u20AC", "\xe2\x82\xac", 3);
+    check_unescape("\\ud83d\\ude00", "\xf0\x9f\x98\x80", 4);
+    check_unescape("\\ud83d", "\xef\xbf\xbd", 3);
+    check_unescape("\\ude00x", "\xef\xbf\xbdx", 4);
+    check_unescape("\\ud83d\\u0061", "\xef\xbf\xbd" "a", 4);
+    check_unescape("\\u0000", "\0", 1);
+    check_unescape("\\\"\\\\\\/\\b\\f\\n\\r\\t", "\"\\/\b\f\n\r\t", 8);
+    check_unescape("\\u12", "\\u12", 4);
+    check_unescape("\\x", "\\x", 2);
+    
+    char* decoded = json_unescape_slice(slice("\\u0061\\u00e9"));
+    CHECK(decoded && strcmp(decoded, "a\xc3\xa9") == 0, "json_unescape_slice");
+    json_free(decoded);
+}
+
+// --- Object lookups ---
+
+// Parses `text`, which must outlive the tree
+static TreeNode* parse(const char* text, JsonParser** parser) {
+    *parser = json_parser_create_borrowed(text, strlen(text));
+    TreeNode* root = *parser ? json_parse_tree(*parser) : NULL;
+    CHECK(root != NULL, "cannot parse %.60s", text);
+    return root;
+}
+
+// Checks that json_object_get() finds the member whose value is written
+// `expected`, or no member if it is NULL
+static void check_member(const TreeNode* object, const char* key, size_t len, const char* expected) {
+    const TreeNode* member = json_object_get(object, key, len);
+    if (!expected) {
+        CHECK(member == NULL, "%zu members, \"%.*s\": found, expected none",
+              object->children_count, (int)len, key);
+        return;
+    }
+    JsonSlice found = member ? member->value : slice("none");
+    CHECK(member && found.length == strlen(expected) && memcmp(found.data, expected, found.length) == 0,
+          "%zu members, \"%.*s\": %.*s, expected %s", object->children_count, (int)len, key,
+          JSON_SLICE_ARGS(found), expected);
+}
+
+// Object of `count` members "k0": 0 .. "kN": N, every third name spelled
+// with its k escaped, then repeats of the first two names, with the other
+// spelling, that must lose to the first ones
+static char* numbered_object(size_t count) {
+    size_t size = count * 32 + 64;
+    char* text = malloc(size);
+    if (!text) return NULL;
+    
+    size_t length = 0;
+    text[length++] = '{';
+    for (size_t i = 0; i < count; i++) {
+        length += (size_t)snprintf(text + length, size - length, "\"%s%zu\": %zu, ",
+                                   i % 3 == 0 ? "\\u006b" : "k", i, i);
+    }
+    snprintf(text + length, size - length, "\"k0\": \"repeat\", \"\\u006b1\": \"repeat\"}");
+    return text;
+}
+
+static void test_object_get(void) {
+    // Scanned, then at and past the size that gets a hash index
+    const size_t sizes[] = { 4, JSON_OBJECT_INDEX_MIN - 1, JSON_OBJECT_INDEX_MIN, JSON_OBJECT_INDEX_MIN + 1, 1000 };
+    for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+        size_t count = sizes[n] - 2;
+        char* text = numbered_object(count);
+        JsonParser* parser = NULL;
+        TreeNode* root = text ? parse(text, &parser) : NULL;
+        if (!root) {
+            json_parser_destroy(parser);
+            free(text);
+            continue;
+        }
+        CHECK(root->children_count == sizes[n], "%zu members, expected %zu", root->children_count, sizes[n]);
+        
+        // The second round goes through the index the first one built
+        char key[32];
+        char value[32];
+        for (int round = 0; round < 2; round++) {
+            for (size_t i = 0; i < count; i++) {
+                snprintf(key, sizeof(key), "k%zu", i);
+                snprintf(value, sizeof(value), "%zu", i);
+                check_member(root, key, strlen(key), value);
+            }
+            snprintf(key, sizeof(key), "k%zu", count);
+            check_member(root, key, strlen(key), NULL);
+            check_member(root, "k", 1, NULL);
+            check_member(root, "", 0, NULL);
+            check_member(root, NULL, 0, NULL);
+            check_member(root, "\\u006b1", 7, NULL);
+            check_member(root, "k1 and more", 2, "1");
+        }
+        
+        tree_node_destroy(root);
+        json_parser_destroy(parser);
+        free(text);
+    }
+    
+    // Names whose escapes decode to text that is spelled differently, with
+    // and without enough padding members for an index
+    const char* names = "{\"caf\\u00e9\": 1, \"caf\xc3\xa9\": 2, \"\\ud83d\\ude00\": 3, "
+                        "\"nul\\u0000byte\": 4, \"\": 5, \"q\\\"uote\": 6, \"tab\\t\": 7, \"\\ud83d\": 8, "
+                        "\"\\u0041BC\": 9, \"ABC\": 10";
+    for (size_t padding = 0; padding <= JSON_OBJECT_INDEX_MIN; padding += JSON_OBJECT_INDEX_MIN) {
+        char text[2048];
+        size_t length = (size_t)snprintf(text, sizeof(text), "%s", names);
+        for (size_t i = 0; i < padding; i++) {
+            length += (size_t)snprintf(text + length, sizeof(text) - length, ", \"p%zu\": 0", i);
+        }
+        snprintf(text + length, sizeof(text) - length, "}");
+        
+        JsonParser* parser = NULL;
+        TreeNode* root = parse(text, &parser);
+        if (root) {
+            check_member(root, "caf\xc3\xa9", 5, "1");
+            check_member(root, "\xf0\x9f\x98\x80", 4, "3");
+            check_member(root, "nul\0byte", 8, "4");
+            check_member(root, "nul", 3, NULL);
+            check_member(root, "", 0, "5");
+            check_member(root, "q\"uote", 6, "6");
+            check_member(root, "tab\t", 4, "7");
+            check_member(root, "\xef\xbf\xbd", 3, "8");
+            check_member(root, "ABC", 3, "9");
+            tree_node_destroy(root);
+        }
+        json_parser_destroy(parser);
+    }
+    
+    // Hand-built objects, whose names repeat after JSON_OBJECT_INDEX_MIN + 8
+    // members: the index is dropped when a member is added
+    TreeNode* object = tree_node_create(NULL, NULL, JSON_OBJECT);
+    char key[32];
+    char value[32];
+    for (size_t i = 0; i < 2 * JSON_OBJECT_INDEX_MIN; i++) {
+        snprintf(key, sizeof(key), "k%zu", i % (JSON_OBJECT_INDEX_MIN + 8));
+        snprintf(value, sizeof(value), "%zu", i);
+        tree_node_add_child(object, tree_node_create(key, value, JSON_NUMBER));
+        
+        // A new name is found past a stale index; a repeated one is not
+        snprintf(value, sizeof(value), "%zu", i % (JSON_OBJECT_INDEX_MIN + 8));
+        check_member(object, key, strlen(key), value);
+    }
+    tree_node_destroy(object);
+}
+
+int main(void) {
+    test_numbers();
+    test_unescape();
+    test_object_get();
+    
+    if (failures > 0) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("API checks passed\n");
+    return 0;
+}